@@ -0,0 +1,140 @@
+/*
+空闲位查找微基准
+
+在接近满的位图上比较：
+- 逐位查找（原来的 get_bitmap_bit 循环）
+- 按 64 位字查找（find_free_bit）
+- 按 64 位字查找 + next-fit 游标（find_free_bit_from）
+
+用法: bench/bitmap_bench [-b 位图字节数] [-f 占用比例%] [-n 分配次数]
+*/
+#include "../include/disk.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// 原来的实现：逐位检查
+static int naive_find_free_bit(uint8_t *bitmap, int size)
+{
+    for (int i = 0; i < size * 8; i++)
+    {
+        if (!get_bitmap_bit(bitmap, i))
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// 按占用比例随机填充位图，前半部分全满（模拟长期使用后低地址被占满）
+static void fill_bitmap(uint8_t *bitmap, int size, double full_ratio)
+{
+    int nbits = size * 8;
+    memset(bitmap, 0, size);
+    for (int i = 0; i < nbits; i++)
+    {
+        if (i < nbits / 2 || (double)rand() / RAND_MAX < full_ratio)
+        {
+            set_bitmap_bit(bitmap, i);
+        }
+    }
+}
+
+typedef int (*alloc_fn)(uint8_t *bitmap, int size, int *cursor);
+
+static int alloc_naive(uint8_t *bitmap, int size, int *cursor)
+{
+    (void)cursor;
+    return naive_find_free_bit(bitmap, size);
+}
+
+static int alloc_word(uint8_t *bitmap, int size, int *cursor)
+{
+    (void)cursor;
+    return find_free_bit(bitmap, size);
+}
+
+static int alloc_next_fit(uint8_t *bitmap, int size, int *cursor)
+{
+    int bit = find_free_bit_from(bitmap, size * 8, *cursor);
+    if (bit != -1)
+    {
+        *cursor = bit + 1;
+    }
+    return bit;
+}
+
+// 连续分配 nalloc 次，返回每次分配的平均纳秒数
+static double run_allocs(alloc_fn fn, const uint8_t *initial, int size, int nalloc)
+{
+    uint8_t *bitmap = malloc(size);
+    memcpy(bitmap, initial, size);
+    int cursor = 0;
+
+    double start = now_sec();
+    int done = 0;
+    for (; done < nalloc; done++)
+    {
+        int bit = fn(bitmap, size, &cursor);
+        if (bit == -1)
+        {
+            break;
+        }
+        set_bitmap_bit(bitmap, bit);
+    }
+    double elapsed = now_sec() - start;
+    free(bitmap);
+    return done ? elapsed * 1e9 / done : 0;
+}
+
+int main(int argc, char *argv[])
+{
+    int sizes[] = {1024, 8192, 65536};
+    int nsizes = 3;
+    int custom_size = 0;
+    double full_pct = 99.0;
+    int nalloc = 2000;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "b:f:n:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'b': custom_size = atoi(optarg); break;
+        case 'f': full_pct = atof(optarg); break;
+        case 'n': nalloc = atoi(optarg); break;
+        default:
+            fprintf(stderr, "usage: %s [-b bitmap_bytes] [-f full_percent] [-n allocations]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (custom_size > 0)
+    {
+        sizes[0] = custom_size;
+        nsizes = 1;
+    }
+
+    srand(1);
+    printf("%-10s %-8s %14s %14s %14s\n", "bitmap", "full%", "naive ns/op", "word ns/op", "nextfit ns/op");
+    for (int i = 0; i < nsizes; i++)
+    {
+        uint8_t *bitmap = malloc(sizes[i]);
+        fill_bitmap(bitmap, sizes[i], full_pct / 100.0);
+
+        double naive = run_allocs(alloc_naive, bitmap, sizes[i], nalloc);
+        double word = run_allocs(alloc_word, bitmap, sizes[i], nalloc);
+        double next = run_allocs(alloc_next_fit, bitmap, sizes[i], nalloc);
+        printf("%-10d %-8.1f %14.1f %14.1f %14.1f\n", sizes[i] * 8, full_pct, naive, word, next);
+        free(bitmap);
+    }
+    return 0;
+}
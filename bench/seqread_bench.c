@@ -0,0 +1,192 @@
+/*
+大文件顺序读吞吐测试
+
+格式化一个镜像，顺序写入一个大文件（会用到一级/二级间接块），再按固定的读大小顺序读完整个文件，
+分别测试块指针映射和 extent 映射，冷读（重新挂载，缓存为空）和热读两种情况。
+
+用法: bench/seqread_bench [-f 镜像] [-s 文件大小KB] [-c 每次读取KB] [-n 重复次数] [-o 额外挂载选项]
+文件默认 8MB，镜像按文件大小加上余量（间接块、各组的元数据、日志）格式化。
+*/
+#include "../include/ext2.h"
+#include "../include/disk.h"
+#include "../include/inode.h"
+#include "../include/directory.h"
+#include "../include/commands.h"
+#include "../include/user.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// 文件系统命令会往标准输出打印提示，测试期间把它们丢掉
+static int saved_stdout = -1;
+
+static void quiet(int on)
+{
+    fflush(stdout);
+    if (on)
+    {
+        saved_stdout = dup(STDOUT_FILENO);
+        int null_fd = open("/dev/null", O_WRONLY);
+        dup2(null_fd, STDOUT_FILENO);
+        close(null_fd);
+    }
+    else if (saved_stdout != -1)
+    {
+        dup2(saved_stdout, STDOUT_FILENO);
+        close(saved_stdout);
+        saved_stdout = -1;
+    }
+}
+
+static int mount_image(const char *image, const char *extra, int extents)
+{
+    mount_options_t opts;
+    default_mount_options(&opts);
+    if (extra != NULL && parse_mount_options(extra, &opts) != 0)
+    {
+        return -1;
+    }
+    opts.use_extents = extents;
+    if (ext2_init(image, &opts) != 0)
+    {
+        return -1;
+    }
+    return cmd_login("root", "root");
+}
+
+// 顺序读完整个文件，返回 MB/s
+static double read_file(uint32_t ino, size_t size, size_t chunk, char *buf)
+{
+    double start = now_sec();
+    size_t done = 0;
+    while (done < size)
+    {
+        ssize_t n = read_inode_data(ino, buf, chunk, done);
+        if (n <= 0)
+        {
+            return -1;
+        }
+        done += n;
+    }
+    return size / (now_sec() - start) / (1024.0 * 1024.0);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *image = "seqread_bench.img";
+    size_t size_kb = 8192;
+    size_t chunk_kb = 64;
+    int iterations = 20;
+    const char *extra = NULL;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "f:s:c:n:o:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'f': image = optarg; break;
+        case 's': size_kb = atol(optarg); break;
+        case 'c': chunk_kb = atol(optarg); break;
+        case 'n': iterations = atoi(optarg); break;
+        case 'o': extra = optarg; break;
+        default:
+            fprintf(stderr, "usage: %s [-f image] [-s file_kb] [-c chunk_kb] [-n iterations] [-o mount_opts]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (chunk_kb == 0 || iterations <= 0 || size_kb == 0)
+    {
+        fprintf(stderr, "Error: file size, chunk size and iterations must be positive\n");
+        return 1;
+    }
+    if (size_kb >= 4 * 1024 * 1024)
+    {
+        fprintf(stderr, "Error: file size must be below 4 GB\n");
+        return 1;
+    }
+
+    format_options_t fmt;
+    default_format_options(&fmt);
+    uint64_t data_blocks = ((uint64_t)size_kb * 1024 + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    uint64_t image_blocks = data_blocks + data_blocks / 8 + EXT2_DEFAULT_BLOCKS_COUNT;
+    if (image_blocks > UINT32_MAX)
+    {
+        fprintf(stderr, "Error: file size too large for this block size\n");
+        return 1;
+    }
+    fmt.blocks_count = (uint32_t)image_blocks;
+
+    size_t chunk = chunk_kb * 1024;
+    char *buf = malloc(chunk);
+    if (buf == NULL)
+    {
+        return 1;
+    }
+    memset(buf, 'x', chunk);
+
+    printf("%-8s %10s %8s %14s %14s\n", "mapping", "file KB", "read KB", "cold MB/s", "warm MB/s");
+    for (int extents = 0; extents <= 1; extents++)
+    {
+        quiet(1);
+        int ok = cmd_format(image, &fmt) == 0 && mount_image(image, extra, extents) == 0 &&
+                 cmd_create("/bench") == 0;
+        uint32_t ino = 0;
+        ok = ok && path_to_inode("/bench", &ino) == 0;
+
+        size_t size = size_kb * 1024;
+        size_t written = 0;
+        while (ok && written < size)
+        {
+            size_t n = size - written < chunk ? size - written : chunk;
+            ok = write_inode_data(ino, buf, n, written) == (ssize_t)n;
+            written += n;
+        }
+        quiet(0);
+        if (!ok)
+        {
+            fprintf(stderr, "Error: Failed to prepare %zu KB test file\n", size / 1024);
+            free(buf);
+            return 1;
+        }
+
+        double cold = 0, warm = 0;
+        for (int i = 0; i < iterations; i++)
+        {
+            // 重新挂载，块缓存和inode缓存都清空
+            quiet(1);
+            ext2_cleanup();
+            ok = mount_image(image, extra, extents) == 0;
+            quiet(0);
+            double c = ok ? read_file(ino, size, chunk, buf) : -1;
+            double w = ok ? read_file(ino, size, chunk, buf) : -1;
+            if (c < 0 || w < 0)
+            {
+                fprintf(stderr, "Error: Read failed\n");
+                free(buf);
+                return 1;
+            }
+            cold += c;
+            warm += w;
+        }
+        printf("%-8s %10zu %8zu %14.1f %14.1f\n", extents ? "extent" : "blockmap",
+               size / 1024, chunk_kb, cold / iterations, warm / iterations);
+
+        quiet(1);
+        ext2_cleanup();
+        quiet(0);
+    }
+
+    free(buf);
+    unlink(image);
+    return 0;
+}
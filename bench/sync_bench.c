@@ -0,0 +1,171 @@
+/*
+持久化模式对比测试
+
+格式化一个带日志的镜像，逐个创建小文件并写入数据，每个文件相当于 shell 中的一条命令
+（结束时调用 sync_fs_metadata，由组提交决定什么时候提交事务）。
+分别测试 data=writeback 和 data=ordered，以及每个文件写完后是否 fsync，
+输出每秒文件数、事务提交数、ordered 模式下的数据屏障数和日志检查点数。
+
+用法: bench/sync_bench [-f 镜像] [-n 文件数] [-s 文件大小KB] [-o 额外挂载选项]
+镜像放在要测试的文件系统上（默认当前目录），fdatasync 的开销取决于底层设备。
+*/
+#include "../include/ext2.h"
+#include "../include/disk.h"
+#include "../include/inode.h"
+#include "../include/directory.h"
+#include "../include/commands.h"
+#include "../include/journal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// 文件系统命令会往标准输出打印提示，测试期间把它们丢掉
+static int saved_stdout = -1;
+
+static void quiet(int on)
+{
+    fflush(stdout);
+    if (on)
+    {
+        saved_stdout = dup(STDOUT_FILENO);
+        int null_fd = open("/dev/null", O_WRONLY);
+        dup2(null_fd, STDOUT_FILENO);
+        close(null_fd);
+    }
+    else if (saved_stdout != -1)
+    {
+        dup2(saved_stdout, STDOUT_FILENO);
+        close(saved_stdout);
+        saved_stdout = -1;
+    }
+}
+
+static int mount_image(const char *image, const char *extra, data_mode_t mode)
+{
+    mount_options_t opts;
+    default_mount_options(&opts);
+    if (extra != NULL && parse_mount_options(extra, &opts) != 0)
+    {
+        return -1;
+    }
+    opts.data_mode = mode;
+    if (ext2_init(image, &opts) != 0)
+    {
+        return -1;
+    }
+    return cmd_login("root", "root");
+}
+
+int main(int argc, char *argv[])
+{
+    const char *image = "sync_bench.img";
+    int nfiles = 200;
+    size_t size_kb = 16;
+    const char *extra = NULL;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "f:n:s:o:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'f': image = optarg; break;
+        case 'n': nfiles = atoi(optarg); break;
+        case 's': size_kb = atol(optarg); break;
+        case 'o': extra = optarg; break;
+        default:
+            fprintf(stderr, "usage: %s [-f image] [-n files] [-s file_kb] [-o mount_opts]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (nfiles <= 0 || size_kb == 0)
+    {
+        fprintf(stderr, "Error: file count and size must be positive\n");
+        return 1;
+    }
+
+    size_t size = size_kb * 1024;
+    char *buf = malloc(size);
+    if (buf == NULL)
+    {
+        return 1;
+    }
+    memset(buf, 'x', size);
+
+    // 镜像要放得下所有文件（加上间接块和日志），至少 16MB
+    format_options_t fmt;
+    default_format_options(&fmt);
+    uint64_t need = (uint64_t)nfiles * (size + 2 * BLOCK_SIZE) * 2;
+    uint64_t image_bytes = need > 16 * 1024 * 1024 ? need : 16 * 1024 * 1024;
+    fmt.blocks_count = (uint32_t)(image_bytes / BLOCK_SIZE);
+
+    static const struct
+    {
+        const char *name;
+        data_mode_t mode;
+    } modes[] = {
+        { "writeback", DATA_WRITEBACK },
+        { "ordered", DATA_ORDERED },
+    };
+
+    printf("%-10s %6s %10s %8s %12s %12s\n", "data", "fsync", "files/s", "commits", "data flushes", "checkpoints");
+    for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++)
+    {
+        for (int per_file_sync = 0; per_file_sync <= 1; per_file_sync++)
+        {
+            quiet(1);
+            int ok = cmd_format(image, &fmt) == 0 && mount_image(image, extra, modes[m].mode) == 0;
+            journal_stats_t js0, js1;
+            durability_stats_t ds0, ds1;
+            journal_get_stats(&js0);
+            get_durability_stats(&ds0);
+
+            double start = now_sec();
+            char path[64];
+            for (int i = 0; ok && i < nfiles; i++)
+            {
+                snprintf(path, sizeof(path), "/f%d", i);
+                uint32_t ino = 0;
+                ok = cmd_create(path) == 0 && path_to_inode(path, &ino) == 0 &&
+                     write_inode_data(ino, buf, size, 0) == (ssize_t)size;
+                sync_fs_metadata();
+                if (ok && per_file_sync)
+                {
+                    ok = sync_filesystem() == 0;
+                }
+            }
+            // 最后一次 sync 让各种模式都以全部落盘结束，计时才可比
+            ok = ok && sync_filesystem() == 0;
+            double elapsed = now_sec() - start;
+
+            journal_get_stats(&js1);
+            get_durability_stats(&ds1);
+            ext2_cleanup();
+            quiet(0);
+            if (!ok)
+            {
+                fprintf(stderr, "Error: Benchmark failed (data=%s)\n", modes[m].name);
+                free(buf);
+                return 1;
+            }
+            printf("%-10s %6s %10.0f %8llu %12llu %12llu\n", modes[m].name, per_file_sync ? "yes" : "no",
+                   nfiles / elapsed,
+                   (unsigned long long)(js1.commits - js0.commits),
+                   (unsigned long long)(ds1.data_flushes - ds0.data_flushes),
+                   (unsigned long long)(js1.checkpoints - js0.checkpoints));
+        }
+    }
+
+    unlink(image);
+    free(buf);
+    return 0;
+}
@@ -10,6 +10,7 @@ int cmd_open(const char *path, int flags);
 int cmd_close(int fd);
 int cmd_read(int fd, void *buffer, size_t size);
 int cmd_write(int fd, const void *buffer, size_t size);
+int cmd_fsync(int fd);
 
 // 目录操作命令
 int cmd_dir(const char *path);
@@ -23,10 +24,11 @@ int cmd_logout(void);
 int cmd_users(void);
 
 // 文件系统管理命令
-int cmd_format(const char *disk_image);
-int cmd_mount(const char *disk_image);
+int cmd_format(const char *disk_image, const format_options_t *opts);
+int cmd_mount(const char *disk_image, const mount_options_t *opts);
 int cmd_umount(void);
 int cmd_status(void);
+int cmd_sync(void);
 
 // 权限管理命令
 int cmd_chmod(const char *path, uint16_t mode);
@@ -2,6 +2,7 @@
 #define DIRECTORY_H
 
 #include "ext2.h"
+#include <stddef.h>
 
 // 目录操作
 int create_directory(const char *path, uint16_t mode);
@@ -14,16 +15,61 @@ int change_directory(const char *path);
 int add_directory_entry(uint32_t parent_inode, const char *name, uint32_t child_inode, uint8_t file_type);
 int remove_directory_entry(uint32_t parent_inode, const char *name);
 int find_directory_entry(uint32_t parent_inode, const char *name, ext2_dir_entry_t *entry);
+int find_directory_name(uint32_t dir_inode, uint32_t child_inode, char *name, size_t size);
+
+// 目录块格式（变长目录项）
+void dir_block_init(uint8_t *buffer);
+int dir_block_insert(uint8_t *buffer, const char *name, uint32_t child_inode, uint8_t file_type);
+
+// 目录项缓存：按 (父目录inode, 名字) 缓存查找结果，包括“不存在”的负项
+#define DCACHE_CAPACITY 256
+
+typedef struct {
+    uint64_t hits;
+    uint64_t negative_hits;
+    uint64_t misses;
+} dcache_stats_t;
+
+void dcache_invalidate(void);
+void dcache_forget_dir(uint32_t dir_inode);
+void dcache_get_stats(dcache_stats_t *stats);
+
+// 目录的父目录映射
+int get_dir_parent(uint32_t dir_inode, uint32_t *parent, char *name, size_t size);
+uint32_t dir_tree_generation(void);
 
 // 路径解析
 int path_to_inode(const char *path, uint32_t *inode_no);
 int get_parent_inode(const char *path, uint32_t *parent_inode, char *child_name);
 
-// 目录遍历
-int read_directory_entries(uint32_t inode_no, ext2_dir_entry_t *entries, int max_entries);
+// 目录遍历游标
+typedef struct {
+    uint32_t dir_inode;
+    uint32_t block_index;         // 下一个要读入的逻辑块
+    uint32_t offset;              // 当前块内下一项的偏移
+    uint8_t block[BLOCK_SIZE];    // 当前目录块
+    char name[MAX_FILENAME + 1];  // 当前项的名字
+} dir_iter_t;
+
+typedef struct {
+    uint32_t inode;
+    uint8_t file_type;
+    uint8_t name_len;
+    const char *name;             // 指向游标内部，下一次 dir_next 后失效
+} dir_entry_view_t;
+
+int dir_open(uint32_t dir_inode, dir_iter_t *it);
+int dir_next(dir_iter_t *it, dir_entry_view_t *view);
+
+// 读目录并批量取出各项的inode（readdirplus）
+typedef struct {
+    uint32_t inode;
+    uint8_t file_type;
+    char name[MAX_FILENAME + 1];
+    ext2_inode_t attr;            // 读取失败时全为0
+} dir_entry_plus_t;
 
-// 目录大小计算
-uint32_t calculate_directory_size(uint32_t dir_inode);
+int read_directory_plus(uint32_t dir_inode, dir_entry_plus_t **entries);
 
 // 特殊目录项
 int create_dot_entries(uint32_t dir_inode, uint32_t parent_inode);
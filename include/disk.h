@@ -3,31 +3,125 @@
 
 #include "ext2.h"
 #include <stdint.h>
+#include <sys/uio.h>
 
 // 位图操作
 void set_bitmap_bit(uint8_t *bitmap, int bit);
 void clear_bitmap_bit(uint8_t *bitmap, int bit);
 int get_bitmap_bit(uint8_t *bitmap, int bit);
 int find_free_bit(uint8_t *bitmap, int size);
+int find_free_bit_from(const uint8_t *bitmap, int nbits, int start);
+
+// 磁盘后端
+typedef enum {
+    DISK_BACKEND_BUFFERED = 0,    // pread/pwrite + 块缓存
+    DISK_BACKEND_MMAP             // 整个镜像 mmap 到内存
+} disk_backend_t;
 
 // 磁盘操作
 int read_block(uint32_t block_no, void *buffer);
 int write_block(uint32_t block_no, const void *buffer);
+int read_blocks(uint32_t start, uint32_t count, void *buffer);
+int write_blocks(uint32_t start, uint32_t count, const void *buffer);
+int read_blocks_iov(uint32_t start, const struct iovec *iov, int iovcnt);
+int write_blocks_iov(uint32_t start, const struct iovec *iov, int iovcnt);
+const void *get_block_ptr(uint32_t block_no);
+
+// 批量块请求（经 I/O 引擎并发执行）
+typedef struct {
+    int write;                    // 0 读，1 写
+    uint32_t block_no;            // 起始块号
+    const struct iovec *iov;      // 总长度必须是 BLOCK_SIZE 的整数倍
+    int iovcnt;
+} block_request_t;
+
+int submit_block_batch(block_request_t *reqs, int nr);
+int prefetch_blocks(const uint32_t *blocks, int n);
+int create_disk_image(const char *filename, uint32_t nblocks, int prealloc,
+                      const block_request_t *meta, int nr);
+const ext2_inode_t *get_inode_ptr(uint32_t inode_no);
 int read_inode(uint32_t inode_no, ext2_inode_t *inode);
+int read_inodes(const uint32_t *inode_nos, int count, ext2_inode_t *out);
 int write_inode(uint32_t inode_no, const ext2_inode_t *inode);
 
+// inode缓存：按inode号哈希，引用计数，脏inode在淘汰、icache_sync 或卸载时写回
+#define ICACHE_CAPACITY 256
+
+typedef struct {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t writebacks;
+} icache_stats_t;
+
+// 每个缓存inode附带的块映射缓存：最近解析出的一段连续的逻辑块到物理块映射
+typedef struct {
+    uint32_t lblk;                // 起始逻辑块号
+    uint32_t pblk;                // 起始物理块号，0 表示这一段是空洞
+    uint32_t len;                 // 块数，0 表示缓存无效
+} block_map_cache_t;
+
+ext2_inode_t *iget(uint32_t inode_no);
+void iput(ext2_inode_t *inode);
+void mark_inode_dirty(ext2_inode_t *inode);
+block_map_cache_t *inode_block_map(ext2_inode_t *inode);
+int icache_sync(void);
+void icache_invalidate(void);
+void icache_get_stats(icache_stats_t *stats);
+
+// 块缓存
+#define BCACHE_DEFAULT_CAPACITY 64  // 默认缓存块数
+#define BCACHE_MIN_CAPACITY 4
+
+typedef struct {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t writebacks;
+    uint64_t evictions;
+} bcache_stats_t;
+
+int bcache_flush(void);
+void bcache_invalidate(void);
+int bcache_set_capacity(uint32_t capacity);
+uint32_t bcache_get_capacity(void);
+void bcache_get_stats(bcache_stats_t *stats);
+
 // 块分配和释放
 uint32_t allocate_block(void);
+uint32_t allocate_blocks(uint32_t goal, uint32_t want, uint32_t *count);
 void free_block(uint32_t block_no);
-uint32_t allocate_inode(void);
-void free_inode(uint32_t inode_no);
+void free_blocks(uint32_t start, uint32_t count);
+uint32_t allocate_inode(uint32_t parent_inode, int is_dir);
+void free_inode(uint32_t inode_no, int is_dir);
+uint32_t inode_goal_block(uint32_t inode_no);
+
+// 块组
+uint32_t get_group_count(void);
+
+// 未初始化块组的inode表由后台线程清零（挂载后启动，卸载时停止）
+int start_itable_init(void);
+void stop_itable_init(void);
+uint32_t get_itable_init_progress(void);
+
+// 位图、组描述符和超级块的延迟写回：分配/释放只改内存，sync_fs_metadata 一次写回全部脏元数据
+void mark_superblock_dirty(void);
+int sync_fs_metadata(void);
+
+// 元数据日志：把正在运行的事务提交进日志（一次写入、一次 fdatasync）
+int commit_transaction(void);
+
+// 持久化：sync 命令和 fsync 调用 sync_filesystem，返回时之前的修改都已落盘
+typedef struct {
+    uint64_t data_flushes;        // ordered 模式下提交前让文件数据落盘的次数
+    uint64_t syncs;               // sync_filesystem 调用次数
+} durability_stats_t;
+
+int sync_filesystem(void);
+void get_durability_stats(durability_stats_t *stats);
 
 // 文件系统初始化
-int init_disk_image(const char *filename);
+int init_disk_image(const char *filename, disk_backend_t backend);
 void close_disk_image(void);
-
-// 位图管理
-extern uint8_t block_bitmap[BLOCK_SIZE];
-extern uint8_t inode_bitmap[BLOCK_SIZE];
+int sync_disk_image(void);
+disk_backend_t get_disk_backend(void);
 
 #endif // DISK_H 
\ No newline at end of file
@@ -6,15 +6,30 @@
 #include <sys/types.h>
 
 // 文件系统常量
+// 块大小在编译时确定（make BLOCK_SIZE=4096），格式化时记录在超级块中，挂载时校验
+#ifndef BLOCK_SIZE
 #define BLOCK_SIZE 1024
-#define MAX_BLOCKS 1024
-#define MAX_INODES 128
+#endif
+#if BLOCK_SIZE < 1024 || BLOCK_SIZE > 65536 || (BLOCK_SIZE & (BLOCK_SIZE - 1)) != 0
+#error "BLOCK_SIZE must be a power of two between 1024 and 65536"
+#endif
 #define MAX_USERS 16
 #define MAX_FILENAME 255
 #define MAX_PATH 1024
 #define MAX_OPEN_FILES 16
 #define EXT2_ROOT_INO 2
 
+// 格式化的默认几何参数：1MB 镜像，每 8KB 一个inode
+#define EXT2_DEFAULT_BLOCKS_COUNT (1048576 / BLOCK_SIZE)
+#define EXT2_DEFAULT_INODE_RATIO 8192
+#define EXT2_MIN_BLOCKS_PER_GROUP 64
+#define EXT2_MAX_BLOCKS_PER_GROUP (8 * BLOCK_SIZE)  // 每组的块位图只占一个块
+#define EXT2_MAX_INODES_PER_GROUP (8 * BLOCK_SIZE)
+
+// 超级块版本：EXT2_DYNAMIC_REV 表示带块组描述符表的布局
+#define EXT2_GOOD_OLD_REV 0
+#define EXT2_DYNAMIC_REV 1
+
 // 文件类型
 #define EXT2_S_IFSOCK 0xC000
 #define EXT2_S_IFLNK  0xA000
@@ -35,6 +50,25 @@
 #define EXT2_S_IWOTH 0x0002
 #define EXT2_S_IXOTH 0x0001
 
+// inode标志（i_flags）
+#define EXT2_INDEX_FL 0x00001000      // 目录有哈希索引，索引块号在 i_dir_acl
+#define EXT2_EXTENTS_FL 0x00080000    // i_block 中存放的是extent树而不是块指针
+
+// 不兼容特性（s_feature_incompat）
+#define EXT2_FEATURE_INCOMPAT_EXTENTS 0x0040
+
+// 兼容特性（s_feature_compat）
+#define EXT2_FEATURE_COMPAT_HAS_JOURNAL 0x0004   // 有元数据日志区，见 journal.h
+#define EXT2_FEATURE_COMPAT_DIR_INDEX 0x0020
+
+// 只读兼容特性（s_feature_ro_compat）
+#define EXT2_FEATURE_RO_COMPAT_UNINIT_BG 0x0010   // 组描述符中的 bg_flags 和 bg_itable_unused 有效
+
+// 块组标志（bg_flags）
+#define EXT2_BG_INODE_UNINIT 0x0001   // inode位图还没有写过，按全0处理
+#define EXT2_BG_BLOCK_UNINIT 0x0002   // 块位图还没有写过，按组的元数据布局推算
+#define EXT2_BG_INODE_ZEROED 0x0004   // inode表已全部清零
+
 // 超级块结构
 typedef struct {
     uint32_t s_inodes_count;      // Inode数量
@@ -72,8 +106,28 @@ typedef struct {
     char s_volume_name[16];       // 卷名
     char s_last_mounted[64];      // 最后挂载点
     uint32_t s_journal_uuid[4];   // 日志UUID
+    uint32_t s_users_block;       // 用户表所在的第一个块
+    uint32_t s_journal_block;     // 日志区的第一个块
+    uint32_t s_journal_blocks;    // 日志区的块数
 } ext2_superblock_t;
 
+/*
+块组描述符，块 1 开始是描述符表（每组一项）。
+除块 0 的超级块外，镜像按 s_blocks_per_group 分成若干块组，第 g 组从块 1 + g * s_blocks_per_group 开始，
+组内依次是块位图（1 块）、inode位图（1 块）、inode表，其余是数据块；第 0 组在这之前还有描述符表和用户表。
+*/
+typedef struct {
+    uint32_t bg_block_bitmap;     // 块位图所在块
+    uint32_t bg_inode_bitmap;     // inode位图所在块
+    uint32_t bg_inode_table;      // inode表的第一个块
+    uint32_t bg_free_blocks_count; // 组内空闲块数
+    uint32_t bg_free_inodes_count; // 组内空闲inode数
+    uint32_t bg_used_dirs_count;  // 组内目录数
+    uint16_t bg_flags;            // EXT2_BG_* 标志
+    uint16_t bg_pad;
+    uint32_t bg_itable_unused;    // inode表末尾从未使用过的inode数
+} ext2_group_desc_t;
+
 // Inode结构
 typedef struct {
     uint16_t i_mode;              // 文件类型和访问权限
@@ -91,11 +145,12 @@ typedef struct {
     uint32_t i_generation;        // 文件版本
     uint32_t i_file_acl;          // 文件ACL
     uint32_t i_dir_acl;           // 目录ACL
-    uint32_t i_faddr;             // 片段地址
+    uint32_t i_subtree_size_hi;   // 目录：子树大小的高 32 位（原片段地址，未使用）
     uint8_t i_frag;               // 片段号
     uint8_t i_fsize;              // 片段大小
     uint16_t i_pad1;              // 填充
-    uint32_t i_reserved2[2];      // 保留
+    uint32_t i_subtree_size;      // 目录：子树中所有非目录文件的字节数之和（低 32 位）
+    uint32_t i_parent;            // 所在目录的inode号
 } ext2_inode_t;
 
 // 目录项结构
@@ -125,6 +180,43 @@ typedef struct {
     int is_open;
 } open_file_t;
 
+// 挂载选项（mount -o opt1,opt2,...）
+// 读文件时访问时间的更新策略
+typedef enum {
+    ATIME_STRICT = 0,             // 每次读都更新 i_atime
+    ATIME_RELATIME,               // 只在 atime 早于 mtime/ctime 或超过一天时更新
+    ATIME_NOATIME                 // 从不更新
+} atime_mode_t;
+
+#define RELATIME_INTERVAL (24 * 60 * 60)
+
+// 文件数据和元数据事务之间的写入顺序
+typedef enum {
+    DATA_ORDERED = 0,             // 提交事务前先让文件数据落盘，事务不会引用还没写到盘上的数据
+    DATA_WRITEBACK                // 数据不等待，崩溃后元数据一致，但新分配的块里可能是旧内容
+} data_mode_t;
+
+typedef struct {
+    uint32_t cache_blocks;        // 块缓存容量（块数），cache=N
+    int use_mmap;                 // 使用 mmap 后端，mmap
+    char io_engine[16];           // I/O 引擎，io=auto|uring|threads|sync
+    uint32_t io_depth;            // 引擎队列深度，qd=N
+    atime_mode_t atime_mode;      // 访问时间策略，atime|relatime|noatime
+    int use_extents;              // 新建的普通文件使用extent映射，extents
+    int init_itable;              // 挂载后在后台清零未初始化的inode表，init_itable|noinit_itable
+    uint32_t commit_interval;     // 日志事务最长多少秒提交一次，commit=N
+    data_mode_t data_mode;        // 文件数据的写入顺序，data=ordered|writeback
+} mount_options_t;
+
+// 格式化选项（format -o opt1,opt2,...）
+typedef struct {
+    uint32_t blocks_count;        // 镜像总块数，size=N[K|M|G]
+    uint32_t inode_ratio;         // 每多少字节数据分配一个inode，inode_ratio=N
+    uint32_t blocks_per_group;    // 每组块数，blocks_per_group=N（0 表示一个位图块能覆盖的最大值）
+    int prealloc;                 // 用 fallocate 预先分配整个镜像，而不是留成稀疏文件，prealloc
+    uint32_t journal_blocks;      // 日志区块数，journal=N[K|M]（按字节），nojournal 为0
+} format_options_t;
+
 // 文件系统状态
 typedef struct {
     ext2_superblock_t superblock;
@@ -133,11 +225,16 @@ typedef struct {
     open_file_t open_files[MAX_OPEN_FILES];
     int next_fd;
     char disk_image[256];
+    mount_options_t mount_opts;
 } ext2_fs_t;
 
 // 函数声明
-int ext2_init(const char *disk_image);
-int ext2_format(const char *disk_image);
+int ext2_init(const char *disk_image, const mount_options_t *opts);
+void default_mount_options(mount_options_t *opts);
+int parse_mount_options(const char *str, mount_options_t *opts);
+void default_format_options(format_options_t *opts);
+int parse_format_options(const char *str, format_options_t *opts);
+int ext2_format(const char *disk_image, const format_options_t *opts);
 void ext2_cleanup(void);
 
 // 全局变量
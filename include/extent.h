@@ -0,0 +1,58 @@
+#ifndef EXTENT_H
+#define EXTENT_H
+
+#include "ext2.h"
+
+/*
+extent 映射（inode 设置了 EXT2_EXTENTS_FL 时使用）
+
+i_block 的 60 字节里放一个 extent 树头和最多 4 个表项，树的深度记在根节点的 eh_depth 中：
+- 深度 0：表项就是 extent（逻辑起始块、长度、物理起始块）
+- 深度 d > 0：表项是索引，各指向一个深度为 d-1 的节点块；深度 0 的叶子块里放按逻辑块号排序的 extent
+索引项的 ei_block 是子树中第一个extent的逻辑块号。一段物理连续的数据只需要一个 extent，
+查找时每层在有序数组上二分；插入和删除只修改目标叶子，叶子满了对半分裂（追加时只移出最后一项），
+分裂一直传递到根节点时树长高一层。
+*/
+
+#define EXT2_EXT_MAGIC 0xF30A
+#define EXT2_EXT_MAX_LEN 32768                 // 一个extent最多覆盖的块数
+#define EXT2_EXT_MAX_BLOCKS (0xFFFFFFFFu / BLOCK_SIZE)  // 逻辑块号上限（i_size 是32位）
+
+typedef struct {
+    uint16_t eh_magic;            // EXT2_EXT_MAGIC
+    uint16_t eh_entries;          // 有效表项数
+    uint16_t eh_max;              // 表项容量
+    uint16_t eh_depth;            // 0 表示表项是extent，大于0表示表项是索引
+    uint32_t eh_generation;
+} ext2_extent_header_t;
+
+typedef struct {
+    uint32_t ee_block;            // 起始逻辑块号
+    uint16_t ee_len;              // 块数
+    uint16_t ee_start_hi;         // 物理块号高16位（总是0）
+    uint32_t ee_start;            // 起始物理块号
+} ext2_extent_t;
+
+typedef struct {
+    uint32_t ei_block;            // 子树中第一个extent的逻辑块号
+    uint32_t ei_leaf;             // 下一层节点（索引块或叶子块）的物理块号
+    uint32_t ei_unused;
+} ext2_extent_idx_t;
+
+#define EXT2_EXT_ROOT_ENTRIES ((sizeof(((ext2_inode_t *)0)->i_block) - sizeof(ext2_extent_header_t)) / sizeof(ext2_extent_t))
+#define EXT2_EXT_LEAF_ENTRIES ((BLOCK_SIZE - sizeof(ext2_extent_header_t)) / sizeof(ext2_extent_t))
+#define EXT2_EXT_MAX_DEPTH 5                    // 树的最大深度，1KB块时也能放下上亿个extent
+
+// 把 i_block 初始化为空的extent树
+void extent_init(ext2_inode_t *inode);
+
+// 查找 block_index 的映射：*pblk 为物理块号（0 表示空洞），*len 为从 block_index 起连续的块数
+int extent_lookup(const ext2_inode_t *inode, uint32_t block_index, uint32_t *pblk, uint32_t *len);
+
+// 把 [block_index, block_index + count) 映射到从 pblk 开始的物理块，pblk 为0时取消映射（不释放块）
+int extent_map(ext2_inode_t *inode, uint32_t block_index, uint32_t pblk, uint32_t count);
+
+// 释放从 first_index 开始的所有数据块（按整段释放），变空的节点块一并释放
+int extent_truncate(ext2_inode_t *inode, uint32_t first_index);
+
+#endif // EXTENT_H
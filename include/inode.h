@@ -5,10 +5,11 @@
 #include <sys/types.h>
 
 // Inode操作
-int create_inode(uint16_t mode, uint16_t uid, uint16_t gid);
+int create_inode(uint32_t parent_inode, uint16_t mode, uint16_t uid, uint16_t gid);
 int delete_inode(uint32_t inode_no);
 int get_inode_block(uint32_t inode_no, uint32_t block_index, uint32_t *block_no);
 int set_inode_block(uint32_t inode_no, uint32_t block_index, uint32_t block_no);
+int set_inode_blocks(uint32_t inode_no, uint32_t block_index, uint32_t first_block, uint32_t count);
 
 // 文件读写操作
 ssize_t read_inode_data(uint32_t inode_no, void *buffer, size_t size, off_t offset);
@@ -16,7 +17,13 @@ ssize_t write_inode_data(uint32_t inode_no, const void *buffer, size_t size, off
 int truncate_inode(uint32_t inode_no, off_t length);
 
 // 权限检查
+#define PERM_CLASS_OWNER 0
+#define PERM_CLASS_GROUP 1
+#define PERM_CLASS_OTHER 2
+
 int check_permission(uint32_t inode_no, int access);
+int inode_permission_bits(uint32_t inode_no, int *cls);
+void invalidate_permission_cache(uint32_t inode_no);
 int change_permission(uint32_t inode_no, uint16_t mode);
 int change_owner(uint32_t inode_no, uint16_t uid, uint16_t gid);
 
@@ -29,6 +36,12 @@ void update_ctime(uint32_t inode_no);
 int increment_link_count(uint32_t inode_no);
 int decrement_link_count(uint32_t inode_no);
 
+// 目录子树大小
+uint64_t get_subtree_size(const ext2_inode_t *ip);
+void adjust_subtree_size(uint32_t dir_inode, int64_t delta);
+void link_to_parent(uint32_t inode_no, uint32_t parent_inode);
+void unlink_from_parent(uint32_t inode_no, uint32_t parent_inode);
+
 // 工具函数
 int is_directory(uint32_t inode_no);
 int is_regular_file(uint32_t inode_no);
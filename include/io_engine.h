@@ -0,0 +1,65 @@
+#ifndef IO_ENGINE_H
+#define IO_ENGINE_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+/*
+块层的 I/O 引擎接口
+
+一批请求一次性交给引擎，引擎最多同时保持 depth 个请求在途，全部完成后返回。
+可选的实现：
+- io_uring：内核异步 I/O（通过系统调用直接使用，不依赖 liburing）
+- threads：线程池，每个工作线程执行 preadv/pwritev
+- sync：在调用线程中逐个执行，作为最后的回退
+*/
+
+#define IO_ENGINE_DEFAULT_DEPTH 32
+#define IO_ENGINE_MAX_DEPTH 256
+#define IO_ENGINE_MAX_THREADS 16
+
+// submit_and_wait 的返回值：引擎本身已不可用（不是某个请求失败），done 为 0 的请求需要换引擎重做
+#define IO_ENGINE_BROKEN (-2)
+
+typedef enum {
+    IO_OP_READ = 0,
+    IO_OP_WRITE
+} io_op_t;
+
+// 一个块请求：从 offset 开始读/写 iov 描述的缓冲区
+typedef struct {
+    io_op_t op;
+    int fd;
+    off_t offset;
+    const struct iovec *iov;
+    int iovcnt;
+    int result;                   // 0 成功，-1 失败或短读写
+    int done;                     // 引擎已处理完（无论成败），由 io_engine_submit 清零
+} io_request_t;
+
+typedef struct {
+    const char *name;
+    int (*setup)(unsigned depth);
+    int (*submit_and_wait)(io_request_t *reqs, int nr, unsigned depth);
+    void (*teardown)(void);
+} io_engine_t;
+
+extern const io_engine_t io_uring_engine;
+extern const io_engine_t threadpool_engine;
+extern const io_engine_t sync_engine;
+
+// name 为 "auto"/NULL 时优先 io_uring，不可用时回退到线程池
+int io_engine_init(const char *name, unsigned depth);
+void io_engine_shutdown(void);
+const char *io_engine_name(void);
+unsigned io_engine_depth(void);
+
+// 提交一批请求并等待全部完成，任一请求失败返回-1
+// 引擎中途不可用时切换到线程池（或同步引擎），重做尚未完成的请求
+int io_engine_submit(io_request_t *reqs, int nr);
+
+// 请求需要搬运的总字节数
+size_t io_request_bytes(const io_request_t *req);
+
+#endif // IO_ENGINE_H
@@ -0,0 +1,97 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include "ext2.h"
+
+/*
+元数据日志（超级块设置了 EXT2_FEATURE_COMPAT_HAS_JOURNAL 时使用）
+
+格式化时在中间的块组里预留一段连续的块作为日志区，s_journal_block 是第一块，s_journal_blocks 是块数。
+日志记录的是整块的元数据（物理块日志），一个事务在日志区中依次是：
+- 描述符块（一个或多个）：事务序号、记录的块数、撤销数，后面是各块的目标块号和被撤销的块号
+- 元数据块的内容，顺序与描述符中的块号一致
+- 提交块：序号和前面所有块的校验和
+整个事务一次顺序写入日志区，再 fdatasync 一次；校验和保证写了一半的事务在重放时被丢弃。
+
+日志区第 0 块是日志超级块，s_start 为 0 表示日志为空（正常卸载或刚做完检查点），
+否则挂载时从日志区第 1 块开始，按序号依次重放完整的事务，把各块写回原位置。
+日志写满时先做检查点：把已提交的块写回原位置并 fdatasync，然后清空日志从头开始。
+
+块被释放并可能被当作文件数据重新使用时，如果它在日志中还有旧内容，事务里记一条撤销，
+重放时跳过序号不大于撤销所在事务的旧内容，避免用旧的元数据覆盖新的文件数据。
+*/
+
+#define JOURNAL_MAGIC 0xC03B3998
+
+// 日志块类型
+#define JOURNAL_SUPERBLOCK 1
+#define JOURNAL_DESCRIPTOR_BLOCK 2
+#define JOURNAL_COMMIT_BLOCK 3
+
+// 格式化时日志区的默认大小：镜像的 1/32，限制在 [JOURNAL_MIN_BLOCKS, JOURNAL_DEFAULT_MAX_BLOCKS] 内
+#define JOURNAL_SIZE_RATIO 32
+#define JOURNAL_MIN_BLOCKS 16
+#define JOURNAL_DEFAULT_MAX_BLOCKS 4096
+#define JOURNAL_BLOCKS_AUTO 0xFFFFFFFFu   // format_options_t.journal_blocks：按镜像大小计算
+
+// 提交间隔的默认值（秒），commit=N
+#define JOURNAL_DEFAULT_COMMIT_INTERVAL 5
+
+typedef struct {
+    uint32_t h_magic;             // JOURNAL_MAGIC
+    uint32_t h_blocktype;         // JOURNAL_*
+    uint32_t h_sequence;          // 事务序号（日志超级块中不用）
+} journal_header_t;
+
+typedef struct {
+    journal_header_t s_header;
+    uint32_t s_blocks;            // 日志区总块数（含日志超级块）
+    uint32_t s_sequence;          // 日志中第一个事务的序号
+    uint32_t s_start;             // 0 表示日志为空，否则第一个事务从日志区第 s_start 块开始
+} journal_superblock_t;
+
+// 描述符块的头部，后面紧跟 d_nr_blocks 个目标块号和 d_nr_revoke 个撤销块号，连续跨越 d_desc_blocks 个块
+typedef struct {
+    journal_header_t d_header;
+    uint32_t d_desc_blocks;       // 描述符块数（含本块）
+    uint32_t d_nr_blocks;         // 记录的元数据块数
+    uint32_t d_nr_revoke;         // 撤销的块数
+} journal_descriptor_t;
+
+typedef struct {
+    journal_header_t c_header;
+    uint32_t c_checksum;          // 描述符块和元数据块的 CRC32
+} journal_commit_t;
+
+typedef struct {
+    uint64_t commits;             // 提交的事务数
+    uint64_t blocks_logged;       // 写进日志的元数据块数
+    uint64_t revokes;             // 撤销记录数
+    uint64_t checkpoints;         // 日志写满后的检查点次数
+} journal_stats_t;
+
+// 格式化：初始化日志超级块
+void journal_format_superblock(void *block, uint32_t nblocks);
+
+// 挂载：重放日志中已提交的事务，返回重放的事务数，-1 表示日志损坏
+int journal_recover(int fd, uint32_t first_block, uint32_t nblocks, uint32_t fs_blocks);
+
+// 运行时：日志区的写入位置、已记录块的集合和待写的撤销记录
+int journal_load(int fd, uint32_t first_block, uint32_t nblocks);
+void journal_unload(void);
+int journal_is_loaded(void);
+uint32_t journal_get_blocks(void);
+
+#define JOURNAL_FULL 1
+int journal_write_transaction(const uint32_t *blocks, uint8_t *const *data, uint32_t count);
+int journal_reset(void);
+
+int journal_is_logged(uint32_t block_no);
+// 撤销表扩不了时返回-1，提交事务清空撤销表后可以再试
+int journal_revoke(uint32_t block_no);
+void journal_cancel_revoke(uint32_t block_no);
+int journal_has_revokes(void);
+
+void journal_get_stats(journal_stats_t *stats);
+
+#endif // JOURNAL_H
@@ -3,6 +3,9 @@
 
 #include "ext2.h"
 
+// 用户表在镜像中占用的块数（格式化时紧接在组描述符表之后预留，起始块记在 s_users_block）
+#define USERS_BLOCKS ((MAX_USERS * sizeof(user_t) + BLOCK_SIZE - 1) / BLOCK_SIZE)
+
 // 用户管理
 void init_users(void);
 int add_user(const char *username, const char *password, uint16_t uid, uint16_t gid);
@@ -18,7 +21,9 @@ int is_logged_in(void);
 int check_file_permission(uint32_t inode_no, int access);
 int check_directory_permission(uint32_t inode_no, int access);
 int check_path_permission(const char *path, int access);
+int resolve_path_permission(const char *path, int access, uint32_t *inode_no);
 int check_user_path_access(const char *path, int access);
+int check_user_path_access_at(const char *path, int access, uint32_t *inode_no);
 
 // 当前用户信息
 uint16_t get_current_uid(void);
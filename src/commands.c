@@ -4,6 +4,8 @@
 #include "../include/user.h"
 #include "../include/disk.h"
 #include "../include/ext2.h"
+#include "../include/io_engine.h"
+#include "../include/journal.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -70,7 +72,7 @@ int cmd_create(const char *path) {
     }
     
     // 创建文件inode
-    uint32_t file_inode = create_inode(EXT2_S_IFREG | 0644, get_current_uid(), get_current_gid());
+    uint32_t file_inode = create_inode(parent_inode, EXT2_S_IFREG | 0644, get_current_uid(), get_current_gid());
     if (file_inode == 0) {
         printf("Error: Failed to create file\n");
         return -1;
@@ -92,13 +94,13 @@ int cmd_delete(const char *path) {
         printf("Error: Not logged in\n");
         return -1;
     }
-    if (!check_user_path_access(path, EXT2_S_IWUSR)) {
+    uint32_t inode_no;
+    if (!check_user_path_access_at(path, EXT2_S_IWUSR, &inode_no)) {
         printf("Error: Permission denied - cannot delete file in this location\n");
         return -1;
     }
     
-    uint32_t inode_no;
-    if (path_to_inode(path, &inode_no) != 0) {
+    if (inode_no == 0 && path_to_inode(path, &inode_no) != 0) {
         printf("Error: File not found\n");
         return -1;
     }
@@ -146,13 +148,14 @@ int cmd_open(const char *path, int flags) {
     if (flags == O_RDONLY || (flags & O_RDONLY)) access |= EXT2_S_IRUSR;
     if (flags & O_WRONLY) access |= EXT2_S_IWUSR;
     if (flags & O_RDWR) access |= (EXT2_S_IRUSR | EXT2_S_IWUSR);
-    if (!check_user_path_access(path, access)) {
+    // 权限检查时已经沿路径解析过一遍，直接用解析出的inode
+    uint32_t inode_no;
+    if (!check_user_path_access_at(path, access, &inode_no)) {
         printf("Error: Permission denied - cannot access this file\n");
         return -1;
     }
     
-    uint32_t inode_no;
-    if (path_to_inode(path, &inode_no) != 0) {
+    if (inode_no == 0 && path_to_inode(path, &inode_no) != 0) {
         printf("Error: File not found\n");
         return -1;
     }
@@ -212,6 +215,26 @@ int cmd_close(int fd) {
     return -1;
 }
 
+// 文件的数据和引用它的元数据都在同一个镜像里，和 ext3/ext4 一样通过提交整个事务实现
+int cmd_fsync(int fd) {
+    if (!is_logged_in()) {
+        printf("Error: Not logged in\n");
+        return -1;
+    }
+    for (int i = 0; i < MAX_OPEN_FILES; i++) {
+        if (fs.open_files[i].is_open && fs.open_files[i].fd == fd) {
+            if (sync_filesystem() != 0) {
+                printf("Error: Failed to sync file\n");
+                return -1;
+            }
+            printf("File synced: fd=%d\n", fd);
+            return 0;
+        }
+    }
+    printf("Error: Invalid file descriptor\n");
+    return -1;
+}
+
 int cmd_read(int fd, void *buffer, size_t size) {
     if (!is_logged_in()) {
         printf("Error: Not logged in\n");
@@ -433,22 +456,14 @@ int cmd_users(void) {
 }
 
 // 文件系统管理命令
-int cmd_format(const char *disk_image) {
+int cmd_format(const char *disk_image, const format_options_t *opts) {
     printf("Formatting disk image: %s\n", disk_image);
-    // 创建空镜像（全0填充）
-    FILE *fp = fopen(disk_image, "wb");
-    if (fp == NULL) {
-        printf("Error: Cannot create disk image\n");
-        return -1;
-    }
-    uint8_t zero_block[BLOCK_SIZE] = {0};
-    for (int i = 0; i < MAX_BLOCKS; i++) {
-        fwrite(zero_block, 1, BLOCK_SIZE, fp);
-    }
-    fclose(fp);
-    // 调用ext2_format完成所有文件系统结构初始化
-    // ext2_format会写入超级块、位图、根目录、用户信息等
-    if (ext2_format(disk_image) != 0) {
+
+    // 先卸载当前镜像，避免它的脏块在格式化后写进同名的新镜像
+    close_disk_image();
+
+    // ext2_format 创建稀疏镜像，只写入超级块、描述符表、根目录和用户信息
+    if (ext2_format(disk_image, opts) != 0) {
         printf("Error: ext2_format failed\n");
         return -1;
     }
@@ -456,9 +471,9 @@ int cmd_format(const char *disk_image) {
     return 0;
 }
 
-int cmd_mount(const char *disk_image) {
+int cmd_mount(const char *disk_image, const mount_options_t *opts) {
     // ext2_init会打开磁盘文件，加载超级块、位图、用户信息等到内存
-    if (ext2_init(disk_image) != 0) {
+    if (ext2_init(disk_image, opts) != 0) {
         printf("Error: Failed to mount disk image\n");
         return -1;
     }
@@ -472,6 +487,15 @@ int cmd_umount(void) {
     return 0;
 }
 
+int cmd_sync(void) {
+    if (sync_filesystem() != 0) {
+        printf("Error: Failed to sync file system\n");
+        return -1;
+    }
+    printf("File system synced\n");
+    return 0;
+}
+
 int cmd_status(void) {
     printf("File System Status:\n");
     printf("Disk image: %s\n", fs.disk_image);
@@ -479,6 +503,24 @@ int cmd_status(void) {
     printf("Free blocks: %u\n", fs.superblock.s_free_blocks_count);
     printf("Total inodes: %u\n", fs.superblock.s_inodes_count);
     printf("Free inodes: %u\n", fs.superblock.s_free_inodes_count);
+    printf("Block size: %d\n", BLOCK_SIZE);
+    printf("Block groups: %u (%u blocks, %u inodes per group)\n", get_group_count(),
+           fs.superblock.s_blocks_per_group, fs.superblock.s_inodes_per_group);
+    if (fs.superblock.s_feature_ro_compat & EXT2_FEATURE_RO_COMPAT_UNINIT_BG) {
+        printf("Inode tables initialized: %u/%u groups\n", get_itable_init_progress(), get_group_count());
+    }
+    if (fs.superblock.s_feature_compat & EXT2_FEATURE_COMPAT_HAS_JOURNAL) {
+        if (journal_is_loaded()) {
+            journal_stats_t js;
+            journal_get_stats(&js);
+            printf("Journal: %u blocks, %llu commits, %llu blocks logged, %llu revokes, %llu checkpoints\n",
+                   fs.superblock.s_journal_blocks, (unsigned long long)js.commits,
+                   (unsigned long long)js.blocks_logged, (unsigned long long)js.revokes,
+                   (unsigned long long)js.checkpoints);
+        } else {
+            printf("Journal: %u blocks (inactive with mmap backend)\n", fs.superblock.s_journal_blocks);
+        }
+    }
     printf("Current user: %s\n", get_current_username());
     
     int open_count = 0;
@@ -488,6 +530,35 @@ int cmd_status(void) {
         }
     }
     printf("Open files: %d\n", open_count);
+
+    printf("Disk backend: %s\n", get_disk_backend() == DISK_BACKEND_MMAP ? "mmap" : "buffered");
+    printf("I/O engine: %s (queue depth %u)\n", io_engine_name(), io_engine_depth());
+    durability_stats_t durability;
+    get_durability_stats(&durability);
+    printf("Data mode: %s, %llu data flushes, %llu syncs\n",
+           fs.mount_opts.data_mode == DATA_WRITEBACK ? "writeback" : "ordered",
+           (unsigned long long)durability.data_flushes, (unsigned long long)durability.syncs);
+    bcache_stats_t stats;
+    bcache_get_stats(&stats);
+    printf("Block cache: %u blocks, %llu hits, %llu misses, %llu writebacks\n",
+           bcache_get_capacity(),
+           (unsigned long long)stats.hits,
+           (unsigned long long)stats.misses,
+           (unsigned long long)stats.writebacks);
+    icache_stats_t istats;
+    icache_get_stats(&istats);
+    printf("Inode cache: %u inodes, %llu hits, %llu misses, %llu writebacks\n",
+           ICACHE_CAPACITY,
+           (unsigned long long)istats.hits,
+           (unsigned long long)istats.misses,
+           (unsigned long long)istats.writebacks);
+    dcache_stats_t dstats;
+    dcache_get_stats(&dstats);
+    printf("Dentry cache: %u entries, %llu hits, %llu negative hits, %llu misses\n",
+           DCACHE_CAPACITY,
+           (unsigned long long)dstats.hits,
+           (unsigned long long)dstats.negative_hits,
+           (unsigned long long)dstats.misses);
     
     return 0;
 }
@@ -601,10 +672,11 @@ int cmd_useradd(const char *username, const char *password, uint16_t uid, uint16
 // 帮助命令
 void cmd_help(void) {
     printf("Available commands:\n");
-    printf("  format <disk_image>     - Format a new disk image\n");
-    printf("  mount <disk_image>      - Mount a disk image\n");
+    printf("  format [-o opts] <disk_image> - Format a new disk image (opts: size=N[K|M|G],bs=N,inode_ratio=N,blocks_per_group=N,prealloc,journal=N[K|M],nojournal)\n");
+    printf("  mount [-o opts] <disk_image> - Mount a disk image (opts: cache=N,mmap,io=E,qd=N,noatime,relatime,extents,noinit_itable,commit=N,data=ordered|writeback)\n");
     printf("  umount                  - Unmount current disk image\n");
     printf("  status                  - Show file system status\n");
+    printf("  sync                    - Flush all changes to disk\n");
     printf("  login <user> <pass>     - Login as user\n");
     printf("  logout                  - Logout current user\n");
     printf("  users                   - List all users\n");
@@ -618,6 +690,7 @@ void cmd_help(void) {
     printf("  close <fd>              - Close file\n");
     printf("  read <fd> <size>        - Read from file\n");
     printf("  write <fd> <data>       - Write to file\n");
+    printf("  fsync <fd>              - Flush file data and metadata to disk\n");
     printf("  lseek <fd> <offset> <whence> - Move file pointer\n");
     printf("  chmod <path> <mode>     - Change file permissions (root only)\n");
     printf("  chown <path> <uid> <gid> - Change file owner (root only)\n");
@@ -633,86 +706,27 @@ void print_usage(void) {
 }
 
 // 获取当前目录路径
+/*
+当前目录的路径在每次显示提示符前都要用，缓存起来：
+只有当前目录变了（cd、登录）或目录树有目录被删除、换了镜像时才沿父目录映射重新拼出来。
+*/
+static char cwd_path_cache[MAX_PATH];
+static uint32_t cwd_path_inode = 0;
+static uint32_t cwd_path_gen = 0;
+
 void get_cwd_path(char *buf, size_t size) {
     uint32_t inode = get_cwd_inode();
-    if (inode == EXT2_ROOT_INO) {
-        strncpy(buf, "/", size);
-        buf[size-1] = '\0';
-        return;
-    }
-    
-    // 构建完整路径
-    char path[MAX_PATH] = "";
-    uint32_t current_inode = inode;
-    
-    while (current_inode != EXT2_ROOT_INO) {
-        // 查找当前inode在父目录中的名字
-        uint32_t parent_inode = EXT2_ROOT_INO;
-        char current_name[MAX_FILENAME + 1] = "";
-        
-        // 尝试从当前inode的..目录项获取父目录
-        ext2_inode_t current;
-        if (read_inode(current_inode, &current) == 0) {
-            uint8_t buffer[BLOCK_SIZE];
-            for (int b = 0; b < 12; b++) {
-                uint32_t block_no;
-                if (get_inode_block(current_inode, b, &block_no) != 0 || block_no == 0) continue;
-                if (read_block(block_no, buffer) != 0) continue;
-                ext2_dir_entry_t *entries = (ext2_dir_entry_t*)buffer;
-                int entry_count = BLOCK_SIZE / sizeof(ext2_dir_entry_t);
-                for (int i = 0; i < entry_count; i++) {
-                    if (entries[i].inode != 0 && strcmp(entries[i].name, "..") == 0) {
-                        parent_inode = entries[i].inode;
-                        break;
-                    }
-                }
-            }
-        }
-        
-        // 在父目录中查找当前inode的名字
-        if (parent_inode != EXT2_ROOT_INO) {
-            ext2_dir_entry_t entry;
-            if (find_directory_entry(parent_inode, ".", &entry) == 0) {
-                // 遍历父目录的所有条目
-                uint8_t buffer[BLOCK_SIZE];
-                for (int b = 0; b < 12; b++) {
-                    uint32_t block_no;
-                    if (get_inode_block(parent_inode, b, &block_no) != 0 || block_no == 0) continue;
-                    if (read_block(block_no, buffer) != 0) continue;
-                    ext2_dir_entry_t *entries = (ext2_dir_entry_t*)buffer;
-                    int entry_count = BLOCK_SIZE / sizeof(ext2_dir_entry_t);
-                    for (int i = 0; i < entry_count; i++) {
-                        if (entries[i].inode == current_inode) {
-                            strncpy(current_name, entries[i].name, sizeof(current_name) - 1);
-                            current_name[sizeof(current_name) - 1] = '\0';
-                            break;
-                        }
-                    }
-                }
+    if (inode != cwd_path_inode || cwd_path_gen != dir_tree_generation()) {
+        // 从当前目录沿父目录向上，把各层名字拼到路径前面
+        char path[MAX_PATH] = "";
+        uint32_t current_inode = inode;
+        int depth = 0;
+        while (current_inode != EXT2_ROOT_INO && depth++ < MAX_PATH / 2) {
+            uint32_t parent_inode;
+            char current_name[MAX_FILENAME + 1];
+            if (get_dir_parent(current_inode, &parent_inode, current_name, sizeof(current_name)) != 0) {
+                break;
             }
-        } else {
-            // 在根目录中查找
-            ext2_dir_entry_t entry;
-            if (find_directory_entry(EXT2_ROOT_INO, ".", &entry) == 0) {
-                uint8_t buffer[BLOCK_SIZE];
-                for (int b = 0; b < 12; b++) {
-                    uint32_t block_no;
-                    if (get_inode_block(EXT2_ROOT_INO, b, &block_no) != 0 || block_no == 0) continue;
-                    if (read_block(block_no, buffer) != 0) continue;
-                    ext2_dir_entry_t *entries = (ext2_dir_entry_t*)buffer;
-                    int entry_count = BLOCK_SIZE / sizeof(ext2_dir_entry_t);
-                    for (int i = 0; i < entry_count; i++) {
-                        if (entries[i].inode == current_inode) {
-                            strncpy(current_name, entries[i].name, sizeof(current_name) - 1);
-                            current_name[sizeof(current_name) - 1] = '\0';
-                            break;
-                        }
-                    }
-                }
-            }
-        }
-        
-        if (current_name[0]) {
             char temp[MAX_PATH];
             strncpy(temp, "/", sizeof(temp) - 1);
             temp[sizeof(temp) - 1] = '\0';
@@ -720,16 +734,14 @@ void get_cwd_path(char *buf, size_t size) {
             strncat(temp, path, sizeof(temp) - strlen(temp) - 1);
             strncpy(path, temp, sizeof(path) - 1);
             path[sizeof(path) - 1] = '\0';
+            current_inode = parent_inode;
         }
-        
-        current_inode = parent_inode;
-    }
-    
-    if (path[0] == '\0') {
-        strncpy(buf, "/", size);
-    } else {
-        strncpy(buf, path, size);
+        strncpy(cwd_path_cache, path[0] == '\0' ? "/" : path, sizeof(cwd_path_cache) - 1);
+        cwd_path_cache[sizeof(cwd_path_cache) - 1] = '\0';
+        cwd_path_inode = inode;
+        cwd_path_gen = dir_tree_generation();
     }
+    strncpy(buf, cwd_path_cache, size);
     buf[size-1] = '\0';
 }
 
@@ -741,20 +753,54 @@ int parse_command(char *line) {
     }
     
     if (strcmp(token, "format") == 0) {
+        format_options_t opts;
+        default_format_options(&opts);
         char *disk_image = strtok(NULL, " \t\n");
+        if (disk_image != NULL && strcmp(disk_image, "-o") == 0) {
+            char *opt_str = strtok(NULL, " \t\n");
+            if (opt_str == NULL) {
+                printf("Error: Missing format options\n");
+                return -1;
+            }
+            // parse_format_options 内部也使用 strtok，先复制出来再继续解析镜像名
+            char opt_copy[256];
+            strncpy(opt_copy, opt_str, sizeof(opt_copy) - 1);
+            opt_copy[sizeof(opt_copy) - 1] = '\0';
+            disk_image = strtok(NULL, " \t\n");
+            if (parse_format_options(opt_copy, &opts) != 0) {
+                return -1;
+            }
+        }
         if (disk_image == NULL) {
             printf("Error: Missing disk image name\n");
             return -1;
         }
-        return cmd_format(disk_image);
+        return cmd_format(disk_image, &opts);
     }
     else if (strcmp(token, "mount") == 0) {
+        mount_options_t opts;
+        default_mount_options(&opts);
         char *disk_image = strtok(NULL, " \t\n");
+        if (disk_image != NULL && strcmp(disk_image, "-o") == 0) {
+            char *opt_str = strtok(NULL, " \t\n");
+            if (opt_str == NULL) {
+                printf("Error: Missing mount options\n");
+                return -1;
+            }
+            // parse_mount_options 内部也使用 strtok，先复制出来再继续解析镜像名
+            char opt_copy[256];
+            strncpy(opt_copy, opt_str, sizeof(opt_copy) - 1);
+            opt_copy[sizeof(opt_copy) - 1] = '\0';
+            disk_image = strtok(NULL, " \t\n");
+            if (parse_mount_options(opt_copy, &opts) != 0) {
+                return -1;
+            }
+        }
         if (disk_image == NULL) {
             printf("Error: Missing disk image name\n");
             return -1;
         }
-        return cmd_mount(disk_image);
+        return cmd_mount(disk_image, &opts);
     }
     else if (strcmp(token, "umount") == 0) {
         return cmd_umount();
@@ -762,6 +808,9 @@ int parse_command(char *line) {
     else if (strcmp(token, "status") == 0) {
         return cmd_status();
     }
+    else if (strcmp(token, "sync") == 0) {
+        return cmd_sync();
+    }
     else if (strcmp(token, "login") == 0) {
         char *username = strtok(NULL, " \t\n");
         char *password = strtok(NULL, " \t\n");
@@ -844,6 +893,14 @@ int parse_command(char *line) {
         int fd = atoi(fd_str);
         return cmd_close(fd);
     }
+    else if (strcmp(token, "fsync") == 0) {
+        char *fd_str = strtok(NULL, " \t\n");
+        if (fd_str == NULL) {
+            printf("Error: Missing file descriptor\n");
+            return -1;
+        }
+        return cmd_fsync(atoi(fd_str));
+    }
     else if (strcmp(token, "read") == 0) {
         char *fd_str = strtok(NULL, " \t\n");
         char *size_str = strtok(NULL, " \t\n");
@@ -956,6 +1013,8 @@ void command_loop(void) {
         }
         
         int result = parse_command(line);
+        // 命令执行期间的位图和超级块修改只在内存中累积，这里统一写回一次
+        sync_fs_metadata();
         if (result == 1) {
             break; // 退出
         }
@@ -10,6 +10,10 @@
 #include <errno.h>
 #include <time.h>
 
+static int is_dot_name(const char *name) {
+    return strcmp(name, ".") == 0 || strcmp(name, "..") == 0;
+}
+
 // 目录操作
 int create_directory(const char *path, uint16_t mode) {
     uint32_t parent_inode;
@@ -53,19 +57,23 @@ int create_directory(const char *path, uint16_t mode) {
         return 0;
     }
     // 创建目录inode，权限严格按参数mode设置，owner为当前用户
-    uint32_t dir_inode = create_inode(EXT2_S_IFDIR | (mode & 0777), get_current_uid(), get_current_gid());
+    uint32_t dir_inode = create_inode(parent_inode, EXT2_S_IFDIR | (mode & 0777), get_current_uid(), get_current_gid());
     if (dir_inode == 0) {
         printf("DEBUG: Failed to create directory inode\n");
         return -1;
     }
-    // 分配数据块
-    uint32_t data_block = allocate_block();
+    // 分配数据块，和目录的inode放在同一组
+    uint32_t count;
+    uint32_t data_block = allocate_blocks(inode_goal_block(dir_inode), 1, &count);
     if (data_block == 0) {
         printf("DEBUG: Failed to allocate data block\n");
         delete_inode(dir_inode);
         return -1;
     }
     set_inode_block(dir_inode, 0, data_block);
+    uint8_t empty[BLOCK_SIZE];
+    dir_block_init(empty);
+    write_block(data_block, empty);
     // 创建 . 和 .. 目录项
     if (create_dot_entries(dir_inode, parent_inode) != 0) {
         printf("DEBUG: Failed to create dot entries\n");
@@ -96,11 +104,16 @@ int delete_directory(const char *path) {
         return -1;
     }
     
-    // 检查目录是否为空（除了 . 和 ..）
-    ext2_dir_entry_t entries[64];
-    int count = read_directory_entries(inode_no, entries, 64);
-    if (count > 2) {
-        return -1; // 目录不为空
+    // 检查目录是否为空（除了 . 和 ..），遇到第一个普通项就停
+    dir_iter_t it;
+    dir_entry_view_t view;
+    if (dir_open(inode_no, &it) != 0) {
+        return -1;
+    }
+    while (dir_next(&it, &view) == 1) {
+        if (!is_dot_name(view.name)) {
+            return -1; // 目录不为空
+        }
     }
     
     // 获取父目录
@@ -116,36 +129,18 @@ int delete_directory(const char *path) {
     }
     
     // 删除目录inode
+    dcache_forget_dir(inode_no);
     return delete_inode(inode_no);
 }
 
-// 计算目录的总大小（递归计算所有子文件和子目录的大小）
-uint32_t calculate_directory_size(uint32_t dir_inode) {
-    uint32_t total_size = 0;
-    ext2_dir_entry_t entries[64];
-    int count = read_directory_entries(dir_inode, entries, 64);
-    
-    for (int i = 0; i < count; i++) {
-        if (entries[i].inode == 0) continue;
-        
-        // 跳过 . 和 .. 目录项
-        if (strcmp(entries[i].name, ".") == 0 || strcmp(entries[i].name, "..") == 0) {
-            continue;
-        }
-        
-        ext2_inode_t inode;
-        if (read_inode(entries[i].inode, &inode) != 0) continue;
-        
-        if (is_directory(entries[i].inode)) {
-            // 递归计算子目录的大小
-            total_size += calculate_directory_size(entries[i].inode);
-        } else {
-            // 普通文件，直接加上文件大小
-            total_size += inode.i_size;
-        }
-    }
-    
-    return total_size;
+typedef struct {
+    uint16_t uid;
+    const char *name;
+} owner_name_t;
+
+static int compare_owner(const void *a, const void *b) {
+    const owner_name_t *x = a, *y = b;
+    return (int)x->uid - (int)y->uid;
 }
 
 int list_directory(const char *path) {
@@ -163,56 +158,72 @@ int list_directory(const char *path) {
         printf("Error: Permission denied\n");
         return -1;
     }
-    ext2_dir_entry_t entries[64];
-    int count = read_directory_entries(inode_no, entries, 64);
+    dir_entry_plus_t *entries;
+    int count = read_directory_plus(inode_no, &entries);
+    if (count < 0) {
+        printf("Error: Cannot read directory: %s\n", path);
+        return -1;
+    }
+
+    // 所有者用户名表按uid排序，每行二分查找
+    owner_name_t owners[MAX_USERS];
+    int nowners = 0;
+    for (int j = 0; j < MAX_USERS; j++) {
+        if (fs.users[j].is_active) {
+            owners[nowners].uid = fs.users[j].uid;
+            owners[nowners].name = fs.users[j].username;
+            nowners++;
+        }
+    }
+    qsort(owners, nowners, sizeof(owner_name_t), compare_owner);
+
     printf("Directory listing for: %s\n", path);
     printf("%-20s %-10s %-10s %-10s %-10s %-10s %-10s %-17s %-17s %-17s\n",
            "Name", "Inode", "Type", "Size", "Permissions", "Owner", "Address", "Atime", "Mtime", "Ctime");
     printf("------------------------------------------------------------------------------------------------------------------------------------------\n");
     for (int i = 0; i < count; i++) {
-        if (entries[i].inode == 0) continue;
-        ext2_inode_t inode;
-        if (read_inode(entries[i].inode, &inode) != 0) continue;
+        const ext2_inode_t *inode = &entries[i].attr;
+        if (inode->i_mode == 0) continue;
         char type_char = '?';
-        if (is_directory(entries[i].inode)) type_char = 'd';
-        else if (is_regular_file(entries[i].inode)) type_char = '-';
-        // 计算显示的大小
-        uint32_t display_size = inode.i_size;
-        if (is_directory(entries[i].inode)) {
-            // 对于目录，计算其下所有文件的总大小
-            display_size = calculate_directory_size(entries[i].inode);
+        uint64_t display_size = inode->i_size;
+        if ((inode->i_mode & 0xF000) == EXT2_S_IFDIR) {
+            type_char = 'd';
+            // 对于目录，显示其下所有文件的总大小
+            display_size = get_subtree_size(inode);
+        } else if ((inode->i_mode & 0xF000) == EXT2_S_IFREG) {
+            type_char = '-';
         }
         char permissions[11];
         snprintf(permissions, sizeof(permissions), "%c%c%c%c%c%c%c%c%c%c",
                 type_char,
-                (inode.i_mode & EXT2_S_IRUSR) ? 'r' : '-',
-                (inode.i_mode & EXT2_S_IWUSR) ? 'w' : '-',
-                (inode.i_mode & EXT2_S_IXUSR) ? 'x' : '-',
-                (inode.i_mode & EXT2_S_IRGRP) ? 'r' : '-',
-                (inode.i_mode & EXT2_S_IWGRP) ? 'w' : '-',
-                (inode.i_mode & EXT2_S_IXGRP) ? 'x' : '-',
-                (inode.i_mode & EXT2_S_IROTH) ? 'r' : '-',
-                (inode.i_mode & EXT2_S_IWOTH) ? 'w' : '-',
-                (inode.i_mode & EXT2_S_IXOTH) ? 'x' : '-');
+                (inode->i_mode & EXT2_S_IRUSR) ? 'r' : '-',
+                (inode->i_mode & EXT2_S_IWUSR) ? 'w' : '-',
+                (inode->i_mode & EXT2_S_IXUSR) ? 'x' : '-',
+                (inode->i_mode & EXT2_S_IRGRP) ? 'r' : '-',
+                (inode->i_mode & EXT2_S_IWGRP) ? 'w' : '-',
+                (inode->i_mode & EXT2_S_IXGRP) ? 'x' : '-',
+                (inode->i_mode & EXT2_S_IROTH) ? 'r' : '-',
+                (inode->i_mode & EXT2_S_IWOTH) ? 'w' : '-',
+                (inode->i_mode & EXT2_S_IXOTH) ? 'x' : '-');
         // 获取所有者用户名
+        owner_name_t key = {inode->i_uid, NULL};
+        owner_name_t *owner = bsearch(&key, owners, nowners, sizeof(owner_name_t), compare_owner);
         char owner_name[32] = "unknown";
-        for (int j = 0; j < MAX_USERS; j++) {
-            if (fs.users[j].is_active && fs.users[j].uid == inode.i_uid) {
-                strncpy(owner_name, fs.users[j].username, sizeof(owner_name) - 1);
-                owner_name[sizeof(owner_name) - 1] = '\0';
-                break;
-            }
+        if (owner != NULL) {
+            strncpy(owner_name, owner->name, sizeof(owner_name) - 1);
+            owner_name[sizeof(owner_name) - 1] = '\0';
         }
         // 格式化时间戳
         char atime_str[20], mtime_str[20], ctime_str[20];
-        time_t atime = inode.i_atime, mtime = inode.i_mtime, ctime = inode.i_ctime;
+        time_t atime = inode->i_atime, mtime = inode->i_mtime, ctime = inode->i_ctime;
         strftime(atime_str, sizeof(atime_str), "%Y-%m-%d %H:%M", localtime(&atime));
         strftime(mtime_str, sizeof(mtime_str), "%Y-%m-%d %H:%M", localtime(&mtime));
         strftime(ctime_str, sizeof(ctime_str), "%Y-%m-%d %H:%M", localtime(&ctime));
-        printf("%-20s %-10u %-10c %-10u %-10s %-10s %-10u %-17s %-17s %-17s\n",
-               entries[i].name, entries[i].inode, type_char, display_size, permissions, owner_name, entries[i].inode,
+        printf("%-20s %-10u %-10c %-10llu %-10s %-10s %-10u %-17s %-17s %-17s\n",
+               entries[i].name, entries[i].inode, type_char, (unsigned long long)display_size, permissions, owner_name, entries[i].inode,
                atime_str, mtime_str, ctime_str);
     }
+    free(entries);
     return 0;
 }
 
@@ -258,31 +269,818 @@ int change_directory(const char *path) {
     return 0;
 }
 
-// 目录项操作
-int add_directory_entry(uint32_t parent_inode, const char *name, uint32_t child_inode, uint8_t file_type) {
-    ext2_inode_t parent;
-    if (read_inode(parent_inode, &parent) != 0) {
+// 把目录的数据块作为一批请求预读进块缓存，后续逐块扫描直接命中缓存
+static void prefetch_directory(uint32_t dir_inode) {
+    uint32_t blocks[12];
+    int count = 0;
+    for (uint32_t i = 0; i < 12; i++) {
+        uint32_t block_no;
+        if (get_inode_block(dir_inode, i, &block_no) != 0 || block_no == 0) {
+            break;
+        }
+        blocks[count++] = block_no;
+    }
+    if (count > 1) {
+        prefetch_blocks(blocks, count);
+    }
+}
+
+/*
+目录块内的目录项操作
+
+目录块中是 ext2 风格的变长目录项：8 字节头（inode、rec_len、name_len、file_type）后接
+name_len 字节的名字（不以 '\0' 结尾），按4字节对齐。rec_len 是到下一项的距离，
+最后一项的 rec_len 延伸到块尾，因此各项的 rec_len 之和正好是一个块。
+插入时从某一项尾部多余的空间中切出新项，删除时把该项的空间并入前一项；
+块首的项没有前一项，只把 inode 置0。
+*/
+#define DIR_ENTRY_HEADER_LEN 8
+#define DIR_REC_LEN(name_len) ((DIR_ENTRY_HEADER_LEN + (name_len) + 3) & ~3)
+#define DIR_MAX_ENTRIES_PER_BLOCK (BLOCK_SIZE / DIR_REC_LEN(1))
+
+// rec_len 只有16位，64KB 块中覆盖整块的长度 65536 和 Linux ext2 一样在磁盘上记为 65535
+#define DIR_MAX_REC_LEN 65535
+
+static uint32_t dirent_rec_len(const ext2_dir_entry_t *de) {
+#if BLOCK_SIZE >= 65536
+    if (de->rec_len == DIR_MAX_REC_LEN) {
+        return 65536;
+    }
+#endif
+    return de->rec_len;
+}
+
+static void dirent_set_rec_len(ext2_dir_entry_t *de, uint32_t len) {
+#if BLOCK_SIZE >= 65536
+    if (len == 65536) {
+        de->rec_len = DIR_MAX_REC_LEN;
+        return;
+    }
+#endif
+    de->rec_len = len;
+}
+
+// 取块中偏移 off 处的目录项，越界或 rec_len 不合法（例如未初始化的块）时返回NULL
+static ext2_dir_entry_t *dirent_at(uint8_t *buffer, uint32_t off) {
+    if (off + DIR_ENTRY_HEADER_LEN > BLOCK_SIZE) {
+        return NULL;
+    }
+    ext2_dir_entry_t *de = (ext2_dir_entry_t*)(buffer + off);
+    uint32_t rec_len = dirent_rec_len(de);
+    if (rec_len < DIR_ENTRY_HEADER_LEN || (rec_len & 3) || off + rec_len > BLOCK_SIZE) {
+        return NULL;
+    }
+    if (de->inode != 0 && (uint32_t)DIR_REC_LEN(de->name_len) > rec_len) {
+        return NULL;
+    }
+    return de;
+}
+
+// 把磁盘上的目录项拷贝成以 '\0' 结尾的内存结构
+static void dirent_copy(const ext2_dir_entry_t *de, ext2_dir_entry_t *out) {
+    out->inode = de->inode;
+    out->rec_len = de->rec_len;
+    out->name_len = de->name_len;
+    out->file_type = de->file_type;
+    memcpy(out->name, de->name, de->name_len);
+    out->name[de->name_len] = '\0';
+}
+
+// 初始化一个空目录块：一个覆盖整块的空闲项
+void dir_block_init(uint8_t *buffer) {
+    memset(buffer, 0, BLOCK_SIZE);
+    dirent_set_rec_len((ext2_dir_entry_t*)buffer, BLOCK_SIZE);
+}
+
+// 在块中查找名字，返回目录项的偏移，*prev 返回前一项的偏移（没有为-1），找不到返回-1
+static int block_find_entry(uint8_t *buffer, const char *name, int *prev) {
+    size_t len = strlen(name);
+    uint32_t off = 0;
+    int last = -1;
+    ext2_dir_entry_t *de;
+    while (off < BLOCK_SIZE && (de = dirent_at(buffer, off)) != NULL) {
+        if (de->inode != 0 && de->name_len == len && memcmp(de->name, name, len) == 0) {
+            if (prev != NULL) {
+                *prev = last;
+            }
+            return off;
+        }
+        last = off;
+        off += dirent_rec_len(de);
+    }
+    return -1;
+}
+
+// 在块中找足够的空闲空间写入新目录项，块满返回-1
+int dir_block_insert(uint8_t *buffer, const char *name, uint32_t child_inode, uint8_t file_type) {
+    size_t len = strlen(name);
+    if (len == 0 || len >= sizeof(((ext2_dir_entry_t*)0)->name)) {
+        return -1;
+    }
+    uint16_t need = DIR_REC_LEN(len);
+    uint32_t off = 0;
+    ext2_dir_entry_t *de;
+    while (off < BLOCK_SIZE && (de = dirent_at(buffer, off)) != NULL) {
+        uint16_t used = de->inode != 0 ? DIR_REC_LEN(de->name_len) : 0;
+        uint32_t rec_len = dirent_rec_len(de);
+        if (rec_len - used >= need) {
+            if (used != 0) {
+                // 从这一项尾部多余的空间中切出新项
+                ext2_dir_entry_t *next = (ext2_dir_entry_t*)(buffer + off + used);
+                dirent_set_rec_len(next, rec_len - used);
+                de->rec_len = used;
+                de = next;
+            }
+            de->inode = child_inode;
+            de->name_len = len;
+            de->file_type = file_type;
+            memcpy(de->name, name, len);
+            return 0;
+        }
+        off += dirent_rec_len(de);
+    }
+    return -1;
+}
+
+// 删除块中的目录项，*child_inode 返回它指向的inode，找不到返回-1
+static int block_remove_entry(uint8_t *buffer, const char *name, uint32_t *child_inode) {
+    int prev;
+    int off = block_find_entry(buffer, name, &prev);
+    if (off < 0) {
+        return -1;
+    }
+    ext2_dir_entry_t *de = (ext2_dir_entry_t*)(buffer + off);
+    *child_inode = de->inode;
+    if (prev >= 0) {
+        ext2_dir_entry_t *pde = (ext2_dir_entry_t*)(buffer + prev);
+        dirent_set_rec_len(pde, dirent_rec_len(pde) + dirent_rec_len(de)); // 并入前一项
+    } else {
+        de->inode = 0; // 块首的项标记为空闲
+    }
+    return 0;
+}
+
+// 把块中所有有效目录项拷贝出来，返回个数
+static int block_collect_entries(uint8_t *buffer, ext2_dir_entry_t *out, int max) {
+    int n = 0;
+    uint32_t off = 0;
+    ext2_dir_entry_t *de;
+    while (n < max && off < BLOCK_SIZE && (de = dirent_at(buffer, off)) != NULL) {
+        if (de->inode != 0) {
+            dirent_copy(de, &out[n++]);
+        }
+        off += dirent_rec_len(de);
+    }
+    return n;
+}
+
+/*
+目录的父目录映射
+
+按inode号直接映射（dir_inode % DIR_PARENT_SLOTS）记录目录的父目录和它在父目录中的名字，
+由名字查找和创建目录时顺带填充，槽位冲突时后来的覆盖先来的。
+get_cwd_path 沿着它向上走，每层一次数组访问，不用再扫描 .. 和父目录的目录块。
+目录被删除或换镜像时 dir_tree_generation 加一，依赖目录路径的缓存据此失效。
+*/
+#define DIR_PARENT_SLOTS 1024
+
+typedef struct {
+    uint32_t dir_inode;
+    uint32_t parent;              // 0 表示未知
+    char name[MAX_FILENAME + 1];
+} dir_parent_t;
+
+static dir_parent_t dir_parents[DIR_PARENT_SLOTS];
+static uint32_t dir_tree_gen = 1;
+
+static void dir_parent_set(uint32_t dir_inode, uint32_t parent, const char *name) {
+    if (dir_inode == 0 || strlen(name) > MAX_FILENAME) {
+        return;
+    }
+    dir_parent_t *dp = &dir_parents[dir_inode % DIR_PARENT_SLOTS];
+    dp->dir_inode = dir_inode;
+    dp->parent = parent;
+    strcpy(dp->name, name);
+}
+
+// 映射中可能已经没有这个目录（被别的目录挤掉），代数总是加一
+static void dir_parent_clear(uint32_t dir_inode) {
+    dir_parent_t *dp = &dir_parents[dir_inode % DIR_PARENT_SLOTS];
+    if (dp->dir_inode == dir_inode) {
+        dp->parent = 0;
+    }
+    dir_tree_gen++;
+}
+
+uint32_t dir_tree_generation(void) {
+    return dir_tree_gen;
+}
+
+// 取目录的父目录和它在父目录中的名字，映射中没有时从 .. 和父目录的目录项中查出来
+int get_dir_parent(uint32_t dir_inode, uint32_t *parent, char *name, size_t size) {
+    if (dir_inode == 0) {
+        return -1;
+    }
+    dir_parent_t *dp = &dir_parents[dir_inode % DIR_PARENT_SLOTS];
+    if (dp->dir_inode != dir_inode || dp->parent == 0) {
+        ext2_dir_entry_t entry;
+        char found[MAX_FILENAME + 1];
+        if (find_directory_entry(dir_inode, "..", &entry) != 0 ||
+            find_directory_name(entry.inode, dir_inode, found, sizeof(found)) != 0) {
+            return -1;
+        }
+        dir_parent_set(dir_inode, entry.inode, found);
+    }
+    *parent = dp->parent;
+    strncpy(name, dp->name, size - 1);
+    name[size - 1] = '\0';
+    return 0;
+}
+
+/*
+目录项缓存（dentry cache）
+
+按 (父目录inode, 名字) 哈希，缓存名字解析的结果，容量满时按LRU淘汰：
+- inode 为0的是负项，记住“这个名字不存在”，重复查找不存在的路径也不用读目录块
+- add_directory_entry / remove_directory_entry 修改目录时同步更新对应的项
+- 删除目录时丢掉以它为父目录的所有项，换镜像（挂载、格式化）时整体清空
+*/
+typedef struct dcache_entry {
+    uint32_t parent;              // 0 表示空闲
+    uint32_t inode;               // 0 表示负项
+    uint8_t file_type;
+    char name[MAX_FILENAME + 1];
+    struct dcache_entry *hash_next;
+    struct dcache_entry *lru_prev;
+    struct dcache_entry *lru_next;
+} dcache_entry_t;
+
+#define DCACHE_HASH_SIZE 128
+
+static dcache_entry_t dcache_pool[DCACHE_CAPACITY];
+static dcache_entry_t *dcache_hash[DCACHE_HASH_SIZE];
+static dcache_entry_t dcache_lru;  // 哨兵节点，lru_next 指向最近使用的项
+static dcache_stats_t dcache_stats;
+static int dcache_ready = 0;
+
+static uint32_t dcache_bucket(uint32_t parent, const char *name) {
+    uint32_t h = parent * 2654435761u;
+    for (const unsigned char *p = (const unsigned char*)name; *p; p++) {
+        h = h * 31 + *p;
+    }
+    return h % DCACHE_HASH_SIZE;
+}
+
+static void dcache_lru_unlink(dcache_entry_t *e) {
+    e->lru_prev->lru_next = e->lru_next;
+    e->lru_next->lru_prev = e->lru_prev;
+}
+
+static void dcache_lru_push_front(dcache_entry_t *e) {
+    e->lru_next = dcache_lru.lru_next;
+    e->lru_prev = &dcache_lru;
+    dcache_lru.lru_next->lru_prev = e;
+    dcache_lru.lru_next = e;
+}
+
+// 把项移出哈希链并放到LRU尾部，等待复用
+static void dcache_drop(dcache_entry_t *e) {
+    dcache_entry_t **pp = &dcache_hash[dcache_bucket(e->parent, e->name)];
+    while (*pp != NULL && *pp != e) {
+        pp = &(*pp)->hash_next;
+    }
+    if (*pp == e) {
+        *pp = e->hash_next;
+    }
+    e->hash_next = NULL;
+    e->parent = 0;
+    dcache_lru_unlink(e);
+    e->lru_prev = dcache_lru.lru_prev;
+    e->lru_next = &dcache_lru;
+    dcache_lru.lru_prev->lru_next = e;
+    dcache_lru.lru_prev = e;
+}
+
+void dcache_invalidate(void) {
+    memset(dcache_hash, 0, sizeof(dcache_hash));
+    memset(&dcache_stats, 0, sizeof(dcache_stats));
+    memset(dir_parents, 0, sizeof(dir_parents));
+    dir_tree_gen++;
+    dcache_lru.lru_next = &dcache_lru;
+    dcache_lru.lru_prev = &dcache_lru;
+    for (int i = 0; i < DCACHE_CAPACITY; i++) {
+        dcache_pool[i].parent = 0;
+        dcache_pool[i].hash_next = NULL;
+        dcache_lru_push_front(&dcache_pool[i]);
+    }
+    dcache_ready = 1;
+}
+
+static dcache_entry_t *dcache_find(uint32_t parent, const char *name) {
+    if (!dcache_ready) {
+        dcache_invalidate();
+    }
+    dcache_entry_t *e = dcache_hash[dcache_bucket(parent, name)];
+    while (e != NULL && (e->parent != parent || strcmp(e->name, name) != 0)) {
+        e = e->hash_next;
+    }
+    return e;
+}
+
+/*
+查缓存：命中正项时填好 entry 返回1，命中负项返回0，未命中返回-1
+*/
+static int dcache_lookup(uint32_t parent, const char *name, ext2_dir_entry_t *entry) {
+    dcache_entry_t *e = dcache_find(parent, name);
+    if (e == NULL) {
+        dcache_stats.misses++;
         return -1;
     }
+    dcache_lru_unlink(e);
+    dcache_lru_push_front(e);
+    if (e->inode == 0) {
+        dcache_stats.negative_hits++;
+        return 0;
+    }
+    dcache_stats.hits++;
+    entry->inode = e->inode;
+    entry->name_len = strlen(e->name);
+    entry->rec_len = DIR_REC_LEN(entry->name_len);
+    entry->file_type = e->file_type;
+    strcpy(entry->name, e->name);
+    return 1;
+}
+
+// 记录名字解析的结果，inode 为0时记为负项
+static void dcache_store(uint32_t parent, const char *name, uint32_t inode, uint8_t file_type) {
+    if (strlen(name) > MAX_FILENAME) {
+        return;
+    }
+    dcache_entry_t *e = dcache_find(parent, name);
+    if (e == NULL) {
+        e = dcache_lru.lru_prev; // 复用最久未使用的项
+        if (e->parent != 0) {
+            dcache_drop(e);
+        }
+        e->parent = parent;
+        strcpy(e->name, name);
+        uint32_t bucket = dcache_bucket(parent, name);
+        e->hash_next = dcache_hash[bucket];
+        dcache_hash[bucket] = e;
+    }
+    e->inode = inode;
+    e->file_type = file_type;
+    dcache_lru_unlink(e);
+    dcache_lru_push_front(e);
+    if (inode != 0 && file_type == 2 && !is_dot_name(name)) {
+        dir_parent_set(inode, parent, name);
+    }
+}
+
+static void dcache_forget(uint32_t parent, const char *name) {
+    dcache_entry_t *e = dcache_find(parent, name);
+    if (e != NULL) {
+        dcache_drop(e);
+    }
+}
+
+// 目录被删除后它的inode号可能被复用，丢掉以它为父目录的所有项
+void dcache_forget_dir(uint32_t dir_inode) {
+    dir_parent_clear(dir_inode);
+    if (!dcache_ready) {
+        return;
+    }
+    for (int i = 0; i < DCACHE_CAPACITY; i++) {
+        if (dcache_pool[i].parent == dir_inode) {
+            dcache_drop(&dcache_pool[i]);
+        }
+    }
+}
+
+void dcache_get_stats(dcache_stats_t *stats) {
+    *stats = dcache_stats;
+}
+
+/*
+目录哈希索引（htree）
+
+目录超过一个块时自动建立索引（i_flags 中的 EXT2_INDEX_FL），索引块的块号放在 i_dir_acl：
+- 逻辑块 0 只放 . 和 ..，其他目录项按名字的哈希值分布在之后的叶子块中
+- 索引块是按哈希值排序的 (起始哈希, 逻辑块号) 表，查找时二分得到唯一的叶子块
+- 叶子块满时按哈希值从中间分裂成两块，并在索引中插入新块的起始哈希
+叶子块仍然是普通的目录块，不认识索引的遍历代码照样可以逐块扫描。
+*/
+#define DX_MAGIC 0x58494448  // "HDIX"
+
+typedef struct {
+    uint32_t magic;
+    uint16_t count;               // 索引项个数
+    uint16_t limit;               // 索引项容量
+    uint32_t nblocks;             // 目录已使用的逻辑块数（新叶子块的逻辑块号）
+} dx_header_t;
+
+typedef struct {
+    uint32_t hash;                // 该叶子块中最小的哈希值
+    uint32_t block;               // 叶子块的逻辑块号
+} dx_entry_t;
+
+#define DX_LIMIT ((BLOCK_SIZE - sizeof(dx_header_t)) / sizeof(dx_entry_t))
+
+// 名字的哈希值（FNV-1a）
+static uint32_t dx_hash(const char *name) {
+    uint32_t h = 2166136261u;
+    for (const unsigned char *p = (const unsigned char*)name; *p; p++) {
+        h ^= *p;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// 已建立索引时返回索引块号，否则返回0
+static uint32_t dx_index_block(uint32_t dir_inode) {
+    const ext2_inode_t *ip = get_inode_ptr(dir_inode);
+    if (ip == NULL || !(ip->i_flags & EXT2_INDEX_FL)) {
+        return 0;
+    }
+    return ip->i_dir_acl;
+}
+
+// 在索引中二分查找哈希值所属的项（最后一个起始哈希 <= hash 的项）
+static int dx_search(const dx_header_t *hdr, uint32_t hash) {
+    const dx_entry_t *entries = (const dx_entry_t*)(hdr + 1);
+    int lo = 1, hi = hdr->count - 1, found = 0; // 第0项的起始哈希是0，总是匹配
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        if (entries[mid].hash <= hash) {
+            found = mid;
+            lo = mid + 1;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    return found;
+}
+
+// 找到名字所在叶子块的物理块号，出错返回0
+static uint32_t dx_leaf_block(uint32_t dir_inode, uint32_t index_block, const char *name) {
+    const dx_header_t *hdr = get_block_ptr(index_block);
+    if (hdr == NULL || hdr->magic != DX_MAGIC || hdr->count == 0) {
+        return 0;
+    }
+    const dx_entry_t *entries = (const dx_entry_t*)(hdr + 1);
+    uint32_t logical = entries[dx_search(hdr, dx_hash(name))].block;
+    uint32_t block_no;
+    if (get_inode_block(dir_inode, logical, &block_no) != 0) {
+        return 0;
+    }
+    return block_no;
+}
+
+static int compare_entry_hash(const void *a, const void *b) {
+    uint32_t ha = dx_hash(((const ext2_dir_entry_t*)a)->name);
+    uint32_t hb = dx_hash(((const ext2_dir_entry_t*)b)->name);
+    return ha < hb ? -1 : ha > hb;
+}
+
+// 给目录追加一个新的空目录块，返回物理块号，失败返回0
+static uint32_t dx_append_block(uint32_t dir_inode, dx_header_t *hdr) {
+    uint32_t block_no = allocate_block();
+    if (block_no == 0) {
+        return 0;
+    }
+    uint8_t empty[BLOCK_SIZE];
+    dir_block_init(empty);
+    if (set_inode_block(dir_inode, hdr->nblocks, block_no) != 0 || write_block(block_no, empty) != 0) {
+        free_block(block_no);
+        return 0;
+    }
+    hdr->nblocks++;
+    return block_no;
+}
+
+/*
+向已建立索引的目录插入目录项：一次哈希、一次索引查找、一次叶子块读写。
+叶子块满时按哈希值分裂。
+*/
+static int dx_insert_entry(uint32_t dir_inode, uint32_t index_block, const char *name,
+                           uint32_t child_inode, uint8_t file_type) {
+    uint8_t index_buf[BLOCK_SIZE];
+    if (read_block(index_block, index_buf) != 0) {
+        return -1;
+    }
+    dx_header_t *hdr = (dx_header_t*)index_buf;
+    dx_entry_t *dx = (dx_entry_t*)(hdr + 1);
+    if (hdr->magic != DX_MAGIC || hdr->count == 0) {
+        return -1;
+    }
+
+    int k = dx_search(hdr, dx_hash(name));
+    uint32_t leaf;
+    if (get_inode_block(dir_inode, dx[k].block, &leaf) != 0 || leaf == 0) {
+        return -1;
+    }
+    uint8_t buffer[BLOCK_SIZE];
+    if (read_block(leaf, buffer) != 0) {
+        return -1;
+    }
+    if (dir_block_insert(buffer, name, child_inode, file_type) == 0) {
+        return write_block(leaf, buffer);
+    }
+
+    // 叶子块满：连同新目录项一起按哈希排序，从按字节数的中点（取哈希值变化处）分成两块
+    if (hdr->count >= DX_LIMIT) {
+        printf("Error: Directory index is full\n");
+        return -1;
+    }
+    // 64K 块时一块能放上万个目录项，放在栈上太大
+    ext2_dir_entry_t *all = malloc((DIR_MAX_ENTRIES_PER_BLOCK + 1) * sizeof(ext2_dir_entry_t));
+    if (all == NULL) {
+        return -1;
+    }
+    int n = block_collect_entries(buffer, all, DIR_MAX_ENTRIES_PER_BLOCK);
+    all[n].inode = child_inode;
+    all[n].name_len = strlen(name);
+    all[n].file_type = file_type;
+    strcpy(all[n].name, name);
+    n++;
+    qsort(all, n, sizeof(ext2_dir_entry_t), compare_entry_hash);
+
+    uint32_t total = 0, half = 0;
+    int mid = 0;
+    for (int i = 0; i < n; i++) {
+        total += DIR_REC_LEN(all[i].name_len);
+    }
+    while (mid < n && half < total / 2) {
+        half += DIR_REC_LEN(all[mid++].name_len);
+    }
+    int split = -1;
+    for (int d = 0; d < n && split < 0; d++) {
+        int candidates[2] = {mid + d, mid - d};
+        for (int c = 0; c < 2; c++) {
+            int i = candidates[c];
+            if (i > 0 && i < n && dx_hash(all[i].name) != dx_hash(all[i - 1].name)) {
+                split = i;
+                break;
+            }
+        }
+    }
+    if (split < 0) {
+        printf("Error: Too many hash collisions in directory\n");
+        free(all);
+        return -1;
+    }
+
+    // 先在内存里分好两半，失败时磁盘上什么都没动
+    uint8_t lower[BLOCK_SIZE], upper[BLOCK_SIZE];
+    dir_block_init(lower);
+    dir_block_init(upper);
+    for (int i = 0; i < n; i++) {
+        if (dir_block_insert(i < split ? lower : upper, all[i].name, all[i].inode, all[i].file_type) != 0) {
+            printf("Error: Directory leaf split failed\n");
+            free(all);
+            return -1;
+        }
+    }
+    uint32_t split_hash = dx_hash(all[split].name);
+    free(all);
+
+    uint32_t new_logical = hdr->nblocks;
+    uint32_t new_leaf = dx_append_block(dir_inode, hdr);
+    if (new_leaf == 0) {
+        return -1;
+    }
+    // 先写新叶子，再写旧叶子，最后写索引；中途失败就撤掉新块，旧叶子恢复原样
+    if (write_block(new_leaf, upper) == 0 && write_block(leaf, lower) == 0) {
+        memmove(&dx[k + 2], &dx[k + 1], (hdr->count - k - 1) * sizeof(dx_entry_t));
+        dx[k + 1].hash = split_hash;
+        dx[k + 1].block = new_logical;
+        hdr->count++;
+        if (write_block(index_block, index_buf) == 0) {
+            return 0;
+        }
+        write_block(leaf, buffer);
+    }
+    set_inode_block(dir_inode, new_logical, 0);
+    free_block(new_leaf);
+    hdr->nblocks = new_logical;
+    return -1;
+}
+
+/*
+把 all[0, n) 中的目录项（已按哈希排序）依次装进叶子块，只在哈希值变化处换块。
+叶子块内容放在 *leaves（每块 BLOCK_SIZE 字节），first[i] 是第 i 块第一个目录项的下标，
+返回叶子块数，出错返回-1。至少有一个（可能为空的）叶子块。
+*/
+static int dx_pack_leaves(const ext2_dir_entry_t *all, int n, uint8_t **leaves, int *first) {
+    int nleaves = 0;
+    int i = 0;
+    *leaves = NULL;
+    do {
+        if (nleaves >= (int)DX_LIMIT) {
+            printf("Error: Directory index is full\n");
+            return -1;
+        }
+        uint8_t *grown = realloc(*leaves, (size_t)(nleaves + 1) * BLOCK_SIZE);
+        if (grown == NULL) {
+            return -1;
+        }
+        *leaves = grown;
+        uint8_t *leaf = grown + (size_t)nleaves * BLOCK_SIZE;
+        int start = i;
+        dir_block_init(leaf);
+        while (i < n && dir_block_insert(leaf, all[i].name, all[i].inode, all[i].file_type) == 0) {
+            i++;
+        }
+        if (i < n) {
+            // 装不下了：退到最近的哈希值变化处，同一哈希值的目录项必须在同一块里
+            int end = i;
+            while (end > start && dx_hash(all[end].name) == dx_hash(all[end - 1].name)) {
+                end--;
+            }
+            if (end == start) {
+                printf("Error: Too many hash collisions in directory\n");
+                return -1;
+            }
+            if (end < i) {
+                dir_block_init(leaf);
+                for (int j = start; j < end; j++) {
+                    dir_block_insert(leaf, all[j].name, all[j].inode, all[j].file_type);
+                }
+                i = end;
+            }
+        }
+        first[nleaves++] = start;
+    } while (i < n);
+    return nleaves;
+}
+
+/*
+把建好的索引装到目录上。索引块和原有块放不下的叶子块先全部分配好、写好内容再挂到目录上，
+然后覆盖原有的叶子块，最后覆盖逻辑块 0 并设置索引标志。
+中途失败时释放新分配的块，已覆盖的原有块用 old_data 恢复，目录保持未索引的状态。
+*/
+static int dx_install_index(uint32_t dir_inode, const uint32_t *old_blocks, const uint8_t *old_data,
+                            uint32_t nblocks, const uint8_t *leaves, uint32_t nleaves,
+                            const uint8_t *block0, const uint8_t *index_buf) {
+    uint32_t reused = nblocks - 1 < nleaves ? nblocks - 1 : nleaves;
+    uint32_t nnew = 1 + nleaves - reused;
+    uint32_t *new_blocks = calloc(nnew, sizeof(uint32_t));
+    if (new_blocks == NULL) {
+        return -1;
+    }
+
+    int ok = 1;
+    for (uint32_t i = 0; ok && i < nnew; i++) {
+        new_blocks[i] = allocate_block();
+        ok = new_blocks[i] != 0;
+    }
+    ok = ok && write_block(new_blocks[0], index_buf) == 0;
+    for (uint32_t i = 1; ok && i < nnew; i++) {
+        ok = write_block(new_blocks[i], leaves + (size_t)(reused + i - 1) * BLOCK_SIZE) == 0;
+    }
+    uint32_t mapped = 0;
+    while (ok && mapped + 1 < nnew) {
+        ok = set_inode_block(dir_inode, nblocks + mapped, new_blocks[mapped + 1]) == 0;
+        mapped += ok;
+    }
+    uint32_t written = 0;
+    while (ok && written < reused) {
+        ok = write_block(old_blocks[written + 1], leaves + (size_t)written * BLOCK_SIZE) == 0;
+        written += ok;
+    }
+    ok = ok && write_block(old_blocks[0], block0) == 0;
+
+    ext2_inode_t *ip = ok ? iget(dir_inode) : NULL;
+    if (ip == NULL) {
+        if (ok) {
+            write_block(old_blocks[0], old_data);
+        }
+        for (uint32_t i = 0; i < written; i++) {
+            write_block(old_blocks[i + 1], old_data + (size_t)(i + 1) * BLOCK_SIZE);
+        }
+        while (mapped > 0) {
+            mapped--;
+            set_inode_block(dir_inode, nblocks + mapped, 0);
+        }
+        for (uint32_t i = 0; i < nnew && new_blocks[i] != 0; i++) {
+            free_block(new_blocks[i]);
+        }
+        free(new_blocks);
+        return -1;
+    }
+    ip->i_flags |= EXT2_INDEX_FL;
+    ip->i_dir_acl = new_blocks[0];
+    mark_inode_dirty(ip);
+    iput(ip);
+    if (!(fs.superblock.s_feature_compat & EXT2_FEATURE_COMPAT_DIR_INDEX)) {
+        fs.superblock.s_feature_compat |= EXT2_FEATURE_COMPAT_DIR_INDEX;
+        mark_superblock_dirty();
+    }
+
+    // 最后一个叶子块之后的原有块不再需要
+    for (uint32_t i = reused + 1; i < nblocks; i++) {
+        set_inode_block(dir_inode, i, 0);
+        free_block(old_blocks[i]);
+    }
+    free(new_blocks);
+    return 0;
+}
+
+/*
+为目录建立索引：. 和 .. 留在逻辑块 0，其他目录项按哈希排序后装进逻辑块 1 开始的叶子块。
+所有块先在内存中建好，由 dx_install_index 写到磁盘上；失败时目录保持原样。
+*/
+static int dx_build_index(uint32_t dir_inode) {
+    uint32_t nblocks = 0;
+    uint32_t block_no;
+    while (get_inode_block(dir_inode, nblocks, &block_no) == 0 && block_no != 0) {
+        nblocks++;
+    }
+    if (nblocks == 0) {
+        return -1;
+    }
+
+    // 收集所有目录项，原有块的内容留一份用于失败时恢复
+    int cap = nblocks * DIR_MAX_ENTRIES_PER_BLOCK;
+    ext2_dir_entry_t *all = malloc(cap * sizeof(ext2_dir_entry_t));
+    uint32_t *old_blocks = malloc(nblocks * sizeof(uint32_t));
+    uint8_t *old_data = malloc((size_t)nblocks * BLOCK_SIZE);
+    int *first = malloc((cap + 1) * sizeof(int));
+    int ok = all != NULL && old_blocks != NULL && old_data != NULL && first != NULL;
+    int n = 0;
+    for (uint32_t i = 0; ok && i < nblocks; i++) {
+        uint8_t *data = old_data + (size_t)i * BLOCK_SIZE;
+        ok = get_inode_block(dir_inode, i, &old_blocks[i]) == 0 && read_block(old_blocks[i], data) == 0;
+        if (ok) {
+            n += block_collect_entries(data, all + n, cap - n);
+        }
+    }
+
+    // 逻辑块 0 只保留 . 和 ..，其他目录项挪到数组前面按哈希排序后装进叶子块
+    uint8_t block0[BLOCK_SIZE];
+    uint8_t index_buf[BLOCK_SIZE] = {0};
+    uint8_t *leaves = NULL;
+    int nleaves = -1;
+    if (ok) {
+        dir_block_init(block0);
+        int m = 0;
+        for (int i = 0; i < n; i++) {
+            if (is_dot_name(all[i].name)) {
+                dir_block_insert(block0, all[i].name, all[i].inode, all[i].file_type);
+            } else {
+                all[m++] = all[i];
+            }
+        }
+        qsort(all, m, sizeof(ext2_dir_entry_t), compare_entry_hash);
+        nleaves = dx_pack_leaves(all, m, &leaves, first);
+    }
+    if (nleaves > 0) {
+        dx_header_t *hdr = (dx_header_t*)index_buf;
+        dx_entry_t *dx = (dx_entry_t*)(hdr + 1);
+        hdr->magic = DX_MAGIC;
+        hdr->limit = DX_LIMIT;
+        hdr->count = nleaves;
+        hdr->nblocks = nleaves + 1;
+        for (int i = 0; i < nleaves; i++) {
+            dx[i].hash = i == 0 ? 0 : dx_hash(all[first[i]].name);
+            dx[i].block = i + 1;
+        }
+    }
+
+    int result = nleaves > 0 ? dx_install_index(dir_inode, old_blocks, old_data, nblocks, leaves, nleaves,
+                                                block0, index_buf) : -1;
+    free(all);
+    free(old_blocks);
+    free(old_data);
+    free(first);
+    free(leaves);
+    return result;
+}
+
+// 把目录项写进目录：已建立索引的插入哈希对应的叶子块，否则找第一个放得下的块
+static int insert_directory_entry(uint32_t parent_inode, const char *name, uint32_t child_inode, uint8_t file_type) {
+    uint32_t index_block = dx_index_block(parent_inode);
+    if (index_block != 0 && !is_dot_name(name)) {
+        return dx_insert_entry(parent_inode, index_block, name, child_inode, file_type);
+    }
     
     // 查找空闲空间
     uint32_t block_index = 0;
     uint32_t block_no;
     uint8_t buffer[BLOCK_SIZE];
     
-    while (block_index < 12) {
-        if (get_inode_block(parent_inode, block_index, &block_no) != 0) {
-            break;
-        }
-        
+    while (get_inode_block(parent_inode, block_index, &block_no) == 0) {
         if (block_no == 0) {
-            // 分配新块
+            if (block_index > 0) {
+                break; // 已有的块都满了
+            }
+            // 空目录，分配第一个块
             block_no = allocate_block();
             if (block_no == 0) {
                 return -1;
             }
             set_inode_block(parent_inode, block_index, block_no);
-            memset(buffer, 0, BLOCK_SIZE);
+            dir_block_init(buffer);
         } else {
             if (read_block(block_no, buffer) != 0) {
                 return -1;
@@ -290,103 +1088,137 @@ int add_directory_entry(uint32_t parent_inode, const char *name, uint32_t child_
         }
         
         // 查找空闲目录项
-        ext2_dir_entry_t *entry = (ext2_dir_entry_t*)buffer;
-        int entry_count = BLOCK_SIZE / sizeof(ext2_dir_entry_t);
-        
-        for (int i = 0; i < entry_count; i++) {
-            if (entry[i].inode == 0) {
-                // 找到空闲项
-                entry[i].inode = child_inode;
-                entry[i].rec_len = sizeof(ext2_dir_entry_t);
-                entry[i].name_len = strlen(name);
-                entry[i].file_type = file_type;
-                strncpy(entry[i].name, name, sizeof(entry[i].name) - 1);
-                entry[i].name[sizeof(entry[i].name) - 1] = '\0';
-                
-                write_block(block_no, buffer);
-                increment_link_count(child_inode);
-                return 0;
-            }
+        if (dir_block_insert(buffer, name, child_inode, file_type) == 0) {
+            return write_block(block_no, buffer);
         }
         
         block_index++;
     }
-    
-    return -1; // 没有空间
+
+    // 目录要超过一个块了：建立哈希索引后再插入
+    if (is_dot_name(name) || dx_build_index(parent_inode) != 0) {
+        return -1; // 没有空间
+    }
+    index_block = dx_index_block(parent_inode);
+    return dx_insert_entry(parent_inode, index_block, name, child_inode, file_type);
 }
 
-int remove_directory_entry(uint32_t parent_inode, const char *name) {
+// 目录项操作
+int add_directory_entry(uint32_t parent_inode, const char *name, uint32_t child_inode, uint8_t file_type) {
     ext2_inode_t parent;
     if (read_inode(parent_inode, &parent) != 0) {
         return -1;
     }
-    
+    if (strlen(name) == 0 || strlen(name) >= sizeof(((ext2_dir_entry_t*)0)->name)) {
+        printf("Error: File name too long\n");
+        return -1;
+    }
+
+    if (insert_directory_entry(parent_inode, name, child_inode, file_type) != 0) {
+        dcache_forget(parent_inode, name);
+        return -1;
+    }
+    dcache_store(parent_inode, name, child_inode, file_type);
+    increment_link_count(child_inode);
+    if (!is_dot_name(name)) {
+        link_to_parent(child_inode, parent_inode);
+    }
+    return 0;
+}
+
+/*
+在目录中找名字所在的块：已建立索引时只读一个叶子块（. 和 .. 在逻辑块 0），
+否则逐块线性扫描。找到时 buffer 中是该块的内容，返回物理块号，找不到返回0。
+*/
+static uint32_t locate_entry_block(uint32_t dir_inode, const char *name, uint8_t *buffer) {
+    uint32_t index_block = dx_index_block(dir_inode);
+    if (index_block != 0) {
+        uint32_t block_no;
+        if (is_dot_name(name)) {
+            if (get_inode_block(dir_inode, 0, &block_no) != 0) {
+                return 0;
+            }
+        } else {
+            block_no = dx_leaf_block(dir_inode, index_block, name);
+        }
+        if (block_no == 0 || read_block(block_no, buffer) != 0) {
+            return 0;
+        }
+        return block_find_entry(buffer, name, NULL) >= 0 ? block_no : 0;
+    }
+
+    prefetch_directory(dir_inode);
     uint32_t block_index = 0;
     uint32_t block_no;
-    uint8_t buffer[BLOCK_SIZE];
-    
-    while (block_index < 12) {
-        if (get_inode_block(parent_inode, block_index, &block_no) != 0 || block_no == 0) {
-            break;
-        }
-        
+    while (get_inode_block(dir_inode, block_index, &block_no) == 0 && block_no != 0) {
         if (read_block(block_no, buffer) != 0) {
-            return -1;
+            return 0;
         }
-        
-        ext2_dir_entry_t *entry = (ext2_dir_entry_t*)buffer;
-        int entry_count = BLOCK_SIZE / sizeof(ext2_dir_entry_t);
-        
-        for (int i = 0; i < entry_count; i++) {
-            if (entry[i].inode != 0 && strcmp(entry[i].name, name) == 0) {
-                uint32_t child_inode = entry[i].inode;
-                entry[i].inode = 0; // 标记为删除
-                
-                write_block(block_no, buffer);
-                decrement_link_count(child_inode);
-                return 0;
-            }
+        if (block_find_entry(buffer, name, NULL) >= 0) {
+            return block_no;
         }
-        
         block_index++;
     }
-    
-    return -1; // 未找到
+    return 0;
 }
 
-int find_directory_entry(uint32_t parent_inode, const char *name, ext2_dir_entry_t *entry) {
+int remove_directory_entry(uint32_t parent_inode, const char *name) {
     ext2_inode_t parent;
     if (read_inode(parent_inode, &parent) != 0) {
         return -1;
     }
-    
-    uint32_t block_index = 0;
-    uint32_t block_no;
+
     uint8_t buffer[BLOCK_SIZE];
-    
-    while (block_index < 12) {
-        if (get_inode_block(parent_inode, block_index, &block_no) != 0 || block_no == 0) {
-            break;
-        }
-        
-        if (read_block(block_no, buffer) != 0) {
-            return -1;
-        }
-        
-        ext2_dir_entry_t *entries = (ext2_dir_entry_t*)buffer;
-        int entry_count = BLOCK_SIZE / sizeof(ext2_dir_entry_t);
-        
-        for (int i = 0; i < entry_count; i++) {
-            if (entries[i].inode != 0 && strcmp(entries[i].name, name) == 0) {
-                memcpy(entry, &entries[i], sizeof(ext2_dir_entry_t));
-                return 0;
-            }
+    uint32_t block_no = locate_entry_block(parent_inode, name, buffer);
+    uint32_t child_inode;
+    if (block_no == 0 || block_remove_entry(buffer, name, &child_inode) != 0) {
+        return -1; // 未找到
+    }
+    write_block(block_no, buffer);
+    dcache_store(parent_inode, name, 0, 0);
+    if (!is_dot_name(name)) {
+        unlink_from_parent(child_inode, parent_inode);
+    }
+    decrement_link_count(child_inode);
+    return 0;
+}
+
+int find_directory_entry(uint32_t parent_inode, const char *name, ext2_dir_entry_t *entry) {
+    // 父目录必须存在（同时保证已挂载），再查目录项缓存
+    if (get_inode_ptr(parent_inode) == NULL) {
+        return -1;
+    }
+    int cached = dcache_lookup(parent_inode, name, entry);
+    if (cached >= 0) {
+        return cached ? 0 : -1;
+    }
+
+    uint8_t buffer[BLOCK_SIZE];
+    if (locate_entry_block(parent_inode, name, buffer) == 0) {
+        dcache_store(parent_inode, name, 0, 0); // 记住“不存在”
+        return -1; // 未找到
+    }
+    int off = block_find_entry(buffer, name, NULL);
+    dirent_copy((ext2_dir_entry_t*)(buffer + off), entry);
+    dcache_store(parent_inode, name, entry->inode, entry->file_type);
+    return 0;
+}
+
+// 在目录中按inode号反查名字（跳过 . 和 ..），找不到返回-1
+int find_directory_name(uint32_t dir_inode, uint32_t child_inode, char *name, size_t size) {
+    dir_iter_t it;
+    dir_entry_view_t view;
+    if (dir_open(dir_inode, &it) != 0) {
+        return -1;
+    }
+    while (dir_next(&it, &view) == 1) {
+        if (view.inode == child_inode && !is_dot_name(view.name)) {
+            strncpy(name, view.name, size - 1);
+            name[size - 1] = '\0';
+            return 0;
         }
-        
-        block_index++;
     }
-    
-    return -1; // 未找到
+    return -1;
 }
 
 // 路径解析
@@ -469,42 +1301,111 @@ int get_parent_inode(const char *path, uint32_t *parent_inode, char *child_name)
 }
 
 // 目录遍历
-int read_directory_entries(uint32_t inode_no, ext2_dir_entry_t *entries, int max_entries) {
-    ext2_inode_t inode;
-    if (read_inode(inode_no, &inode) != 0) {
+/*
+目录遍历游标
+
+dir_open 之后反复调用 dir_next，每次得到一个目录项的视图（inode、类型、名字指针），
+目录块在走到时才读入游标自带的缓冲区，一次只占一个块，没有项数上限，
+调用者随时可以停下（例如判断目录是否为空时遇到第一个普通项就结束）。
+视图中的名字指向游标内部，下一次 dir_next 之后失效。
+*/
+int dir_open(uint32_t dir_inode, dir_iter_t *it) {
+    if (get_inode_ptr(dir_inode) == NULL) {
         return -1;
     }
-    
-    int entry_count = 0;
-    uint32_t block_index = 0;
-    uint32_t block_no;
-    uint8_t buffer[BLOCK_SIZE];
-    
-    while (block_index < 12 && entry_count < max_entries) {
-        if (get_inode_block(inode_no, block_index, &block_no) != 0 || block_no == 0) {
-            break;
+    prefetch_directory(dir_inode);
+    it->dir_inode = dir_inode;
+    it->block_index = 0;
+    it->offset = BLOCK_SIZE; // 还没有读入块
+    return 0;
+}
+
+// 返回1表示得到一项，0表示遍历结束
+int dir_next(dir_iter_t *it, dir_entry_view_t *view) {
+    while (1) {
+        ext2_dir_entry_t *de;
+        while (it->offset < BLOCK_SIZE && (de = dirent_at(it->block, it->offset)) != NULL) {
+            it->offset += dirent_rec_len(de);
+            if (de->inode != 0) {
+                memcpy(it->name, de->name, de->name_len);
+                it->name[de->name_len] = '\0';
+                view->inode = de->inode;
+                view->file_type = de->file_type;
+                view->name_len = de->name_len;
+                view->name = it->name;
+                return 1;
+            }
         }
-        
-        if (read_block(block_no, buffer) != 0) {
-            break;
+
+        // 当前块走完，读入下一个块
+        uint32_t block_no;
+        if (get_inode_block(it->dir_inode, it->block_index, &block_no) != 0 || block_no == 0) {
+            return 0;
         }
-        
-        ext2_dir_entry_t *block_entries = (ext2_dir_entry_t*)buffer;
-        int block_entry_count = BLOCK_SIZE / sizeof(ext2_dir_entry_t);
-        
-        for (int i = 0; i < block_entry_count && entry_count < max_entries; i++) {
-            if (block_entries[i].inode != 0) {
-                memcpy(&entries[entry_count], &block_entries[i], sizeof(ext2_dir_entry_t));
-                entry_count++;
+        if (read_block(block_no, it->block) != 0) {
+            return 0;
+        }
+        it->block_index++;
+        it->offset = 0;
+    }
+}
+
+/*
+读目录并同时取出每一项的inode（readdirplus）：
+先用游标收集所有目录项，再把它们的inode一次批量读出（read_inodes 按inode表块排序，
+每个表块只读一次）。结果按目录中的顺序排列，*entries 由调用者 free，返回项数。
+*/
+int read_directory_plus(uint32_t dir_inode, dir_entry_plus_t **entries) {
+    dir_iter_t it;
+    dir_entry_view_t view;
+    if (dir_open(dir_inode, &it) != 0) {
+        return -1;
+    }
+
+    int count = 0, cap = 16;
+    dir_entry_plus_t *list = malloc(cap * sizeof(dir_entry_plus_t));
+    if (list == NULL) {
+        return -1;
+    }
+    while (dir_next(&it, &view) == 1) {
+        if (count == cap) {
+            dir_entry_plus_t *grown = realloc(list, 2 * cap * sizeof(dir_entry_plus_t));
+            if (grown == NULL) {
+                free(list);
+                return -1;
             }
+            list = grown;
+            cap *= 2;
         }
-        
-        block_index++;
+        list[count].inode = view.inode;
+        list[count].file_type = view.file_type;
+        memcpy(list[count].name, view.name, view.name_len + 1);
+        count++;
     }
-    
-    return entry_count;
+
+    uint32_t *inode_nos = malloc((count + 1) * sizeof(uint32_t));
+    ext2_inode_t *attrs = malloc((count + 1) * sizeof(ext2_inode_t));
+    if (inode_nos == NULL || attrs == NULL) {
+        free(inode_nos);
+        free(attrs);
+        free(list);
+        return -1;
+    }
+    for (int i = 0; i < count; i++) {
+        inode_nos[i] = list[i].inode;
+    }
+    read_inodes(inode_nos, count, attrs);
+    for (int i = 0; i < count; i++) {
+        list[i].attr = attrs[i];
+    }
+    free(inode_nos);
+    free(attrs);
+
+    *entries = list;
+    return count;
 }
 
+
 // 特殊目录项
 int create_dot_entries(uint32_t dir_inode, uint32_t parent_inode) {
     // 创建 . 目录项
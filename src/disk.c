@@ -1,16 +1,70 @@
 #include "../include/disk.h"
 #include "../include/ext2.h"
+#include "../include/io_engine.h"
+#include "../include/journal.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stddef.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <pthread.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
 
 // 全局变量
 static int disk_fd = -1;
-uint8_t block_bitmap[BLOCK_SIZE];
-uint8_t inode_bitmap[BLOCK_SIZE];
+static disk_backend_t disk_backend = DISK_BACKEND_BUFFERED;
+static uint8_t *disk_map = NULL;      // mmap 后端下整个镜像的映射
+static uint32_t disk_map_blocks = 0;  // 映射覆盖的块数
+
+/*
+块组
+
+挂载时把描述符表和各组的位图读进内存，各组的位图按组号顺序拼接成一整张位图：
+块位图第 i 位对应块 i+1，第 g 组占其中第 g * s_blocks_per_group 位开始的一段；
+inode位图第 i 位对应 inode i+1，第 g 组占第 g * s_inodes_per_group 位开始的一段。
+这样位图查找仍然是在一段连续的位上扫描，写回时再按组切开。
+*/
+static ext2_group_desc_t *group_desc = NULL;  // 按整块分配，写回时整块写
+static uint32_t group_count = 0;
+static uint32_t gdt_blocks = 0;               // 描述符表占用的块数
+static uint8_t *block_bitmap = NULL;
+static uint8_t *inode_bitmap = NULL;
+
+// 元数据脏标记：分配/释放只修改内存中的位图、描述符和超级块计数，由 sync_fs_metadata 统一写回
+#define GROUP_BLOCK_BITMAP_DIRTY 0x01
+#define GROUP_INODE_BITMAP_DIRTY 0x02
+#define GROUP_DESC_DIRTY 0x04
+static uint8_t *group_dirty = NULL;           // 每组一个字节
+static int superblock_dirty = 0;
+
+/*
+块组的延迟初始化（EXT2_FEATURE_RO_COMPAT_UNINIT_BG）
+
+格式化时只写超级块和描述符表，各组都标记为 EXT2_BG_BLOCK_UNINIT | EXT2_BG_INODE_UNINIT：
+挂载时这些组的块位图按元数据布局推算，inode位图按全0处理，不读位图块；位图第一次写回时清除标志。
+bg_itable_unused 是inode表末尾从未使用过的inode数（水位线），分配到水位线之后的inode时，
+新用到的inode表块直接在缓存中清零，不从磁盘读入。
+挂载后一个后台线程把各组水位线之后的inode表清零，整组完成后由主线程设置 EXT2_BG_INODE_ZEROED。
+后台线程只写水位线之后的块，主线程推进水位线和后台线程选取要清零的块都在 itable_lock 内进行。
+*/
+#define ITABLE_ZERO_CHUNK (256 * 1024)       // 后台线程每次持锁清零的字节数
+static pthread_mutex_t itable_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t itable_thread;
+static int itable_thread_running = 0;
+static int itable_stop = 0;
+static uint32_t itable_blocks = 0;            // 每组inode表的块数
+static uint32_t *itable_used_blocks = NULL;   // 每组水位线以下的inode表块数
+static uint32_t *itable_zero_from = NULL;     // 每组inode表的 [zero_from, 表尾) 已由后台线程清零
+static uint32_t itable_done_pending = 0;      // 后台线程已完成、还没有记进描述符的组数
+
+// next-fit 游标：下一次分配从上次分配位置之后开始查找
+static int block_alloc_cursor = 0;
+static int inode_alloc_cursor = 0;
 
 // 位图操作,1占用，0不占用
 void set_bitmap_bit(uint8_t *bitmap, int bit)
@@ -20,242 +74,2614 @@ void set_bitmap_bit(uint8_t *bitmap, int bit)
     bitmap[byte] |= (1 << offset);
 }
 
-void clear_bitmap_bit(uint8_t *bitmap, int bit)
+void clear_bitmap_bit(uint8_t *bitmap, int bit)
+{
+    int byte = bit / 8;
+    int offset = bit % 8;
+    bitmap[byte] &= ~(1 << offset);
+}
+
+int get_bitmap_bit(uint8_t *bitmap, int bit)
+{
+    int byte = bit / 8;
+    int offset = bit % 8;
+    return (bitmap[byte] >> offset) & 1;
+}
+
+/*
+按小端序把位图中从第 word 个 64 位字读出来，
+第 i 位对应位图中的第 word * 64 + i 位（和 get_bitmap_bit 的编号一致）。
+*/
+static inline uint64_t load_bitmap_word(const uint8_t *bitmap, int word)
+{
+    uint64_t w;
+    memcpy(&w, bitmap + (size_t)word * 8, sizeof(w));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    w = __builtin_bswap64(w);
+#endif
+    return w;
+}
+
+/*
+在 [from, end) 范围内查找第一个 0 位，找不到返回-1。
+
+一次检查一个 64 位字：全 1 的字直接跳过，否则对取反后的字做 count-trailing-zeros
+得到第一个 0 的位置。连续四个字先整体按位与，全 1 时一次跳过 256 位
+（编译器会把它向量化成 SIMD 比较）。
+*/
+static int scan_zero_bit(const uint8_t *bitmap, int from, int end)
+{
+    int word = from / 64;
+    int full_words = end / 64;
+
+    // 第一个字：屏蔽掉 from 之前的位
+    if (word < full_words)
+    {
+        uint64_t inv = ~load_bitmap_word(bitmap, word) & (~0ULL << (from % 64));
+        if (inv != 0)
+        {
+            return word * 64 + __builtin_ctzll(inv);
+        }
+        word++;
+
+        while (word + 4 <= full_words)
+        {
+            uint64_t w0 = load_bitmap_word(bitmap, word);
+            uint64_t w1 = load_bitmap_word(bitmap, word + 1);
+            uint64_t w2 = load_bitmap_word(bitmap, word + 2);
+            uint64_t w3 = load_bitmap_word(bitmap, word + 3);
+            if ((w0 & w1 & w2 & w3) != ~0ULL)
+            {
+                break;
+            }
+            word += 4;
+        }
+
+        for (; word < full_words; word++)
+        {
+            inv = ~load_bitmap_word(bitmap, word);
+            if (inv != 0)
+            {
+                return word * 64 + __builtin_ctzll(inv);
+            }
+        }
+        from = full_words * 64;
+    }
+
+    // 不足一个字的尾部逐位检查
+    for (int i = from; i < end; i++)
+    {
+        if (!((bitmap[i / 8] >> (i % 8)) & 1))
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// 在 [from, end) 范围内查找第一个 1 位，找不到返回 end
+static int scan_set_bit(const uint8_t *bitmap, int from, int end)
+{
+    int word = from / 64;
+    int full_words = end / 64;
+
+    if (word < full_words)
+    {
+        uint64_t w = load_bitmap_word(bitmap, word) & (~0ULL << (from % 64));
+        for (;;)
+        {
+            if (w != 0)
+            {
+                return word * 64 + __builtin_ctzll(w);
+            }
+            if (++word >= full_words)
+            {
+                break;
+            }
+            w = load_bitmap_word(bitmap, word);
+        }
+        from = full_words * 64;
+    }
+
+    for (int i = from; i < end; i++)
+    {
+        if ((bitmap[i / 8] >> (i % 8)) & 1)
+        {
+            return i;
+        }
+    }
+    return end;
+}
+
+// 在 [from, end) 范围内从第 start 位开始查找 0 位，到 end 后回绕到 from 继续查找
+static int find_free_bit_in(const uint8_t *bitmap, int from, int end, int start)
+{
+    if (start < from || start >= end)
+    {
+        start = from;
+    }
+
+    int bit = scan_zero_bit(bitmap, start, end);
+    if (bit == -1 && start > from)
+    {
+        bit = scan_zero_bit(bitmap, from, start);
+    }
+    return bit;
+}
+
+/*
+从第 start 位开始查找第一个 0 位（空闲），到 nbits 后回绕到开头继续查找。
+nbits 是位图中有效的位数，返回位号，没有空闲位返回-1。
+*/
+int find_free_bit_from(const uint8_t *bitmap, int nbits, int start)
+{
+    return find_free_bit_in(bitmap, 0, nbits, start);
+}
+
+/*find_free_bit：
+
+扫描 block_bitmap（块位图）或者是inode_bitmap，寻找第一个 0（空闲块）。
+
+返回值为相应的位置块号或者inode号
+
+其中一位bitmap是8位，表示8个块或者8个inode
+
+size表示的是bitmap有多少个字节（BLOCK_SIZE）
+*/
+int find_free_bit(uint8_t *bitmap, int size)
+{
+    return find_free_bit_from(bitmap, size * 8, 0);
+}
+
+/*
+块缓冲区缓存（write-back LRU）
+
+所有经过 read_block/write_block 的块都先落在缓存里：
+- 按块号哈希查找，命中时直接 memcpy，不再发起系统调用
+- LRU 链表头部是最近使用的块，尾部是最先被淘汰的块
+- write_block 只把缓冲区标记为脏，真正写盘发生在淘汰、bcache_flush 或卸载时
+
+挂载了带日志的镜像时，经过 write_block 和inode表修改的块都是元数据：
+- 第一次弄脏时加入正在运行的事务（pinned），提交进日志之前不能写回原位置，淘汰时跳过
+- 已提交但还没写回的块再次被修改前，先把已提交的内容写回原位置，检查点时就不需要它的旧版本
+- 每条命令结束时，事务中的块数超过上限的一半或距上次提交超过 commit 秒，就把事务一次提交；
+  单个操作修改的块超过上限时提前提交，保证钉住的块最多占缓存的一半
+文件数据经 read_blocks/write_blocks 和批量请求直接读写磁盘，不进日志。
+*/
+typedef struct buffer_head
+{
+    uint32_t block_no;
+    int valid;                    // 缓冲区中是否有有效数据
+    int dirty;                    // 是否需要写回磁盘
+    int pinned;                   // 属于正在运行的日志事务，提交前不能写回原位置
+    uint8_t *data;
+    struct buffer_head *hash_next;
+    struct buffer_head *lru_prev;
+    struct buffer_head *lru_next;
+} buffer_head_t;
+
+static buffer_head_t *bcache_pool = NULL;
+static uint8_t *bcache_data = NULL;
+static buffer_head_t **bcache_hash = NULL;
+static uint32_t bcache_hash_size = 0;
+static uint32_t bcache_capacity = BCACHE_DEFAULT_CAPACITY;
+static buffer_head_t bcache_lru;  // 哨兵节点，lru_next 指向最近使用的块
+static bcache_stats_t bcache_stats;
+
+// 日志事务（只在缓冲区后端启用）
+static int journal_enabled = 0;
+static uint32_t txn_pinned = 0;               // 正在运行的事务中的块数
+static uint32_t txn_limit = 0;                // 一个事务最多的块数
+static time_t txn_start = 0;                  // 正在运行的事务中第一个块被弄脏的时间
+static int txn_committing = 0;                // 正在提交：写回内存中的元数据时不再触发提交
+#define JOURNAL_MIN_CACHE 16                  // 启用日志时缓存至少要有的块数，提交时写回位图等元数据还需要空闲的缓冲区
+
+// 文件数据直接写盘，上次 fdatasync 之后是否写过数据（为真时 ordered 模式提交前要先让数据落盘）
+static int data_pending = 0;
+static durability_stats_t durability_stats;
+
+/*
+直接读写磁盘镜像，不经过缓存。
+
+使用 pread/pwrite 按偏移读写，一次系统调用完成，不再需要 lseek + read/write 两次调用，
+也不依赖（和修改）文件描述符的当前偏移。
+*/
+static int disk_pread_full(void *buffer, size_t len, off_t offset)
+{
+    uint8_t *p = buffer;
+    while (len > 0)
+    {
+        ssize_t n = pread(disk_fd, p, len, offset);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return -1;
+        }
+        p += n;
+        len -= n;
+        offset += n;
+    }
+    return 0;
+}
+
+static int disk_pwrite_full(const void *buffer, size_t len, off_t offset)
+{
+    const uint8_t *p = buffer;
+    while (len > 0)
+    {
+        ssize_t n = pwrite(disk_fd, p, len, offset);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return -1;
+        }
+        p += n;
+        len -= n;
+        offset += n;
+    }
+    return 0;
+}
+
+static int disk_read_raw(uint32_t block_no, void *buffer)
+{
+    if (disk_fd == -1)
+    {
+        return -1;
+    }
+    return disk_pread_full(buffer, BLOCK_SIZE, (off_t)block_no * BLOCK_SIZE);
+}
+
+static int disk_write_raw(uint32_t block_no, const void *buffer)
+{
+    if (disk_fd == -1)
+    {
+        return -1;
+    }
+    return disk_pwrite_full(buffer, BLOCK_SIZE, (off_t)block_no * BLOCK_SIZE);
+}
+
+static uint32_t bcache_hash_fn(uint32_t block_no)
+{
+    return (block_no * 2654435761u) & (bcache_hash_size - 1);
+}
+
+static void lru_unlink(buffer_head_t *bh)
+{
+    bh->lru_prev->lru_next = bh->lru_next;
+    bh->lru_next->lru_prev = bh->lru_prev;
+}
+
+static void lru_push_front(buffer_head_t *bh)
+{
+    bh->lru_next = bcache_lru.lru_next;
+    bh->lru_prev = &bcache_lru;
+    bcache_lru.lru_next->lru_prev = bh;
+    bcache_lru.lru_next = bh;
+}
+
+static void lru_push_back(buffer_head_t *bh)
+{
+    bh->lru_prev = bcache_lru.lru_prev;
+    bh->lru_next = &bcache_lru;
+    bcache_lru.lru_prev->lru_next = bh;
+    bcache_lru.lru_prev = bh;
+}
+
+static void hash_remove(buffer_head_t *bh)
+{
+    buffer_head_t **pp = &bcache_hash[bcache_hash_fn(bh->block_no)];
+    while (*pp != NULL)
+    {
+        if (*pp == bh)
+        {
+            *pp = bh->hash_next;
+            break;
+        }
+        pp = &(*pp)->hash_next;
+    }
+    bh->hash_next = NULL;
+}
+
+static void hash_insert(buffer_head_t *bh)
+{
+    uint32_t h = bcache_hash_fn(bh->block_no);
+    bh->hash_next = bcache_hash[h];
+    bcache_hash[h] = bh;
+}
+
+static void bcache_free(void)
+{
+    free(bcache_pool);
+    free(bcache_data);
+    free(bcache_hash);
+    bcache_pool = NULL;
+    bcache_data = NULL;
+    bcache_hash = NULL;
+    bcache_hash_size = 0;
+}
+
+// 按当前容量分配缓冲区池，所有缓冲区初始都挂在 LRU 尾部等待使用
+static int bcache_alloc(void)
+{
+    uint32_t hash_size = 1;
+    while (hash_size < bcache_capacity * 2)
+    {
+        hash_size <<= 1;
+    }
+
+    bcache_pool = calloc(bcache_capacity, sizeof(buffer_head_t));
+    bcache_data = malloc((size_t)bcache_capacity * BLOCK_SIZE);
+    bcache_hash = calloc(hash_size, sizeof(buffer_head_t *));
+    if (bcache_pool == NULL || bcache_data == NULL || bcache_hash == NULL)
+    {
+        bcache_free();
+        return -1;
+    }
+    bcache_hash_size = hash_size;
+
+    bcache_lru.lru_next = &bcache_lru;
+    bcache_lru.lru_prev = &bcache_lru;
+    for (uint32_t i = 0; i < bcache_capacity; i++)
+    {
+        bcache_pool[i].data = bcache_data + (size_t)i * BLOCK_SIZE;
+        lru_push_back(&bcache_pool[i]);
+    }
+    return 0;
+}
+
+static buffer_head_t *bcache_lookup(uint32_t block_no)
+{
+    buffer_head_t *bh = bcache_hash[bcache_hash_fn(block_no)];
+    while (bh != NULL)
+    {
+        if (bh->block_no == block_no)
+        {
+            return bh;
+        }
+        bh = bh->hash_next;
+    }
+    return NULL;
+}
+
+// 把缓冲区移出正在运行的事务（内容被文件数据整块覆盖，或者块被释放）
+static void bh_unpin(buffer_head_t *bh)
+{
+    if (bh->pinned)
+    {
+        bh->pinned = 0;
+        txn_pinned--;
+    }
+}
+
+/*
+修改元数据块之前、取缓冲区之前调用：事务已满时先提交（单个操作太大，只能拆成两个事务）。
+提交会用到缓存，所以必须在调用者拿到缓冲区之前进行，否则它的缓冲区可能被淘汰。
+*/
+static int txn_reserve(void)
+{
+    if (journal_enabled && !txn_committing && txn_pinned >= txn_limit)
+    {
+        return commit_transaction();
+    }
+    return 0;
+}
+
+// 修改缓冲区之前调用，把它加入正在运行的事务；已提交但还没写回的旧内容先写回原位置
+static int bh_prepare_write(buffer_head_t *bh)
+{
+    if (!journal_enabled || bh->pinned)
+    {
+        return 0;
+    }
+    if (bh->dirty)
+    {
+        if (disk_write_raw(bh->block_no, bh->data) != 0)
+        {
+            return -1;
+        }
+        bh->dirty = 0;
+        bcache_stats.writebacks++;
+    }
+    if (txn_pinned == 0)
+    {
+        txn_start = time(NULL);
+    }
+    // 同一事务中先释放、又作为元数据重新使用的块，撤销记录作废
+    journal_cancel_revoke(bh->block_no);
+    bh->pinned = 1;
+    txn_pinned++;
+    return 0;
+}
+
+/*
+取得 block_no 对应的缓冲区并移到 LRU 头部。
+未命中时淘汰 LRU 尾部的缓冲区（脏块先写回），need_read 为 0 时调用者会整块覆盖，不必先读盘。
+*/
+static buffer_head_t *bcache_get(uint32_t block_no, int need_read)
+{
+    if (bcache_pool == NULL && bcache_alloc() != 0)
+    {
+        return NULL;
+    }
+
+    buffer_head_t *bh = bcache_lookup(block_no);
+    if (bh != NULL)
+    {
+        bcache_stats.hits++;
+        lru_unlink(bh);
+        lru_push_front(bh);
+        return bh;
+    }
+
+    bcache_stats.misses++;
+    // 从 LRU 尾部找第一个没有钉住的缓冲区；全都钉住时（不应发生）先提交事务
+    bh = bcache_lru.lru_prev;
+    while (bh != &bcache_lru && bh->pinned)
+    {
+        bh = bh->lru_prev;
+    }
+    if (bh == &bcache_lru)
+    {
+        if (commit_transaction() != 0)
+        {
+            return NULL;
+        }
+        bh = bcache_lru.lru_prev;
+    }
+    if (bh->valid)
+    {
+        if (bh->dirty)
+        {
+            if (disk_write_raw(bh->block_no, bh->data) != 0)
+            {
+                return NULL;
+            }
+            bcache_stats.writebacks++;
+        }
+        hash_remove(bh);
+        bcache_stats.evictions++;
+    }
+    bh->valid = 0;
+    bh->dirty = 0;
+
+    if (need_read && disk_read_raw(block_no, bh->data) != 0)
+    {
+        // 读取失败，缓冲区保持无效并留在 LRU 尾部
+        return NULL;
+    }
+
+    bh->block_no = block_no;
+    bh->valid = 1;
+    hash_insert(bh);
+    lru_unlink(bh);
+    lru_push_front(bh);
+    return bh;
+}
+
+static int compare_bh_block(const void *a, const void *b)
+{
+    uint32_t x = (*(buffer_head_t *const *)a)->block_no;
+    uint32_t y = (*(buffer_head_t *const *)b)->block_no;
+    return (x > y) - (x < y);
+}
+
+// 写回所有脏块（未提交的事务中的块除外），按块号排序以便顺序写盘
+int bcache_flush(void)
+{
+    if (bcache_pool == NULL || disk_fd == -1)
+    {
+        return 0;
+    }
+
+    buffer_head_t **dirty = malloc(bcache_capacity * sizeof(buffer_head_t *));
+    if (dirty == NULL)
+    {
+        return -1;
+    }
+
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < bcache_capacity; i++)
+    {
+        if (bcache_pool[i].valid && bcache_pool[i].dirty && !bcache_pool[i].pinned)
+        {
+            dirty[count++] = &bcache_pool[i];
+        }
+    }
+    qsort(dirty, count, sizeof(buffer_head_t *), compare_bh_block);
+
+    int result = 0;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (disk_write_raw(dirty[i]->block_no, dirty[i]->data) != 0)
+        {
+            result = -1;
+            continue;
+        }
+        dirty[i]->dirty = 0;
+        bcache_stats.writebacks++;
+    }
+
+    free(dirty);
+    return result;
+}
+
+static int store_group_metadata(void);
+
+/*
+提交正在运行的事务：钉住的块按块号排序后作为一个事务写进日志（一次写入、一次 fdatasync），
+之后它们只是普通的脏块，可以随时写回原位置。
+操作中途提交时，内存中的位图、描述符和超级块先写进缓存一起提交，
+这样事务里不会出现引用了位图中还是空闲的块或inode的情况（最多是分配了还没用上的块）。
+日志写满时先做检查点：已提交的块全部写回原位置并落盘，清空日志后再写。
+*/
+int commit_transaction(void)
+{
+    if (!journal_enabled || txn_committing)
+    {
+        return txn_committing ? -1 : 0;
+    }
+    txn_committing = 1;
+    int stored = store_group_metadata();
+    txn_committing = 0;
+    if (stored != 0)
+    {
+        return -1;
+    }
+    if (txn_pinned == 0 && !journal_has_revokes())
+    {
+        return 0;
+    }
+
+    uint32_t n = 0;
+    buffer_head_t **bhs = malloc((txn_pinned + 1) * sizeof(buffer_head_t *));
+    uint32_t *blocks = malloc((txn_pinned + 1) * sizeof(uint32_t));
+    uint8_t **data = malloc((txn_pinned + 1) * sizeof(uint8_t *));
+    if (bhs == NULL || blocks == NULL || data == NULL)
+    {
+        free(bhs);
+        free(blocks);
+        free(data);
+        return -1;
+    }
+    for (uint32_t i = 0; i < bcache_capacity && n < txn_pinned; i++)
+    {
+        if (bcache_pool[i].pinned)
+        {
+            bhs[n++] = &bcache_pool[i];
+        }
+    }
+    qsort(bhs, n, sizeof(buffer_head_t *), compare_bh_block);
+    for (uint32_t i = 0; i < n; i++)
+    {
+        blocks[i] = bhs[i]->block_no;
+        data[i] = bhs[i]->data;
+    }
+
+    // ordered 模式：事务可能引用刚写的数据块，数据先落盘；一次屏障覆盖之前写的所有数据
+    int ret = 0;
+    if (fs.mount_opts.data_mode == DATA_ORDERED && data_pending)
+    {
+        ret = fdatasync(disk_fd) == 0 ? 0 : -1;
+        durability_stats.data_flushes++;
+    }
+    if (ret == 0)
+    {
+        ret = journal_write_transaction(blocks, data, n);
+    }
+    if (ret == JOURNAL_FULL)
+    {
+        ret = -1;
+        if (bcache_flush() == 0 && fdatasync(disk_fd) == 0 && journal_reset() == 0)
+        {
+            ret = journal_write_transaction(blocks, data, n);
+        }
+    }
+
+    for (uint32_t i = 0; i < n; i++)
+    {
+        bhs[i]->pinned = 0;
+    }
+    txn_pinned = 0;
+    if (ret == 0)
+    {
+        // 提交时的 fdatasync 对整个镜像文件生效，之前写的数据也已落盘
+        data_pending = 0;
+    }
+    else
+    {
+        // 之后的修改不再有日志保护，脏块按普通的写回方式处理
+        printf("Error: Journal commit failed, journaling disabled\n");
+        journal_enabled = 0;
+    }
+
+    free(bhs);
+    free(blocks);
+    free(data);
+    return ret == 0 ? 0 : -1;
+}
+
+// 丢弃所有缓存内容（不写回），用于切换磁盘镜像
+void bcache_invalidate(void)
+{
+    if (bcache_pool == NULL)
+    {
+        return;
+    }
+    for (uint32_t i = 0; i < bcache_capacity; i++)
+    {
+        if (bcache_pool[i].valid)
+        {
+            hash_remove(&bcache_pool[i]);
+        }
+        bcache_pool[i].valid = 0;
+        bcache_pool[i].dirty = 0;
+        bcache_pool[i].pinned = 0;
+    }
+    txn_pinned = 0;
+}
+
+// 修改缓存容量，先写回脏块再按新容量重新分配
+int bcache_set_capacity(uint32_t capacity)
+{
+    if (capacity < BCACHE_MIN_CAPACITY)
+    {
+        return -1;
+    }
+    if (commit_transaction() != 0 || bcache_flush() != 0)
+    {
+        return -1;
+    }
+    bcache_free();
+    bcache_capacity = capacity;
+    return 0;
+}
+
+uint32_t bcache_get_capacity(void)
+{
+    return bcache_capacity;
+}
+
+void bcache_get_stats(bcache_stats_t *stats)
+{
+    *stats = bcache_stats;
+}
+
+// mmap 后端：块在映射中的地址，越界返回 NULL
+static uint8_t *map_block(uint32_t block_no)
+{
+    if (disk_map == NULL || block_no >= disk_map_blocks)
+    {
+        return NULL;
+    }
+    return disk_map + (size_t)block_no * BLOCK_SIZE;
+}
+
+// mmap 后端：count 个连续块是否都在映射范围内
+static int map_range_ok(uint32_t start, uint32_t count)
+{
+    return disk_map != NULL && start < disk_map_blocks && count <= disk_map_blocks - start;
+}
+
+/*block_no：要读取的块号（从 0 开始编号）。
+
+buffer：目标内存缓冲区，用于存储读取的数据*/
+int read_block(uint32_t block_no, void *buffer)
+{
+    if (disk_fd == -1)
+    {
+        return -1;
+    }
+
+    if (disk_backend == DISK_BACKEND_MMAP)
+    {
+        uint8_t *src = map_block(block_no);
+        if (src == NULL)
+        {
+            return -1;
+        }
+        memcpy(buffer, src, BLOCK_SIZE);
+        return 0;
+    }
+
+    buffer_head_t *bh = bcache_get(block_no, 1);
+    if (bh == NULL)
+    {
+        return -1;
+    }
+
+    memcpy(buffer, bh->data, BLOCK_SIZE);
+    return 0;
+}
+
+// 写入缓存并标记为脏，由 bcache_flush 或淘汰时写回磁盘
+int write_block(uint32_t block_no, const void *buffer)
+{
+    if (disk_fd == -1)
+    {
+        return -1;
+    }
+
+    if (disk_backend == DISK_BACKEND_MMAP)
+    {
+        uint8_t *dst = map_block(block_no);
+        if (dst == NULL)
+        {
+            return -1;
+        }
+        memcpy(dst, buffer, BLOCK_SIZE);
+        return 0;
+    }
+
+    if (txn_reserve() != 0)
+    {
+        return -1;
+    }
+    buffer_head_t *bh = bcache_get(block_no, 0);
+    if (bh == NULL || bh_prepare_write(bh) != 0)
+    {
+        return -1;
+    }
+
+    memcpy(bh->data, buffer, BLOCK_SIZE);
+    bh->dirty = 1;
+    return 0;
+}
+/*
+零拷贝读取：返回块内容的只读指针，不做 memcpy。
+
+mmap 后端下指针直接指向映射，卸载前一直有效；
+缓冲区后端下指针指向缓存缓冲区，只保证在下一次块层调用之前有效，调用者不能长期持有。
+*/
+const void *get_block_ptr(uint32_t block_no)
+{
+    if (disk_fd == -1)
+    {
+        return NULL;
+    }
+    if (disk_backend == DISK_BACKEND_MMAP)
+    {
+        return map_block(block_no);
+    }
+    buffer_head_t *bh = bcache_get(block_no, 1);
+    return bh ? bh->data : NULL;
+}
+
+// 把 [start, start+count) 范围内缓存的脏块写回磁盘
+static int bcache_writeback_range(uint32_t start, uint32_t count)
+{
+    if (bcache_pool == NULL)
+    {
+        return 0;
+    }
+    for (uint32_t i = 0; i < count; i++)
+    {
+        buffer_head_t *bh = bcache_lookup(start + i);
+        if (bh != NULL && bh->dirty && !bh->pinned)
+        {
+            if (disk_write_raw(bh->block_no, bh->data) != 0)
+            {
+                return -1;
+            }
+            bh->dirty = 0;
+            bcache_stats.writebacks++;
+        }
+    }
+    return 0;
+}
+
+// 丢弃 [start, start+count) 范围内的缓存副本
+static void bcache_drop_range(uint32_t start, uint32_t count)
+{
+    if (bcache_pool == NULL)
+    {
+        return;
+    }
+    for (uint32_t i = 0; i < count; i++)
+    {
+        buffer_head_t *bh = bcache_lookup(start + i);
+        if (bh != NULL)
+        {
+            bh_unpin(bh);
+            hash_remove(bh);
+            bh->valid = 0;
+            bh->dirty = 0;
+            lru_unlink(bh);
+            lru_push_back(bh);
+        }
+    }
+}
+
+/*
+多块读写接口
+
+read_blocks/write_blocks 在一次 pread/pwrite 中搬运 [start, start+count) 这一段连续的块，
+read_blocks_iov/write_blocks_iov 用 preadv/pwritev 把同一段连续的块散布到多个缓冲区。
+
+这些接口主要给文件数据使用，不会把块放进缓存，但要和缓存保持一致：
+- 读：已缓存的块（可能是脏的）以缓存为准
+- 写：写盘后同步更新或丢弃缓存中的旧副本
+*/
+int read_blocks(uint32_t start, uint32_t count, void *buffer)
+{
+    if (disk_fd == -1)
+    {
+        return -1;
+    }
+
+    if (disk_backend == DISK_BACKEND_MMAP)
+    {
+        if (!map_range_ok(start, count))
+        {
+            return -1;
+        }
+        memcpy(buffer, map_block(start), (size_t)count * BLOCK_SIZE);
+        return 0;
+    }
+
+    uint8_t *out = buffer;
+    uint32_t i = 0;
+    while (i < count)
+    {
+        buffer_head_t *bh = bcache_pool ? bcache_lookup(start + i) : NULL;
+        if (bh != NULL)
+        {
+            memcpy(out + (size_t)i * BLOCK_SIZE, bh->data, BLOCK_SIZE);
+            i++;
+            continue;
+        }
+
+        // 合并一段连续的未缓存块，一次 pread 读完
+        uint32_t run = 1;
+        while (i + run < count && (bcache_pool == NULL || bcache_lookup(start + i + run) == NULL))
+        {
+            run++;
+        }
+        if (disk_pread_full(out + (size_t)i * BLOCK_SIZE, (size_t)run * BLOCK_SIZE,
+                            (off_t)(start + i) * BLOCK_SIZE) != 0)
+        {
+            return -1;
+        }
+        i += run;
+    }
+    return 0;
+}
+
+int write_blocks(uint32_t start, uint32_t count, const void *buffer)
+{
+    if (disk_fd == -1)
+    {
+        return -1;
+    }
+
+    if (disk_backend == DISK_BACKEND_MMAP)
+    {
+        if (!map_range_ok(start, count))
+        {
+            return -1;
+        }
+        memcpy(map_block(start), buffer, (size_t)count * BLOCK_SIZE);
+        return 0;
+    }
+
+    if (disk_pwrite_full(buffer, (size_t)count * BLOCK_SIZE, (off_t)start * BLOCK_SIZE) != 0)
+    {
+        return -1;
+    }
+    data_pending = 1;
+
+    if (bcache_pool != NULL)
+    {
+        const uint8_t *in = buffer;
+        for (uint32_t i = 0; i < count; i++)
+        {
+            buffer_head_t *bh = bcache_lookup(start + i);
+            if (bh != NULL)
+            {
+                memcpy(bh->data, in + (size_t)i * BLOCK_SIZE, BLOCK_SIZE);
+                bh_unpin(bh);
+                bh->dirty = 0;
+            }
+        }
+    }
+    return 0;
+}
+
+static size_t iov_total(const struct iovec *iov, int iovcnt)
+{
+    size_t total = 0;
+    for (int i = 0; i < iovcnt; i++)
+    {
+        total += iov[i].iov_len;
+    }
+    return total;
+}
+
+int read_blocks_iov(uint32_t start, const struct iovec *iov, int iovcnt)
+{
+    if (disk_fd == -1 || iovcnt <= 0 || iovcnt > IOV_MAX)
+    {
+        return -1;
+    }
+
+    size_t total = iov_total(iov, iovcnt);
+    if (total % BLOCK_SIZE != 0)
+    {
+        return -1;
+    }
+    uint32_t count = total / BLOCK_SIZE;
+
+    if (disk_backend == DISK_BACKEND_MMAP)
+    {
+        if (!map_range_ok(start, count))
+        {
+            return -1;
+        }
+        const uint8_t *src = map_block(start);
+        for (int i = 0; i < iovcnt; i++)
+        {
+            memcpy(iov[i].iov_base, src, iov[i].iov_len);
+            src += iov[i].iov_len;
+        }
+        return 0;
+    }
+
+    // 范围内的脏块先写回，保证 preadv 读到的是最新内容
+    if (bcache_writeback_range(start, count) != 0)
+    {
+        return -1;
+    }
+
+    ssize_t n;
+    do
+    {
+        n = preadv(disk_fd, iov, iovcnt, (off_t)start * BLOCK_SIZE);
+    } while (n < 0 && errno == EINTR);
+    return n == (ssize_t)total ? 0 : -1;
+}
+
+int write_blocks_iov(uint32_t start, const struct iovec *iov, int iovcnt)
+{
+    if (disk_fd == -1 || iovcnt <= 0 || iovcnt > IOV_MAX)
+    {
+        return -1;
+    }
+
+    size_t total = iov_total(iov, iovcnt);
+    if (total % BLOCK_SIZE != 0)
+    {
+        return -1;
+    }
+    uint32_t count = total / BLOCK_SIZE;
+
+    if (disk_backend == DISK_BACKEND_MMAP)
+    {
+        if (!map_range_ok(start, count))
+        {
+            return -1;
+        }
+        uint8_t *dst = map_block(start);
+        for (int i = 0; i < iovcnt; i++)
+        {
+            memcpy(dst, iov[i].iov_base, iov[i].iov_len);
+            dst += iov[i].iov_len;
+        }
+        return 0;
+    }
+
+    ssize_t n;
+    do
+    {
+        n = pwritev(disk_fd, iov, iovcnt, (off_t)start * BLOCK_SIZE);
+    } while (n < 0 && errno == EINTR);
+    if (n != (ssize_t)total)
+    {
+        return -1;
+    }
+    data_pending = 1;
+
+    // 缓存中的旧副本已被整块覆盖，直接丢弃
+    bcache_drop_range(start, count);
+    return 0;
+}
+
+/*
+批量块请求
+
+一批互不相关的块请求交给 I/O 引擎（io_uring 或线程池），同时保持多个请求在途，全部完成后返回。
+和 read_blocks_iov/write_blocks_iov 一样与块缓存保持一致。
+*/
+int submit_block_batch(block_request_t *reqs, int nr)
+{
+    if (disk_fd == -1)
+    {
+        return -1;
+    }
+    if (nr <= 0)
+    {
+        return 0;
+    }
+
+    if (disk_backend == DISK_BACKEND_MMAP)
+    {
+        int result = 0;
+        for (int i = 0; i < nr; i++)
+        {
+            int ret = reqs[i].write ? write_blocks_iov(reqs[i].block_no, reqs[i].iov, reqs[i].iovcnt)
+                                    : read_blocks_iov(reqs[i].block_no, reqs[i].iov, reqs[i].iovcnt);
+            if (ret != 0)
+            {
+                result = -1;
+            }
+        }
+        return result;
+    }
+
+    io_request_t *io = malloc(nr * sizeof(io_request_t));
+    if (io == NULL)
+    {
+        return -1;
+    }
+
+    for (int i = 0; i < nr; i++)
+    {
+        io[i].op = reqs[i].write ? IO_OP_WRITE : IO_OP_READ;
+        io[i].fd = disk_fd;
+        io[i].offset = (off_t)reqs[i].block_no * BLOCK_SIZE;
+        io[i].iov = reqs[i].iov;
+        io[i].iovcnt = reqs[i].iovcnt;
+        io[i].result = -1;
+        if (!reqs[i].write &&
+            bcache_writeback_range(reqs[i].block_no, io_request_bytes(&io[i]) / BLOCK_SIZE) != 0)
+        {
+            free(io);
+            return -1;
+        }
+    }
+
+    int result = io_engine_submit(io, nr);
+
+    for (int i = 0; i < nr; i++)
+    {
+        if (reqs[i].write)
+        {
+            bcache_drop_range(reqs[i].block_no, io_request_bytes(&io[i]) / BLOCK_SIZE);
+            data_pending = 1;
+        }
+    }
+    free(io);
+    return result;
+}
+
+/*
+预读：把一批块一次性读进缓存，之后的 read_block 直接命中。
+目录扫描等场景先调用它，让多个块读请求同时在途，而不是逐块同步读取。
+*/
+int prefetch_blocks(const uint32_t *blocks, int n)
+{
+    if (disk_fd == -1 || disk_backend == DISK_BACKEND_MMAP)
+    {
+        return 0;
+    }
+    if (bcache_pool == NULL && bcache_alloc() != 0)
+    {
+        return -1;
+    }
+    // 预读不能把同一批中刚读进来的块又挤出去
+    if ((uint32_t)n > bcache_capacity / 2)
+    {
+        n = bcache_capacity / 2;
+    }
+
+    block_request_t *reqs = malloc(n * sizeof(block_request_t));
+    struct iovec *iov = malloc(n * sizeof(struct iovec));
+    buffer_head_t **bhs = malloc(n * sizeof(buffer_head_t *));
+    if (reqs == NULL || iov == NULL || bhs == NULL)
+    {
+        free(reqs);
+        free(iov);
+        free(bhs);
+        return -1;
+    }
+
+    int nr = 0;
+    for (int i = 0; i < n; i++)
+    {
+        if (blocks[i] == 0 || bcache_lookup(blocks[i]) != NULL)
+        {
+            continue;
+        }
+        buffer_head_t *bh = bcache_get(blocks[i], 0);
+        if (bh == NULL)
+        {
+            continue;
+        }
+        iov[nr].iov_base = bh->data;
+        iov[nr].iov_len = BLOCK_SIZE;
+        reqs[nr].write = 0;
+        reqs[nr].block_no = blocks[i];
+        reqs[nr].iov = &iov[nr];
+        reqs[nr].iovcnt = 1;
+        bhs[nr] = bh;
+        nr++;
+    }
+
+    int result = submit_block_batch(reqs, nr);
+    if (result != 0)
+    {
+        // 读取失败的缓冲区不能留在缓存里
+        for (int i = 0; i < nr; i++)
+        {
+            bcache_drop_range(bhs[i]->block_no, 1);
+        }
+    }
+
+    free(reqs);
+    free(iov);
+    free(bhs);
+    return result;
+}
+
+// 新建（或清空）一个镜像文件：用 ftruncate 得到稀疏文件（未写过的块读出来都是0），
+// 然后把格式化需要的元数据块作为一批写请求交给 I/O 引擎，多个写请求同时在途。
+// prealloc 非0时再用 fallocate 预先分配全部空间（文件系统不支持时忽略）
+int create_disk_image(const char *filename, uint32_t nblocks, int prealloc,
+                      const block_request_t *meta, int nr)
+{
+    int fd = open(filename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1)
+    {
+        return -1;
+    }
+
+    off_t size = (off_t)nblocks * BLOCK_SIZE;
+    if (ftruncate(fd, size) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    if (prealloc && fallocate(fd, 0, 0, size) != 0 && errno != EOPNOTSUPP && errno != ENOSYS)
+    {
+        close(fd);
+        return -1;
+    }
+
+    int result = 0;
+    if (nr > 0)
+    {
+        io_request_t *reqs = malloc(nr * sizeof(io_request_t));
+        if (reqs == NULL)
+        {
+            close(fd);
+            return -1;
+        }
+        for (int i = 0; i < nr; i++)
+        {
+            reqs[i].op = IO_OP_WRITE;
+            reqs[i].fd = fd;
+            reqs[i].offset = (off_t)meta[i].block_no * BLOCK_SIZE;
+            reqs[i].iov = meta[i].iov;
+            reqs[i].iovcnt = meta[i].iovcnt;
+            reqs[i].result = -1;
+        }
+        result = io_engine_submit(reqs, nr);
+        free(reqs);
+    }
+
+    if (close(fd) != 0)
+    {
+        result = -1;
+    }
+    return result;
+}
+
+// 计算inode所在的inode表块号，以及它是该块中的第几个inode
+static int inode_location(uint32_t inode_no, uint32_t *block_no, uint32_t *offset)
+{
+    if (inode_no == 0 || inode_no > fs.superblock.s_inodes_count || group_desc == NULL)
+    {
+        return -1;
+    }
+
+    // inode 先按 s_inodes_per_group 分到各组，再在所在组的inode表中顺序存放，
+    // 每块放 BLOCK_SIZE / sizeof(ext2_inode_t) 个（块尾不足一个inode的空间不用）
+    uint32_t per_block = BLOCK_SIZE / sizeof(ext2_inode_t);
+    uint32_t group = (inode_no - 1) / fs.superblock.s_inodes_per_group;
+    uint32_t index = (inode_no - 1) % fs.superblock.s_inodes_per_group;
+    *block_no = group_desc[group].bg_inode_table + index / per_block;
+    *offset = index % per_block;
+    return 0;
+}
+
+// inode表中第 inode_no 个inode所在位置的指针（块缓存或映射中），读写都直接操作这个位置
+static uint8_t *inode_table_slot(uint32_t inode_no, int for_write)
+{
+    uint32_t block_no, offset;
+    if (inode_location(inode_no, &block_no, &offset) != 0 || disk_fd == -1)
+    {
+        return NULL;
+    }
+
+    uint8_t *block;
+    if (disk_backend == DISK_BACKEND_MMAP)
+    {
+        block = map_block(block_no);
+    }
+    else
+    {
+        if (for_write && txn_reserve() != 0)
+        {
+            return NULL;
+        }
+        buffer_head_t *bh = bcache_get(block_no, 1);
+        if (bh == NULL || (for_write && bh_prepare_write(bh) != 0))
+        {
+            return NULL;
+        }
+        bh->dirty |= for_write;
+        block = bh->data;
+    }
+    if (block == NULL)
+    {
+        return NULL;
+    }
+    return block + offset * sizeof(ext2_inode_t);
+}
+
+/*
+inode缓存
+
+内存中的inode副本，按inode号哈希查找：
+- iget 返回缓存中的inode并增加引用计数，持有期间不会被淘汰，指针保持有效
+- 修改后调用 mark_inode_dirty，iput 释放引用
+- 脏inode只在被淘汰、icache_sync（每条命令结束时）或卸载时写回inode表
+read_inode/write_inode 也经过这个缓存，只是拷贝一份inode出来或拷贝进去。
+*/
+typedef struct icache_entry
+{
+    uint32_t inode_no;            // 0 表示空闲
+    int refcount;
+    int dirty;
+    ext2_inode_t inode;
+    block_map_cache_t map;        // 最近一次解析出的块映射
+    struct icache_entry *hash_next;
+    struct icache_entry *lru_prev;
+    struct icache_entry *lru_next;
+} icache_entry_t;
+
+#define ICACHE_HASH_SIZE 64
+
+static icache_entry_t icache_pool[ICACHE_CAPACITY];
+static icache_entry_t *icache_hash[ICACHE_HASH_SIZE];
+static icache_entry_t icache_lru;  // 哨兵节点，lru_next 指向最近使用的inode
+static icache_stats_t icache_stats;
+static int icache_ready = 0;
+
+static void icache_lru_unlink(icache_entry_t *e)
+{
+    e->lru_prev->lru_next = e->lru_next;
+    e->lru_next->lru_prev = e->lru_prev;
+}
+
+static void icache_lru_push_front(icache_entry_t *e)
+{
+    e->lru_next = icache_lru.lru_next;
+    e->lru_prev = &icache_lru;
+    icache_lru.lru_next->lru_prev = e;
+    icache_lru.lru_next = e;
+}
+
+static void icache_hash_remove(icache_entry_t *e)
+{
+    icache_entry_t **pp = &icache_hash[e->inode_no % ICACHE_HASH_SIZE];
+    while (*pp != NULL && *pp != e)
+    {
+        pp = &(*pp)->hash_next;
+    }
+    if (*pp == e)
+    {
+        *pp = e->hash_next;
+    }
+    e->hash_next = NULL;
+}
+
+// 清空缓存，不写回（调用者负责先 icache_sync）
+void icache_invalidate(void)
+{
+    memset(icache_hash, 0, sizeof(icache_hash));
+    icache_lru.lru_next = &icache_lru;
+    icache_lru.lru_prev = &icache_lru;
+    for (int i = 0; i < ICACHE_CAPACITY; i++)
+    {
+        icache_entry_t *e = &icache_pool[i];
+        e->inode_no = 0;
+        e->refcount = 0;
+        e->dirty = 0;
+        e->hash_next = NULL;
+        icache_lru_push_front(e);
+    }
+    icache_ready = 1;
+}
+
+static int icache_writeback(icache_entry_t *e)
+{
+    uint8_t *slot = inode_table_slot(e->inode_no, 1);
+    if (slot == NULL)
+    {
+        return -1;
+    }
+    memcpy(slot, &e->inode, sizeof(ext2_inode_t));
+    e->dirty = 0;
+    icache_stats.writebacks++;
+    return 0;
+}
+
+// 只在缓存中查找，不读inode表
+static icache_entry_t *icache_find(uint32_t inode_no)
+{
+    icache_entry_t *e = icache_hash[inode_no % ICACHE_HASH_SIZE];
+    while (e != NULL && e->inode_no != inode_no)
+    {
+        e = e->hash_next;
+    }
+    return e;
+}
+
+static icache_entry_t *icache_lookup(uint32_t inode_no)
+{
+    if (!icache_ready)
+    {
+        icache_invalidate();
+    }
+    if (inode_no == 0 || inode_no > fs.superblock.s_inodes_count || disk_fd == -1)
+    {
+        return NULL;
+    }
+
+    icache_entry_t *e = icache_find(inode_no);
+    if (e != NULL)
+    {
+        icache_stats.hits++;
+        icache_lru_unlink(e);
+        icache_lru_push_front(e);
+        return e;
+    }
+
+    // 未命中：从LRU尾部找一个没有被引用的项，脏的先写回
+    icache_stats.misses++;
+    for (e = icache_lru.lru_prev; e != &icache_lru && e->refcount > 0; e = e->lru_prev)
+    {
+    }
+    if (e == &icache_lru)
+    {
+        return NULL; // 所有项都被引用
+    }
+    if (e->inode_no != 0)
+    {
+        if (e->dirty && icache_writeback(e) != 0)
+        {
+            return NULL;
+        }
+        icache_hash_remove(e);
+    }
+
+    const uint8_t *slot = inode_table_slot(inode_no, 0);
+    if (slot == NULL)
+    {
+        e->inode_no = 0;
+        return NULL;
+    }
+    memcpy(&e->inode, slot, sizeof(ext2_inode_t));
+    memset(&e->map, 0, sizeof(e->map));
+    e->inode_no = inode_no;
+    e->dirty = 0;
+    e->hash_next = icache_hash[inode_no % ICACHE_HASH_SIZE];
+    icache_hash[inode_no % ICACHE_HASH_SIZE] = e;
+    icache_lru_unlink(e);
+    icache_lru_push_front(e);
+    return e;
+}
+
+static icache_entry_t *icache_entry_of(ext2_inode_t *inode)
+{
+    return (icache_entry_t *)((uint8_t *)inode - offsetof(icache_entry_t, inode));
+}
+
+ext2_inode_t *iget(uint32_t inode_no)
+{
+    icache_entry_t *e = icache_lookup(inode_no);
+    if (e == NULL)
+    {
+        return NULL;
+    }
+    e->refcount++;
+    return &e->inode;
+}
+
+void iput(ext2_inode_t *inode)
+{
+    if (inode != NULL)
+    {
+        icache_entry_t *e = icache_entry_of(inode);
+        if (e->refcount > 0)
+        {
+            e->refcount--;
+        }
+    }
+}
+
+void mark_inode_dirty(ext2_inode_t *inode)
+{
+    if (inode != NULL)
+    {
+        icache_entry_of(inode)->dirty = 1;
+    }
+}
+
+// 缓存inode的块映射缓存，修改块映射的代码负责让它失效（len 置0）
+block_map_cache_t *inode_block_map(ext2_inode_t *inode)
+{
+    return &icache_entry_of(inode)->map;
+}
+
+// 把所有脏inode写回inode表（写进块缓存或映射）
+int icache_sync(void)
+{
+    int ret = 0;
+    if (!icache_ready || disk_fd == -1)
+    {
+        return 0;
+    }
+    for (int i = 0; i < ICACHE_CAPACITY; i++)
+    {
+        icache_entry_t *e = &icache_pool[i];
+        if (e->inode_no != 0 && e->dirty && icache_writeback(e) != 0)
+        {
+            ret = -1;
+        }
+    }
+    return ret;
+}
+
+void icache_get_stats(icache_stats_t *stats)
+{
+    *stats = icache_stats;
+}
+
+/*
+零拷贝读取inode：返回缓存中inode的只读指针。
+不持有引用，有效期到下一次可能淘汰缓存项的inode操作为止；需要长期持有时用 iget/iput。
+*/
+const ext2_inode_t *get_inode_ptr(uint32_t inode_no)
+{
+    icache_entry_t *e = icache_lookup(inode_no);
+    return e != NULL ? &e->inode : NULL;
+}
+
+/*
+读inode_no里面的inode信息到inode结构体中。
+
+inode先经过inode缓存：命中时直接拷贝缓存中的副本，
+未命中时才根据块号block_no和块内偏移offset从inode表中读出。
+*/
+int read_inode(uint32_t inode_no, ext2_inode_t *inode)
+{
+    const ext2_inode_t *src = get_inode_ptr(inode_no);
+    if (src == NULL)
+    {
+        return -1;
+    }
+    memcpy(inode, src, sizeof(ext2_inode_t));
+    return 0;
+}
+
+/*
+批量读inode（例如列目录时取所有目录项的属性）：
+先找出不在inode缓存中的inode所在的inode表块，按块号排序去重后一次预读进块缓存，
+再逐个取出，每个inode表块只读一次。
+out[i] 对应 inode_nos[i]，读取失败的项清零。返回成功读出的个数。
+*/
+typedef struct
+{
+    uint32_t block_no;
+    uint32_t inode_no;
+} inode_slot_ref_t;
+
+static int compare_slot_ref(const void *a, const void *b)
+{
+    const inode_slot_ref_t *x = a, *y = b;
+    if (x->block_no != y->block_no)
+    {
+        return x->block_no < y->block_no ? -1 : 1;
+    }
+    return x->inode_no < y->inode_no ? -1 : x->inode_no > y->inode_no;
+}
+
+int read_inodes(const uint32_t *inode_nos, int count, ext2_inode_t *out)
+{
+    if (!icache_ready)
+    {
+        icache_invalidate();
+    }
+    inode_slot_ref_t *refs = malloc(count * sizeof(inode_slot_ref_t));
+    uint32_t *blocks = malloc(count * sizeof(uint32_t));
+    if (count > 0 && (refs == NULL || blocks == NULL))
+    {
+        free(refs);
+        free(blocks);
+        return -1;
+    }
+
+    int nrefs = 0;
+    for (int i = 0; i < count; i++)
+    {
+        uint32_t block_no, offset;
+        if (icache_find(inode_nos[i]) == NULL && inode_location(inode_nos[i], &block_no, &offset) == 0)
+        {
+            refs[nrefs].block_no = block_no;
+            refs[nrefs].inode_no = inode_nos[i];
+            nrefs++;
+        }
+    }
+    qsort(refs, nrefs, sizeof(inode_slot_ref_t), compare_slot_ref);
+    int nblocks = 0;
+    for (int i = 0; i < nrefs; i++)
+    {
+        if (nblocks == 0 || blocks[nblocks - 1] != refs[i].block_no)
+        {
+            blocks[nblocks++] = refs[i].block_no;
+        }
+    }
+    if (nblocks > 0)
+    {
+        prefetch_blocks(blocks, nblocks);
+    }
+    // 按inode表中的顺序装入inode缓存，之后的读取都是缓存命中
+    for (int i = 0; i < nrefs; i++)
+    {
+        get_inode_ptr(refs[i].inode_no);
+    }
+    free(refs);
+    free(blocks);
+
+    int ok = 0;
+    for (int i = 0; i < count; i++)
+    {
+        if (read_inode(inode_nos[i], &out[i]) == 0)
+        {
+            ok++;
+        }
+        else
+        {
+            memset(&out[i], 0, sizeof(ext2_inode_t));
+        }
+    }
+    return ok;
+}
+
+/* 只更新inode缓存中的副本并标记为脏，写回inode表推迟到淘汰或 icache_sync */
+int write_inode(uint32_t inode_no, const ext2_inode_t *inode)
+{
+    //  inode_no：要写入的 inode 编号（从 1 开始编号）。
+    //  inode：源内存结构体指针，存储待写入的 inode 数据。
+    icache_entry_t *e = icache_lookup(inode_no);
+    if (e == NULL)
+    {
+        return -1;
+    }
+    memcpy(&e->inode, inode, sizeof(ext2_inode_t));
+    memset(&e->map, 0, sizeof(e->map)); // 块指针可能整体变了
+    e->dirty = 1;
+    return 0;
+}
+
+// 块位图中的有效位数：块 1..s_blocks_count-1
+static int block_bit_count(void)
+{
+    return group_desc != NULL ? (int)(fs.superblock.s_blocks_count - 1) : 0;
+}
+
+// 位图第 bit 位的分配状态改变后，更新所在组的空闲计数并标记要写回的元数据
+static void block_bit_changed(int bit, int allocated)
+{
+    uint32_t g = (uint32_t)bit / fs.superblock.s_blocks_per_group;
+    if (allocated)
+    {
+        group_desc[g].bg_free_blocks_count--;
+        fs.superblock.s_free_blocks_count--;
+    }
+    else
+    {
+        group_desc[g].bg_free_blocks_count++;
+        fs.superblock.s_free_blocks_count++;
+    }
+    group_dirty[g] |= GROUP_BLOCK_BITMAP_DIRTY | GROUP_DESC_DIRTY;
+    superblock_dirty = 1;
+}
+
+// 块分配和释放
+uint32_t allocate_block(void)
+{
+
+    // 第 i 位对应块 i+1，最后一组中超出镜像的位在格式化时已经置1
+    int free_bit = find_free_bit_from(block_bitmap, block_bit_count(), block_alloc_cursor);
+    if (free_bit == -1)
+    {
+        return 0; // 没有空闲块
+    }
+    block_alloc_cursor = free_bit + 1;
+    /* 设置块位图block_bitmap中的对应位为已分配,分配后设置即
+    free_bit找到的位置是哪个块号是空闲的*/
+    set_bitmap_bit(block_bitmap, free_bit);
+
+    // 只标记为脏，命令结束或卸载时再写回位图
+    block_bit_changed(free_bit, 1);
+
+    return free_bit + 1; // 第0位是空闲的，但是这是第一块，块号从1开始
+}
+
+/*
+在 [from, end) 范围内做 best-fit：选能放下 want 块的最短空闲段，长度相同时选离 goal_bit 最近的；
+没有这么长的空闲段时选最长的一段。返回这一段的起始位（没有空闲位返回-1），*len 为它的长度。
+*/
+static int best_fit_run(int from, int end, int goal_bit, uint32_t want, int *len)
+{
+    int start = -1;
+    int best_dist = 0;
+    int pos = from;
+    *len = 0;
+    while (pos < end)
+    {
+        int run_start = scan_zero_bit(block_bitmap, pos, end);
+        if (run_start == -1)
+        {
+            break;
+        }
+        int run_end = scan_set_bit(block_bitmap, run_start, end);
+        int run_len = run_end - run_start;
+        int dist = abs(run_start - goal_bit);
+        int fits = run_len >= (int)want;
+        int best_fits = *len >= (int)want;
+
+        int better;
+        if (start == -1)
+        {
+            better = 1;
+        }
+        else if (fits != best_fits)
+        {
+            better = fits;
+        }
+        else if (run_len != *len)
+        {
+            // 都放得下时越短越好，都放不下时越长越好
+            better = fits ? run_len < *len : run_len > *len;
+        }
+        else
+        {
+            better = dist < best_dist;
+        }
+
+        if (better)
+        {
+            start = run_start;
+            *len = run_len;
+            best_dist = dist;
+        }
+        pos = run_end;
+    }
+    return start;
+}
+
+/*
+分配一段连续的块，最多 want 块，返回第一块的块号（没有空闲块返回0），*count 为实际分配的块数。
+
+- goal 非0且空闲时，从 goal 开始向后尽量延伸，新块紧接在文件已有的块之后
+- 否则先在 goal 所在的块组内做 best-fit，让文件的块和它的inode留在同一组；
+  组内放不下时再在整个位图上找，仍然没有这么长的空闲段时选最长的一段，剩下的部分由调用者继续分配
+*/
+uint32_t allocate_blocks(uint32_t goal, uint32_t want, uint32_t *count)
+{
+    int nbits = block_bit_count();
+    int start = -1;
+    int len = 0;
+    *count = 0;
+    if (want == 0 || nbits == 0)
+    {
+        return 0;
+    }
+
+    if (goal >= 1 && goal <= (uint32_t)nbits && !get_bitmap_bit(block_bitmap, goal - 1))
+    {
+        start = goal - 1;
+        len = scan_set_bit(block_bitmap, start, nbits) - start;
+    }
+    else
+    {
+        int goal_bit = goal >= 1 && goal <= (uint32_t)nbits ? (int)goal - 1 : 0;
+        int bpg = (int)fs.superblock.s_blocks_per_group;
+        int group_start = goal_bit / bpg * bpg;
+        int group_end = group_start + bpg < nbits ? group_start + bpg : nbits;
+        start = best_fit_run(group_start, group_end, goal_bit, want, &len);
+        if (start == -1 || len < (int)want)
+        {
+            int any_len;
+            int any = best_fit_run(0, nbits, goal_bit, want, &any_len);
+            if (any != -1 && any_len > len)
+            {
+                start = any;
+                len = any_len;
+            }
+        }
+    }
+
+    if (start == -1)
+    {
+        return 0; // 没有空闲块
+    }
+    if (len > (int)want)
+    {
+        len = want;
+    }
+
+    for (int i = start; i < start + len; i++)
+    {
+        set_bitmap_bit(block_bitmap, i);
+        block_bit_changed(i, 1);
+    }
+    block_alloc_cursor = start + len;
+
+    *count = len;
+    return start + 1;
+}
+
+void free_block(uint32_t block_no)
+{
+    if (block_no == 0 || (int)block_no > block_bit_count())
+    {
+        return;
+    }
+    // 重复释放不能让空闲计数变多
+    if (!get_bitmap_bit(block_bitmap, block_no - 1))
+    {
+        return;
+    }
+
+    // 释放的块可能马上被当作文件数据重新使用：它在事务中的内容作废，日志中的旧内容要撤销
+    if (journal_enabled)
+    {
+        buffer_head_t *bh = bcache_pool != NULL ? bcache_lookup(block_no) : NULL;
+        if (bh != NULL && bh->pinned)
+        {
+            bh_unpin(bh);
+            bh->dirty = 0;
+        }
+        // 撤销表扩不了：提交事务清空撤销表后再记一次；还记不下就不释放这个块，
+        // 宁可漏掉一个块，也不能让重放把旧元数据写到重新分配出去的块上
+        if (journal_is_logged(block_no) && journal_revoke(block_no) != 0 &&
+            (commit_transaction() != 0 || journal_revoke(block_no) != 0))
+        {
+            printf("Error: Failed to revoke journaled block %u, keeping it allocated\n", block_no);
+            return;
+        }
+    }
+
+    clear_bitmap_bit(block_bitmap, block_no - 1);
+    block_bit_changed(block_no - 1, 0);
+}
+
+// 释放一段连续的块（extent整段释放时使用），已经空闲的块跳过
+void free_blocks(uint32_t start, uint32_t count)
+{
+    for (uint32_t i = 0; i < count; i++)
+    {
+        free_block(start + i);
+    }
+}
+
+// inode 所在组的第一个数据块（inode表之后），作为还没有数据块的文件的分配目标
+uint32_t inode_goal_block(uint32_t inode_no)
+{
+    if (inode_no == 0 || inode_no > fs.superblock.s_inodes_count || group_desc == NULL)
+    {
+        return 0;
+    }
+    uint32_t per_block = BLOCK_SIZE / sizeof(ext2_inode_t);
+    uint32_t g = (inode_no - 1) / fs.superblock.s_inodes_per_group;
+    return group_desc[g].bg_inode_table + (fs.superblock.s_inodes_per_group + per_block - 1) / per_block;
+}
+
+/*
+选择新inode所在的块组：
+- 根目录下的目录分散到各组：在空闲inode不少于平均值的组中选空闲块最多的，
+  不同的目录树各自占一个组，组内的文件和数据块留在一起
+- 其他inode放在父目录所在的组，这一组没有空闲inode时依次尝试后面的组
+没有父目录时（格式化时创建根目录）从第 0 组开始，根目录因此总是 inode 2。
+*/
+static int find_inode_group(uint32_t parent_inode, int is_dir)
+{
+    uint32_t ipg = fs.superblock.s_inodes_per_group;
+    if (parent_inode > fs.superblock.s_inodes_count)
+    {
+        parent_inode = 0;
+    }
+
+    if (is_dir && parent_inode == EXT2_ROOT_INO && group_count > 1)
+    {
+        uint32_t avg = fs.superblock.s_free_inodes_count / group_count;
+        int best = -1;
+        for (uint32_t g = 0; g < group_count; g++)
+        {
+            uint32_t free_inodes = group_desc[g].bg_free_inodes_count;
+            if (free_inodes == 0 || free_inodes < avg)
+            {
+                continue;
+            }
+            if (best == -1 || group_desc[g].bg_free_blocks_count > group_desc[best].bg_free_blocks_count)
+            {
+                best = g;
+            }
+        }
+        if (best != -1)
+        {
+            return best;
+        }
+    }
+
+    uint32_t first = parent_inode != 0 ? (parent_inode - 1) / ipg : 0;
+    for (uint32_t i = 0; i < group_count; i++)
+    {
+        uint32_t g = (first + i) % group_count;
+        if (group_desc[g].bg_free_inodes_count > 0)
+        {
+            return g;
+        }
+    }
+    return -1;
+}
+
+// 分配到组内第 index 个inode：越过水位线时推进水位线，新用到的inode表块直接在缓存中清零
+static void itable_claim(uint32_t g, uint32_t index)
+{
+    static const uint8_t zero_block[BLOCK_SIZE];
+    if (!(fs.superblock.s_feature_ro_compat & EXT2_FEATURE_RO_COMPAT_UNINIT_BG))
+    {
+        return;
+    }
+    uint32_t ipg = fs.superblock.s_inodes_per_group;
+    uint32_t used = ipg - group_desc[g].bg_itable_unused;
+    if (index < used)
+    {
+        return;
+    }
+
+    // 只有第一个inode都在水位线之后的块才是整块未使用的
+    uint32_t per_block = BLOCK_SIZE / sizeof(ext2_inode_t);
+    uint32_t first = (used + per_block - 1) / per_block;
+    uint32_t last = index / per_block;
+    pthread_mutex_lock(&itable_lock);
+    itable_used_blocks[g] = last + 1;
+    pthread_mutex_unlock(&itable_lock);
+    for (uint32_t b = first; b <= last; b++)
+    {
+        write_block(group_desc[g].bg_inode_table + b, zero_block);
+    }
+
+    group_desc[g].bg_itable_unused = ipg - index - 1;
+    group_dirty[g] |= GROUP_DESC_DIRTY;
+}
+
+uint32_t allocate_inode(uint32_t parent_inode, int is_dir)
 {
-    int byte = bit / 8;
-    int offset = bit % 8;
-    bitmap[byte] &= ~(1 << offset);
+    if (group_desc == NULL)
+    {
+        return 0;
+    }
+    int g = find_inode_group(parent_inode, is_dir);
+    if (g == -1)
+    {
+        return 0; // 没有空闲inode
+    }
+
+    // 第 i 位对应 inode i+1，在选中的组内从游标处开始找
+    int ipg = (int)fs.superblock.s_inodes_per_group;
+    int free_bit = find_free_bit_in(inode_bitmap, g * ipg, (g + 1) * ipg, inode_alloc_cursor);
+    if (free_bit == -1)
+    {
+        return 0; // 组描述符的计数和位图不一致
+    }
+    inode_alloc_cursor = free_bit + 1;
+    itable_claim(g, free_bit - g * ipg);
+
+    set_bitmap_bit(inode_bitmap, free_bit); // 把空闲的inode号设置为占用
+    fs.superblock.s_free_inodes_count--;
+    group_desc[g].bg_free_inodes_count--;
+    if (is_dir)
+    {
+        group_desc[g].bg_used_dirs_count++;
+    }
+
+    group_dirty[g] |= GROUP_INODE_BITMAP_DIRTY | GROUP_DESC_DIRTY;
+    superblock_dirty = 1;
+
+    return free_bit + 1; // inode号从1开始
 }
 
-int get_bitmap_bit(uint8_t *bitmap, int bit)
+void free_inode(uint32_t inode_no, int is_dir)
 {
-    int byte = bit / 8;
-    int offset = bit % 8;
-    return (bitmap[byte] >> offset) & 1;
+    if (inode_no == 0 || inode_no > fs.superblock.s_inodes_count || group_desc == NULL)
+    {
+        return;
+    }
+    if (!get_bitmap_bit(inode_bitmap, inode_no - 1))
+    {
+        return;
+    }
+
+    uint32_t g = (inode_no - 1) / fs.superblock.s_inodes_per_group;
+    clear_bitmap_bit(inode_bitmap, inode_no - 1);
+    fs.superblock.s_free_inodes_count++;
+    group_desc[g].bg_free_inodes_count++;
+    if (is_dir && group_desc[g].bg_used_dirs_count > 0)
+    {
+        group_desc[g].bg_used_dirs_count--;
+    }
+
+    group_dirty[g] |= GROUP_INODE_BITMAP_DIRTY | GROUP_DESC_DIRTY;
+    superblock_dirty = 1;
 }
 
-/*find_free_bit：
+void mark_superblock_dirty(void)
+{
+    superblock_dirty = 1;
+}
 
-扫描 block_bitmap（块位图）或者是inode_bitmap，寻找第一个 0（空闲块）。
+// 超级块只占块 0 的前 sizeof(ext2_superblock_t) 字节，不能整块读进 fs.superblock
+static int load_superblock(void)
+{
+    uint8_t buffer[BLOCK_SIZE];
+    if (read_block(0, buffer) != 0)
+    {
+        return -1;
+    }
+    memcpy(&fs.superblock, buffer, sizeof(ext2_superblock_t));
+    return 0;
+}
 
-返回值为相应的位置块号或者inode号
+static int store_superblock(void)
+{
+    uint8_t buffer[BLOCK_SIZE];
+    if (read_block(0, buffer) != 0)
+    {
+        return -1;
+    }
+    fs.superblock.s_wtime = time(NULL);
+    memcpy(buffer, &fs.superblock, sizeof(ext2_superblock_t));
+    return write_block(0, buffer);
+}
 
-其中一位bitmap是8位，表示8个块或者8个inode
+// 把一组的位图写回它的位图块，块中超出本组位数的部分按 ext2 的约定填1
+static int store_group_bitmap(uint32_t block_no, const uint8_t *bits, uint32_t nbytes)
+{
+    uint8_t buffer[BLOCK_SIZE];
+    memset(buffer, 0xFF, BLOCK_SIZE);
+    memcpy(buffer, bits, nbytes);
+    return write_block(block_no, buffer);
+}
 
-size表示的是bitmap有多少个字节（BLOCK_SIZE）
-*/
-int find_free_bit(uint8_t *bitmap, int size)
+// 把后台线程清零完成的组记进描述符
+static void itable_collect_done(void)
 {
-    for (int i = 0; i < size * 8; i++)
+    pthread_mutex_lock(&itable_lock);
+    if (itable_done_pending > 0)
     {
-        if (!get_bitmap_bit(bitmap, i))
+        for (uint32_t g = 0; g < group_count; g++)
         {
-            return i;
+            if (!(group_desc[g].bg_flags & EXT2_BG_INODE_ZEROED) && itable_zero_from[g] <= itable_used_blocks[g])
+            {
+                group_desc[g].bg_flags |= EXT2_BG_INODE_ZEROED;
+                group_dirty[g] |= GROUP_DESC_DIRTY;
+            }
         }
+        itable_done_pending = 0;
     }
-    return -1;
+    pthread_mutex_unlock(&itable_lock);
 }
 
-/*block_no：要读取的块号（从 0 开始编号）。
-
-buffer：目标内存缓冲区，用于存储读取的数据*/
-int read_block(uint32_t block_no, void *buffer)
+// 把镜像中的一段块清零：优先用 fallocate 让文件系统直接清零，不支持时写零块
+static int zero_disk_blocks(uint32_t start, uint32_t count, uint8_t **zero)
 {
-    if (disk_fd == -1)
+    off_t offset = (off_t)start * BLOCK_SIZE;
+    size_t len = (size_t)count * BLOCK_SIZE;
+    if (fallocate(disk_fd, FALLOC_FL_ZERO_RANGE, offset, len) == 0)
+    {
+        return 0;
+    }
+    if (*zero == NULL && (*zero = calloc(1, len)) == NULL)
     {
         return -1;
     }
+    return disk_pwrite_full(*zero, len, offset);
+}
 
-    off_t offset = (off_t)block_no * BLOCK_SIZE;
-    if (lseek(disk_fd, offset, SEEK_SET) == -1)
+// 后台线程：逐组从inode表末尾向水位线清零，每次持锁处理 ITABLE_ZERO_CHUNK 字节
+static void *itable_init_worker(void *arg)
+{
+    (void)arg;
+    uint32_t chunk = ITABLE_ZERO_CHUNK / BLOCK_SIZE > 0 ? ITABLE_ZERO_CHUNK / BLOCK_SIZE : 1;
+    uint8_t *zero = NULL;
+    for (uint32_t g = 0; g < group_count; g++)
     {
-        return -1;
+        for (;;)
+        {
+            pthread_mutex_lock(&itable_lock);
+            if (itable_stop)
+            {
+                pthread_mutex_unlock(&itable_lock);
+                free(zero);
+                return NULL;
+            }
+            uint32_t used = itable_used_blocks[g];
+            uint32_t from = itable_zero_from[g];
+            if (from <= used)
+            {
+                itable_done_pending++;
+                pthread_mutex_unlock(&itable_lock);
+                break;
+            }
+            uint32_t count = from - used < chunk ? from - used : chunk;
+            int ret = zero_disk_blocks(group_desc[g].bg_inode_table + from - count, count, &zero);
+            if (ret == 0)
+            {
+                itable_zero_from[g] = from - count;
+            }
+            pthread_mutex_unlock(&itable_lock);
+            if (ret != 0)
+            {
+                free(zero); // 放弃，下次挂载时再继续
+                return NULL;
+            }
+        }
+    }
+    free(zero);
+    return NULL;
+}
+
+// 挂载后启动后台清零线程（没有需要清零的组时不启动）
+int start_itable_init(void)
+{
+    if (disk_fd == -1 || itable_thread_running ||
+        !(fs.superblock.s_feature_ro_compat & EXT2_FEATURE_RO_COMPAT_UNINIT_BG))
+    {
+        return 0;
+    }
+    uint32_t g = 0;
+    while (g < group_count && itable_zero_from[g] <= itable_used_blocks[g])
+    {
+        g++;
+    }
+    if (g == group_count)
+    {
+        return 0;
     }
 
-    
-    ssize_t bytes_read = read(disk_fd, buffer, BLOCK_SIZE);
-    if (bytes_read != BLOCK_SIZE)
+    itable_stop = 0;
+    if (pthread_create(&itable_thread, NULL, itable_init_worker, NULL) != 0)
     {
         return -1;
     }
-
+    itable_thread_running = 1;
     return 0;
 }
-/*每个块的大小为 BLOCK_SIZE（例如 4KB）。
 
-块号 block_no 乘以 BLOCK_SIZE，得到该块在文件中的字节偏移量。
+// 停止后台清零线程，正在清零的一段完成后返回
+void stop_itable_init(void)
+{
+    if (!itable_thread_running)
+    {
+        return;
+    }
+    pthread_mutex_lock(&itable_lock);
+    itable_stop = 1;
+    pthread_mutex_unlock(&itable_lock);
+    pthread_join(itable_thread, NULL);
+    itable_thread_running = 0;
+}
 
-调用 lseek 将文件指针移动到 offset 处。
+// inode表已全部初始化（清零或已使用）的组数
+uint32_t get_itable_init_progress(void)
+{
+    uint32_t done = 0;
+    pthread_mutex_lock(&itable_lock);
+    for (uint32_t g = 0; g < group_count; g++)
+    {
+        if (itable_zero_from[g] <= itable_used_blocks[g])
+        {
+            done++;
+        }
+    }
+    pthread_mutex_unlock(&itable_lock);
+    return done;
+}
 
-SEEK_SET 表示从文件开头计算偏移量。
+// 把内存中的脏位图、描述符和超级块写进块缓存
+static int store_group_metadata(void)
+{
+    int ret = 0;
+    uint32_t block_bytes = fs.superblock.s_blocks_per_group / 8;
+    uint32_t inode_bytes = fs.superblock.s_inodes_per_group / 8;
+    uint32_t desc_per_block = BLOCK_SIZE / sizeof(ext2_group_desc_t);
+    for (uint32_t g = 0; g < group_count; g++)
+    {
+        if (group_dirty[g] & GROUP_BLOCK_BITMAP_DIRTY)
+        {
+            if (store_group_bitmap(group_desc[g].bg_block_bitmap, block_bitmap + (size_t)g * block_bytes, block_bytes) == 0)
+            {
+                group_dirty[g] &= ~GROUP_BLOCK_BITMAP_DIRTY;
+                if (group_desc[g].bg_flags & EXT2_BG_BLOCK_UNINIT)
+                {
+                    group_desc[g].bg_flags &= ~EXT2_BG_BLOCK_UNINIT;
+                    group_dirty[g] |= GROUP_DESC_DIRTY;
+                }
+            }
+            else
+            {
+                ret = -1;
+            }
+        }
+        if (group_dirty[g] & GROUP_INODE_BITMAP_DIRTY)
+        {
+            if (store_group_bitmap(group_desc[g].bg_inode_bitmap, inode_bitmap + (size_t)g * inode_bytes, inode_bytes) == 0)
+            {
+                group_dirty[g] &= ~GROUP_INODE_BITMAP_DIRTY;
+                if (group_desc[g].bg_flags & EXT2_BG_INODE_UNINIT)
+                {
+                    group_desc[g].bg_flags &= ~EXT2_BG_INODE_UNINIT;
+                    group_dirty[g] |= GROUP_DESC_DIRTY;
+                }
+            }
+            else
+            {
+                ret = -1;
+            }
+        }
+        if (group_dirty[g] & GROUP_DESC_DIRTY)
+        {
+            // 描述符表按块写回，同一块中其他组的描述符一起写
+            uint32_t first = g / desc_per_block * desc_per_block;
+            if (write_block(1 + g / desc_per_block, group_desc + first) == 0)
+            {
+                for (uint32_t i = first; i < first + desc_per_block && i < group_count; i++)
+                {
+                    group_dirty[i] &= ~GROUP_DESC_DIRTY;
+                }
+            }
+            else
+            {
+                ret = -1;
+            }
+        }
+    }
+    if (superblock_dirty)
+    {
+        if (store_superblock() == 0)
+        {
+            superblock_dirty = 0;
+        }
+        else
+        {
+            ret = -1;
+        }
+    }
 
-如果移动失败（如 offset 超出文件大小），返回错误。
+    return ret;
+}
 
-*/
-int write_block(uint32_t block_no, const void *buffer)
+int sync_fs_metadata(void)
 {
     if (disk_fd == -1)
     {
-        return -1;
+        return 0;
     }
 
-    off_t offset = (off_t)block_no * BLOCK_SIZE;
-    if (lseek(disk_fd, offset, SEEK_SET) == -1)
+    int ret = icache_sync();
+    itable_collect_done();
+    if (store_group_metadata() != 0)
     {
-        return -1;
+        ret = -1;
     }
-    /*调用 write 将 buffer 中的 BLOCK_SIZE 字节数据写入当前文件指针位置。
-    如果实际写入的字节数 bytes_written 不等于 BLOCK_SIZE，说明写入失败（可能磁盘已满或发生 I/O 错误），返回错误。*/
-    ssize_t bytes_written = write(disk_fd, buffer, BLOCK_SIZE);
-    if (bytes_written != BLOCK_SIZE)
+
+    // 组提交：这里是操作的边界，事务攒到上限的一半或超过提交间隔时一次提交
+    if (journal_enabled && txn_pinned > 0 &&
+        (txn_pinned >= txn_limit / 2 || time(NULL) - txn_start >= (time_t)fs.mount_opts.commit_interval))
     {
-        return -1;
+        if (commit_transaction() != 0)
+        {
+            ret = -1;
+        }
     }
-
-    return 0;
+    return ret;
 }
+
 /*
-读inode_no里面的inode信息到inode结构体中。
+校验超级块中的几何参数，算出块组数和描述符表占用的块数。
+块大小必须和编译时的 BLOCK_SIZE 一致；每组的位数必须是8的倍数，各组的位图才能按字节拼接。
 */
-int read_inode(uint32_t inode_no, ext2_inode_t *inode)
+static int check_geometry(void)
 {
-    if (inode_no == 0 || inode_no >= MAX_INODES)
+    const ext2_superblock_t *sb = &fs.superblock;
+    if (sb->s_magic != 0xEF53)
     {
+        printf("Error: Invalid file system magic number\n");
+        return -1;
+    }
+    if (sb->s_rev_level != EXT2_DYNAMIC_REV)
+    {
+        printf("Error: Unsupported file system revision %u, please reformat the image\n", sb->s_rev_level);
+        return -1;
+    }
+    if (sb->s_log_block_size > 6 || (1024u << sb->s_log_block_size) != BLOCK_SIZE)
+    {
+        printf("Error: Image block size is %u bytes, this build uses %d (rebuild with make BLOCK_SIZE=N)\n",
+               sb->s_log_block_size > 6 ? 0 : 1024u << sb->s_log_block_size, BLOCK_SIZE);
         return -1;
     }
 
-    // 计算inode在磁盘上的位置
-    // 超级块占1个块，块位图占1个块，inode位图占1个块
-    // inode表从第4个块开始
-    // inode表存储的是inode信息，每个inode占用sizeof(ext2_inode_t)字节。
-    /*
-(BLOCK_SIZE / sizeof(ext2_inode_t)得到的是多少inode占据一个块，比如1024/256=4也就是4个inode一个块*/
-    uint32_t block_no = 3 + (inode_no - 1) / (BLOCK_SIZE / sizeof(ext2_inode_t));
-    uint32_t offset = (inode_no - 1) % (BLOCK_SIZE / sizeof(ext2_inode_t));
+    uint32_t bpg = sb->s_blocks_per_group;
+    uint32_t ipg = sb->s_inodes_per_group;
+    if (sb->s_inode_size != sizeof(ext2_inode_t) || sb->s_blocks_count < 2 || sb->s_blocks_count - 1 > INT_MAX ||
+        bpg < EXT2_MIN_BLOCKS_PER_GROUP || bpg > EXT2_MAX_BLOCKS_PER_GROUP || bpg % 8 != 0 ||
+        ipg == 0 || ipg > EXT2_MAX_INODES_PER_GROUP || ipg % 8 != 0)
+    {
+        printf("Error: Invalid file system geometry\n");
+        return -1;
+    }
 
-    uint8_t buffer[BLOCK_SIZE];
-    if (read_block(block_no, buffer) != 0)
+    group_count = (sb->s_blocks_count - 1 + bpg - 1) / bpg;
+    if ((uint64_t)group_count * ipg != sb->s_inodes_count || sb->s_inodes_count > INT_MAX)
     {
+        printf("Error: Invalid file system geometry\n");
         return -1;
     }
-    /*buffer + offset * sizeof(ext2_inode_t) 计算 inode 在缓冲区中的起始地址。
-        memcpy 将数据拷贝到 inode 结构体。
+    gdt_blocks = (group_count * sizeof(ext2_group_desc_t) + BLOCK_SIZE - 1) / BLOCK_SIZE;
 
-    首先需要知道他的块号block_no，读到对应的块到buffer中，
-    然后计算出inode在该块中的偏移量offset(块为单位的偏移，第一块，第二块，第三块)，最后将该块中对应的inode数据（大小为ext2_inode_t）拷贝到inode返回的指针中。
-    */
-    memcpy(inode, buffer + offset * sizeof(ext2_inode_t), sizeof(ext2_inode_t));
+    struct stat st;
+    if (fstat(disk_fd, &st) != 0 || (uint64_t)st.st_size < (uint64_t)sb->s_blocks_count * BLOCK_SIZE)
+    {
+        printf("Error: Disk image is smaller than the file system\n");
+        return -1;
+    }
     return 0;
 }
-/* 注意这里的buffer是块的起始地址，如果要写入的是inode_no=2的话，根据块偏移找到对应的位置（同上）
-    memcpy(buffer + offset * sizeof(ext2_inode_t), inode, sizeof(ext2_inode_t));*/
-int write_inode(uint32_t inode_no, const ext2_inode_t *inode)
+
+static void free_groups(void)
 {
-    //  inode_no：要写入的 inode 编号（从 1 开始编号）。
-    //  inode：源内存结构体指针，存储待写入的 inode 数据。
-    if (inode_no == 0 || inode_no >= MAX_INODES)
+    free(group_desc);
+    free(block_bitmap);
+    free(inode_bitmap);
+    free(group_dirty);
+    free(itable_used_blocks);
+    free(itable_zero_from);
+    group_desc = NULL;
+    block_bitmap = NULL;
+    inode_bitmap = NULL;
+    group_dirty = NULL;
+    itable_used_blocks = NULL;
+    itable_zero_from = NULL;
+    itable_done_pending = 0;
+    group_count = 0;
+    gdt_blocks = 0;
+    itable_blocks = 0;
+}
+
+// 未初始化的组没有写过块位图：组开头到inode表末尾是元数据，最后一组超出镜像的部分也置1
+static int init_group_block_bitmap(uint32_t g)
+{
+    uint32_t bpg = fs.superblock.s_blocks_per_group;
+    uint8_t *bits = block_bitmap + (size_t)g * (bpg / 8);
+    uint32_t first = 1 + g * bpg;
+    uint32_t nblocks = fs.superblock.s_blocks_count - first < bpg ? fs.superblock.s_blocks_count - first : bpg;
+    if (group_desc[g].bg_inode_table < first || group_desc[g].bg_inode_table - first + itable_blocks > nblocks)
+    {
+        return -1;
+    }
+    uint32_t meta = group_desc[g].bg_inode_table - first + itable_blocks;
+    for (uint32_t i = 0; i < meta; i++)
+    {
+        set_bitmap_bit(bits, i);
+    }
+    for (uint32_t i = nblocks; i < bpg; i++)
+    {
+        set_bitmap_bit(bits, i);
+    }
+    return 0;
+}
+
+// 读入描述符表和各组的位图
+static int load_groups(void)
+{
+    uint32_t block_bytes = fs.superblock.s_blocks_per_group / 8;
+    uint32_t inode_bytes = fs.superblock.s_inodes_per_group / 8;
+    // 位图末尾留出一个64位字，按字扫描时不会越界
+    group_desc = malloc((size_t)gdt_blocks * BLOCK_SIZE);
+    block_bitmap = calloc((size_t)group_count * block_bytes + 8, 1);
+    inode_bitmap = calloc((size_t)group_count * inode_bytes + 8, 1);
+    group_dirty = calloc(group_count, 1);
+    itable_used_blocks = calloc(group_count, sizeof(uint32_t));
+    itable_zero_from = calloc(group_count, sizeof(uint32_t));
+    if (group_desc == NULL || block_bitmap == NULL || inode_bitmap == NULL || group_dirty == NULL ||
+        itable_used_blocks == NULL || itable_zero_from == NULL ||
+        read_blocks(1, gdt_blocks, group_desc) != 0)
     {
+        free_groups();
         return -1;
     }
 
-    uint32_t block_no = 3 + (inode_no - 1) / (BLOCK_SIZE / sizeof(ext2_inode_t));
-    uint32_t offset = (inode_no - 1) % (BLOCK_SIZE / sizeof(ext2_inode_t));
+    // 没有延迟初始化特性的镜像，各组按已初始化处理（旧镜像的 bg_flags/bg_itable_unused 为0）
+    int uninit_bg = (fs.superblock.s_feature_ro_compat & EXT2_FEATURE_RO_COMPAT_UNINIT_BG) != 0;
+    uint32_t ipg = fs.superblock.s_inodes_per_group;
+    uint32_t per_block = BLOCK_SIZE / sizeof(ext2_inode_t);
+    itable_blocks = (ipg + per_block - 1) / per_block;
 
     uint8_t buffer[BLOCK_SIZE];
-    if (read_block(block_no, buffer) != 0)
+    for (uint32_t g = 0; g < group_count; g++)
     {
-        return -1;
+        ext2_group_desc_t *gd = &group_desc[g];
+        if (!uninit_bg)
+        {
+            gd->bg_flags = 0;
+            gd->bg_itable_unused = 0;
+        }
+        if (gd->bg_block_bitmap >= fs.superblock.s_blocks_count || gd->bg_inode_bitmap >= fs.superblock.s_blocks_count ||
+            gd->bg_inode_table >= fs.superblock.s_blocks_count || gd->bg_itable_unused > ipg)
+        {
+            free_groups();
+            return -1;
+        }
+        if (gd->bg_flags & EXT2_BG_BLOCK_UNINIT)
+        {
+            if (init_group_block_bitmap(g) != 0)
+            {
+                free_groups();
+                return -1;
+            }
+        }
+        else
+        {
+            if (read_block(gd->bg_block_bitmap, buffer) != 0)
+            {
+                free_groups();
+                return -1;
+            }
+            memcpy(block_bitmap + (size_t)g * block_bytes, buffer, block_bytes);
+        }
+        if (gd->bg_flags & EXT2_BG_INODE_UNINIT)
+        {
+            if (g == 0)
+            {
+                set_bitmap_bit(inode_bitmap, 0); // inode 1 保留，根目录是 inode 2
+            }
+        }
+        else
+        {
+            if (read_block(gd->bg_inode_bitmap, buffer) != 0)
+            {
+                free_groups();
+                return -1;
+            }
+            memcpy(inode_bitmap + (size_t)g * inode_bytes, buffer, inode_bytes);
+        }
+
+        itable_used_blocks[g] = (ipg - gd->bg_itable_unused + per_block - 1) / per_block;
+        itable_zero_from[g] = (gd->bg_flags & EXT2_BG_INODE_ZEROED) ? 0 : itable_blocks;
     }
-    // 注意这里的buffer是块的起始地址，如果要写入的是inode_no=2的话，根据块偏移找到对应的位置（同上）
-    memcpy(buffer + offset * sizeof(ext2_inode_t), inode, sizeof(ext2_inode_t));
-    return write_block(block_no, buffer);
+    return 0;
 }
 
-// 块分配和释放
-uint32_t allocate_block(void)
+uint32_t get_group_count(void)
 {
+    return group_count;
+}
 
-    int free_bit = find_free_bit(block_bitmap, BLOCK_SIZE); // 返回分配的块号（从 1 开始）。
-    if (free_bit == -1)
+// 打开 mmap 后端：整个镜像以 MAP_SHARED 映射，块读写都是内存拷贝
+static int map_disk_image(void)
+{
+    struct stat st;
+    if (fstat(disk_fd, &st) != 0 || st.st_size < BLOCK_SIZE)
     {
-        return 0; // 没有空闲块
+        return -1;
     }
-    /* 设置块位图block_bitmap中的对应位为已分配,分配后设置即
-    free_bit找到的位置是哪个块号是空闲的*/
-    set_bitmap_bit(block_bitmap, free_bit);
-
-    fs.superblock.s_free_blocks_count--;
 
-    // 写回位图
-    write_block(1, block_bitmap);
-
-    return free_bit + 1; // 第0位是空闲的，但是这是第一块，块号从1开始
+    void *map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, disk_fd, 0);
+    if (map == MAP_FAILED)
+    {
+        return -1;
+    }
+    disk_map = map;
+    disk_map_blocks = st.st_size / BLOCK_SIZE;
+    return 0;
 }
 
-void free_block(uint32_t block_no)
+static void unmap_disk_image(void)
 {
-    if (block_no == 0 || block_no > MAX_BLOCKS)
+    if (disk_map != NULL)
     {
-        return;
+        munmap(disk_map, (size_t)disk_map_blocks * BLOCK_SIZE);
+        disk_map = NULL;
+        disk_map_blocks = 0;
     }
+}
 
-    clear_bitmap_bit(block_bitmap, block_no - 1);
-    fs.superblock.s_free_blocks_count++;
-
-    // 写回位图
-    write_block(1, block_bitmap);
+// 把已修改的数据写回镜像：缓冲区后端写回脏块，mmap 后端调用 msync
+int sync_disk_image(void)
+{
+    if (disk_fd == -1)
+    {
+        return 0;
+    }
+    if (disk_backend == DISK_BACKEND_MMAP)
+    {
+        return msync(disk_map, (size_t)disk_map_blocks * BLOCK_SIZE, MS_SYNC);
+    }
+    return bcache_flush();
 }
 
-uint32_t allocate_inode(void)
+/*
+把到目前为止的修改全部持久化（sync 命令、fsync）。
+有日志时提交正在运行的事务即可，已提交的元数据以后按检查点写回原位置；
+没有日志时写回所有脏块再 fdatasync，ordered 模式下数据先落盘，元数据后写。
+*/
+int sync_filesystem(void)
 {
-    int free_bit = find_free_bit(inode_bitmap, BLOCK_SIZE); // bitmap中找到空闲的inode号
-    if (free_bit == -1)
+    if (disk_fd == -1)
     {
-        return 0; // 没有空闲inode
+        return 0;
+    }
+    durability_stats.syncs++;
+    int ret = sync_fs_metadata();
+    if (disk_backend == DISK_BACKEND_MMAP)
+    {
+        return sync_disk_image() == 0 ? ret : -1;
     }
 
-    set_bitmap_bit(inode_bitmap, free_bit); // 把空闲的inode号设置为占用
-    fs.superblock.s_free_inodes_count--;
+    if (journal_enabled)
+    {
+        if (commit_transaction() != 0)
+        {
+            ret = -1;
+        }
+        // 没有可提交的元数据时（例如只覆盖了已有的数据块），单独让数据落盘
+        if (data_pending)
+        {
+            if (fdatasync(disk_fd) != 0)
+            {
+                ret = -1;
+            }
+            data_pending = 0;
+        }
+        return ret;
+    }
+
+    if (fs.mount_opts.data_mode == DATA_ORDERED && data_pending)
+    {
+        if (fdatasync(disk_fd) != 0)
+        {
+            ret = -1;
+        }
+        durability_stats.data_flushes++;
+    }
+    if (bcache_flush() != 0 || fdatasync(disk_fd) != 0)
+    {
+        ret = -1;
+    }
+    data_pending = 0;
+    return ret;
+}
 
-    // 写回位图
-    write_block(2, inode_bitmap);
+void get_durability_stats(durability_stats_t *stats)
+{
+    *stats = durability_stats;
+}
 
-    return free_bit + 1; // inode号从1开始
+disk_backend_t get_disk_backend(void)
+{
+    return disk_backend;
 }
 
-void free_inode(uint32_t inode_no)
+/*
+重放日志，然后（缓冲区后端）启用日志事务。
+重放过的块可能包括超级块，需要重新读入并校验；mmap 后端的写入直接落在映射上，无法保证先写日志，只做重放。
+*/
+static int recover_journal(void)
 {
-    if (inode_no == 0 || inode_no > MAX_INODES)
+    journal_enabled = 0;
+    txn_pinned = 0;
+    data_pending = 0;
+    if (!(fs.superblock.s_feature_compat & EXT2_FEATURE_COMPAT_HAS_JOURNAL))
     {
-        return;
+        return 0;
+    }
+    uint32_t first = fs.superblock.s_journal_block;
+    uint32_t nblocks = fs.superblock.s_journal_blocks;
+    if (first == 0 || nblocks < JOURNAL_MIN_BLOCKS || first >= fs.superblock.s_blocks_count ||
+        nblocks > fs.superblock.s_blocks_count - first)
+    {
+        printf("Error: Invalid journal location\n");
+        return -1;
     }
 
-    clear_bitmap_bit(inode_bitmap, inode_no - 1);
-    fs.superblock.s_free_inodes_count++;
+    int replayed = journal_recover(disk_fd, first, nblocks, fs.superblock.s_blocks_count);
+    if (replayed < 0)
+    {
+        return -1;
+    }
+    if (replayed > 0)
+    {
+        bcache_invalidate();
+        if (load_superblock() != 0 || check_geometry() != 0)
+        {
+            return -1;
+        }
+    }
 
-    // 写回位图
-    write_block(2, inode_bitmap);
+    if (disk_backend == DISK_BACKEND_BUFFERED)
+    {
+        if (journal_load(disk_fd, first, nblocks) != 0 ||
+            (bcache_capacity < JOURNAL_MIN_CACHE && bcache_set_capacity(JOURNAL_MIN_CACHE) != 0))
+        {
+            return -1;
+        }
+        // 钉住的块最多占缓存的一半，一个事务（加上描述符和提交块）总能放进空的日志
+        txn_limit = bcache_capacity / 2 < (nblocks - 2) / 2 ? bcache_capacity / 2 : (nblocks - 2) / 2;
+        if (txn_limit == 0)
+        {
+            txn_limit = 1;
+        }
+        journal_enabled = 1;
+    }
+    return 0;
 }
 
 // 文件系统初始化
-int init_disk_image(const char *filename)
+int init_disk_image(const char *filename, disk_backend_t backend)
 {
+    // 如果已有镜像打开，先写回并关闭，避免旧镜像的脏块写进新镜像
+    close_disk_image();
+    memset(&bcache_stats, 0, sizeof(bcache_stats));
+    memset(&icache_stats, 0, sizeof(icache_stats));
+
     disk_fd = open(filename, O_RDWR);
     if (disk_fd == -1)
     {
         return -1;
     }
 
-    // 读取位图
-    if (read_block(1, block_bitmap) != 0)
+    disk_backend = backend;
+    block_alloc_cursor = 0;
+    inode_alloc_cursor = 0;
+    superblock_dirty = 0;
+    if (backend == DISK_BACKEND_MMAP && map_disk_image() != 0)
     {
         close(disk_fd);
         disk_fd = -1;
+        disk_backend = DISK_BACKEND_BUFFERED;
         return -1;
     }
 
-    if (read_block(2, inode_bitmap) != 0)
+    // 读取超级块、描述符表和各组的位图
+    if (load_superblock() != 0 || check_geometry() != 0 || recover_journal() != 0 || load_groups() != 0)
     {
+        journal_unload();
+        journal_enabled = 0;
+        free_groups();
+        memset(&fs.superblock, 0, sizeof(fs.superblock)); // 不留下无法挂载的镜像的参数
+        bcache_invalidate();
+        unmap_disk_image();
         close(disk_fd);
         disk_fd = -1;
         return -1;
@@ -268,7 +2694,26 @@ void close_disk_image(void)
 {
     if (disk_fd != -1)
     {
+        stop_itable_init();
+        sync_fs_metadata();
+        commit_transaction();
+        sync_disk_image();
+        if (journal_enabled)
+        {
+            // 已提交的块都已写回原位置：落盘后把日志标记为空，下次挂载不需要重放
+            if (fdatasync(disk_fd) == 0)
+            {
+                journal_reset();
+            }
+            journal_enabled = 0;
+        }
+        journal_unload();
+        icache_invalidate();
+        bcache_invalidate();
+        unmap_disk_image();
+        free_groups();
         close(disk_fd);
         disk_fd = -1;
+        disk_backend = DISK_BACKEND_BUFFERED;
     }
-}
\ No newline at end of file
+}
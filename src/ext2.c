@@ -3,92 +3,393 @@
 #include "../include/user.h"
 #include "../include/commands.h"
 #include "../include/inode.h"
+#include "../include/directory.h"
+#include "../include/io_engine.h"
+#include "../include/journal.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <limits.h>
 
 // 全局变量
 ext2_fs_t fs;
 
+// 默认挂载选项
+void default_mount_options(mount_options_t *opts) {
+    memset(opts, 0, sizeof(mount_options_t));
+    opts->cache_blocks = BCACHE_DEFAULT_CAPACITY;
+    strcpy(opts->io_engine, "auto");
+    opts->io_depth = IO_ENGINE_DEFAULT_DEPTH;
+    opts->atime_mode = ATIME_STRICT;
+    opts->init_itable = 1;
+    opts->commit_interval = JOURNAL_DEFAULT_COMMIT_INTERVAL;
+    opts->data_mode = DATA_ORDERED;
+}
+
+// 解析 "opt1,opt2,..." 形式的挂载选项，遇到未知选项返回-1
+int parse_mount_options(const char *str, mount_options_t *opts) {
+    char buf[256];
+    strncpy(buf, str, sizeof(buf) - 1);
+    buf[sizeof(buf) - 1] = '\0';
+
+    for (char *opt = strtok(buf, ","); opt != NULL; opt = strtok(NULL, ",")) {
+        if (strncmp(opt, "cache=", 6) == 0) {
+            char *end;
+            long blocks = strtol(opt + 6, &end, 10);
+            if (*end != '\0' || blocks < BCACHE_MIN_CAPACITY) {
+                printf("Error: Invalid cache size: %s\n", opt + 6);
+                return -1;
+            }
+            opts->cache_blocks = (uint32_t)blocks;
+        } else if (strcmp(opt, "mmap") == 0) {
+            opts->use_mmap = 1;
+        } else if (strcmp(opt, "extents") == 0) {
+            opts->use_extents = 1;
+        } else if (strcmp(opt, "init_itable") == 0) {
+            opts->init_itable = 1;
+        } else if (strcmp(opt, "noinit_itable") == 0) {
+            opts->init_itable = 0;
+        } else if (strcmp(opt, "atime") == 0) {
+            opts->atime_mode = ATIME_STRICT;
+        } else if (strcmp(opt, "relatime") == 0) {
+            opts->atime_mode = ATIME_RELATIME;
+        } else if (strcmp(opt, "noatime") == 0) {
+            opts->atime_mode = ATIME_NOATIME;
+        } else if (strncmp(opt, "io=", 3) == 0) {
+            const char *engine = opt + 3;
+            if (strcmp(engine, "auto") != 0 && strcmp(engine, "uring") != 0 &&
+                strcmp(engine, "threads") != 0 && strcmp(engine, "sync") != 0) {
+                printf("Error: Unknown I/O engine: %s\n", engine);
+                return -1;
+            }
+            strncpy(opts->io_engine, engine, sizeof(opts->io_engine) - 1);
+            opts->io_engine[sizeof(opts->io_engine) - 1] = '\0';
+        } else if (strncmp(opt, "commit=", 7) == 0) {
+            char *end;
+            long seconds = strtol(opt + 7, &end, 10);
+            if (*end != '\0' || seconds < 0 || seconds > 86400) {
+                printf("Error: Invalid commit interval: %s\n", opt + 7);
+                return -1;
+            }
+            opts->commit_interval = (uint32_t)seconds;
+        } else if (strcmp(opt, "data=ordered") == 0) {
+            opts->data_mode = DATA_ORDERED;
+        } else if (strcmp(opt, "data=writeback") == 0) {
+            opts->data_mode = DATA_WRITEBACK;
+        } else if (strncmp(opt, "qd=", 3) == 0) {
+            char *end;
+            long depth = strtol(opt + 3, &end, 10);
+            if (*end != '\0' || depth < 1 || depth > IO_ENGINE_MAX_DEPTH) {
+                printf("Error: Invalid queue depth: %s\n", opt + 3);
+                return -1;
+            }
+            opts->io_depth = (uint32_t)depth;
+        } else {
+            printf("Error: Unknown mount option: %s\n", opt);
+            return -1;
+        }
+    }
+    return 0;
+}
+
 // 文件系统初始化
-int ext2_init(const char *disk_image) {
+int ext2_init(const char *disk_image, const mount_options_t *opts) {
+    // 先卸载已挂载的镜像，让它的脏元数据在清空 fs 之前写回
+    close_disk_image();
+    dcache_invalidate();
+    invalidate_permission_cache(0);
+
     // 初始化文件系统状态
     memset(&fs, 0, sizeof(ext2_fs_t));
     fs.current_user = -1;
     fs.next_fd = 3; // 0, 1, 2 是标准输入输出
+    if (opts != NULL) {
+        fs.mount_opts = *opts;
+    } else {
+        default_mount_options(&fs.mount_opts);
+    }
 
     // 初始化用户系统（会自动从磁盘加载）
     init_users();
 
     // 挂载磁盘镜像
     if (disk_image != NULL) {
-        if (init_disk_image(disk_image) != 0) {
-            printf("Error: Failed to open disk image\n");
+        if (bcache_set_capacity(fs.mount_opts.cache_blocks) != 0) {
+            printf("Error: Failed to set block cache capacity\n");
             return -1;
         }
-        // 读取超级块
-        if (read_block(0, &fs.superblock) != 0) {
-            printf("Error: Failed to read superblock\n");
-            close_disk_image();
+        if (io_engine_init(fs.mount_opts.io_engine, fs.mount_opts.io_depth) != 0) {
+            printf("Error: Failed to initialize I/O engine: %s\n", fs.mount_opts.io_engine);
             return -1;
         }
-        // 校验魔数
-        if (fs.superblock.s_magic != 0xEF53) {
-            printf("Error: Invalid file system magic number\n");
-            close_disk_image();
+        disk_backend_t backend = fs.mount_opts.use_mmap ? DISK_BACKEND_MMAP : DISK_BACKEND_BUFFERED;
+        if (init_disk_image(disk_image, backend) != 0) {
+            printf("Error: Failed to open disk image\n");
             return -1;
         }
+        // 超级块、组描述符和位图已由 init_disk_image 读入并校验过魔数和几何参数，空闲计数直接取自超级块
+        fs.superblock.s_mtime = time(NULL);
+        fs.superblock.s_mnt_count++;
+        mark_superblock_dirty();
         // 加载用户信息
         load_users_from_disk();
+        if (fs.mount_opts.init_itable && start_itable_init() != 0) {
+            printf("Warning: Failed to start inode table initialization\n");
+        }
     }
 
     return 0;
 }
 
+// 默认格式化选项
+void default_format_options(format_options_t *opts) {
+    memset(opts, 0, sizeof(format_options_t));
+    opts->blocks_count = EXT2_DEFAULT_BLOCKS_COUNT;
+    opts->inode_ratio = EXT2_DEFAULT_INODE_RATIO;
+    opts->blocks_per_group = 0;
+    opts->journal_blocks = JOURNAL_BLOCKS_AUTO;
+}
+
+// 解析带 K/M/G 后缀的字节数
+static int parse_size(const char *str, uint64_t *bytes) {
+    char *end;
+    unsigned long long value = strtoull(str, &end, 10);
+    uint64_t unit = 1;
+    if (*end == 'K' || *end == 'k') {
+        unit = 1ULL << 10;
+        end++;
+    } else if (*end == 'M' || *end == 'm') {
+        unit = 1ULL << 20;
+        end++;
+    } else if (*end == 'G' || *end == 'g') {
+        unit = 1ULL << 30;
+        end++;
+    }
+    if (end == str || *end != '\0' || value > UINT64_MAX / unit) {
+        return -1;
+    }
+    *bytes = value * unit;
+    return 0;
+}
+
+// 解析 "opt1,opt2,..." 形式的格式化选项，遇到未知选项返回-1
+int parse_format_options(const char *str, format_options_t *opts) {
+    char buf[256];
+    strncpy(buf, str, sizeof(buf) - 1);
+    buf[sizeof(buf) - 1] = '\0';
+
+    for (char *opt = strtok(buf, ","); opt != NULL; opt = strtok(NULL, ",")) {
+        if (strncmp(opt, "size=", 5) == 0) {
+            uint64_t bytes;
+            // 块位图按 int 位号寻址
+            if (parse_size(opt + 5, &bytes) != 0 || bytes / BLOCK_SIZE < 2 || bytes / BLOCK_SIZE - 1 > INT_MAX) {
+                printf("Error: Invalid image size: %s\n", opt + 5);
+                return -1;
+            }
+            opts->blocks_count = (uint32_t)(bytes / BLOCK_SIZE);
+        } else if (strncmp(opt, "bs=", 3) == 0) {
+            // 块大小决定了所有块缓冲区的大小，只能在编译时选择
+            uint64_t bytes;
+            if (parse_size(opt + 3, &bytes) != 0 || bytes != BLOCK_SIZE) {
+                printf("Error: Block size %s is not supported by this build (BLOCK_SIZE=%d, rebuild with make BLOCK_SIZE=N)\n",
+                       opt + 3, BLOCK_SIZE);
+                return -1;
+            }
+        } else if (strncmp(opt, "inode_ratio=", 12) == 0) {
+            uint64_t bytes;
+            if (parse_size(opt + 12, &bytes) != 0 || bytes < 1024 || bytes > (1ULL << 30)) {
+                printf("Error: Invalid inode ratio: %s\n", opt + 12);
+                return -1;
+            }
+            opts->inode_ratio = (uint32_t)bytes;
+        } else if (strncmp(opt, "blocks_per_group=", 17) == 0) {
+            char *end;
+            long blocks = strtol(opt + 17, &end, 10);
+            if (*end != '\0' || blocks < EXT2_MIN_BLOCKS_PER_GROUP || blocks > EXT2_MAX_BLOCKS_PER_GROUP || blocks % 8 != 0) {
+                printf("Error: Invalid blocks per group: %s (multiple of 8, %d..%d)\n",
+                       opt + 17, EXT2_MIN_BLOCKS_PER_GROUP, EXT2_MAX_BLOCKS_PER_GROUP);
+                return -1;
+            }
+            opts->blocks_per_group = (uint32_t)blocks;
+        } else if (strncmp(opt, "journal=", 8) == 0) {
+            uint64_t bytes;
+            if (parse_size(opt + 8, &bytes) != 0 || bytes / BLOCK_SIZE < JOURNAL_MIN_BLOCKS ||
+                bytes / BLOCK_SIZE > EXT2_MAX_BLOCKS_PER_GROUP) {
+                printf("Error: Invalid journal size: %s (%d..%d blocks)\n", opt + 8, JOURNAL_MIN_BLOCKS,
+                       EXT2_MAX_BLOCKS_PER_GROUP);
+                return -1;
+            }
+            opts->journal_blocks = (uint32_t)(bytes / BLOCK_SIZE);
+        } else if (strcmp(opt, "nojournal") == 0) {
+            opts->journal_blocks = 0;
+        } else if (strcmp(opt, "prealloc") == 0) {
+            opts->prealloc = 1;
+        } else {
+            printf("Error: Unknown format option: %s\n", opt);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// 格式化时确定的块组布局
+typedef struct {
+    uint32_t blocks_count;
+    uint32_t blocks_per_group;
+    uint32_t inodes_per_group;
+    uint32_t group_count;
+    uint32_t gdt_blocks;          // 组描述符表的块数
+    uint32_t itable_blocks;       // 每组inode表的块数
+    uint32_t journal_blocks;      // 日志区块数，0 表示没有日志
+} fs_geometry_t;
+
+// 第 g 组包含的块数（最后一组可能不满）
+static uint32_t group_blocks(const fs_geometry_t *geo, uint32_t g) {
+    uint32_t remaining = geo->blocks_count - 1 - g * geo->blocks_per_group;
+    return remaining < geo->blocks_per_group ? remaining : geo->blocks_per_group;
+}
+
+// 第 g 组开头被元数据占用的块数：位图两块加inode表，第 0 组还有描述符表和用户表
+static uint32_t group_overhead(const fs_geometry_t *geo, uint32_t g) {
+    uint32_t n = 2 + geo->itable_blocks;
+    if (g == 0) {
+        n += geo->gdt_blocks + USERS_BLOCKS;
+    }
+    return n;
+}
+
+/*
+按格式化选项划分块组：inode 总数按每 inode_ratio 字节一个计算，平均分到各组（按8对齐）。
+最后一组放不下自己的元数据和至少一个数据块时整组去掉，镜像相应缩小。
+*/
+static int compute_geometry(const format_options_t *opts, fs_geometry_t *geo) {
+    uint32_t per_block = BLOCK_SIZE / sizeof(ext2_inode_t);
+    memset(geo, 0, sizeof(*geo));
+    geo->blocks_count = opts->blocks_count;
+    geo->blocks_per_group = opts->blocks_per_group != 0 ? opts->blocks_per_group : EXT2_MAX_BLOCKS_PER_GROUP;
+    if (geo->blocks_count < 2) {
+        printf("Error: Disk image is too small\n");
+        return -1;
+    }
+
+    while (1) {
+        geo->group_count = (geo->blocks_count - 1 + geo->blocks_per_group - 1) / geo->blocks_per_group;
+        uint64_t inodes = (uint64_t)geo->blocks_count * BLOCK_SIZE / opts->inode_ratio;
+        if (inodes < 16) {
+            inodes = 16;
+        }
+        uint64_t ipg = (inodes + geo->group_count - 1) / geo->group_count;
+        ipg = (ipg + 7) & ~7ULL;
+        if (ipg > EXT2_MAX_INODES_PER_GROUP) {
+            ipg = EXT2_MAX_INODES_PER_GROUP;
+        }
+        geo->inodes_per_group = (uint32_t)ipg;
+        geo->itable_blocks = (geo->inodes_per_group + per_block - 1) / per_block;
+        geo->gdt_blocks = (geo->group_count * sizeof(ext2_group_desc_t) + BLOCK_SIZE - 1) / BLOCK_SIZE;
+
+        uint32_t last = geo->group_count - 1;
+        if (last > 0 && group_blocks(geo, last) <= group_overhead(geo, last)) {
+            geo->blocks_count = 1 + last * geo->blocks_per_group;
+            continue;
+        }
+        break;
+    }
+
+    // 第 0 组的元数据最多，它放得下其他整组也放得下
+    if (group_blocks(geo, 0) <= group_overhead(geo, 0)) {
+        printf("Error: Disk image is too small for its metadata (blocks_per_group or inode_ratio too small)\n");
+        return -1;
+    }
+    if ((uint64_t)geo->group_count * geo->inodes_per_group > INT_MAX) {
+        printf("Error: Too many inodes\n");
+        return -1;
+    }
+
+    // 日志区放在中间一组的数据区里，必须整段放得下（第 0 组还要留出根目录的块）
+    uint32_t mid = geo->group_count / 2;
+    uint32_t room = group_blocks(geo, mid) - group_overhead(geo, mid) - (mid == 0 ? 1 : 0);
+    if (opts->journal_blocks == JOURNAL_BLOCKS_AUTO) {
+        uint32_t blocks = geo->blocks_count / JOURNAL_SIZE_RATIO;
+        if (blocks < JOURNAL_MIN_BLOCKS) {
+            blocks = JOURNAL_MIN_BLOCKS;
+        }
+        if (blocks > JOURNAL_DEFAULT_MAX_BLOCKS) {
+            blocks = JOURNAL_DEFAULT_MAX_BLOCKS;
+        }
+        if (blocks > room / 2) {
+            blocks = room / 2;
+        }
+        geo->journal_blocks = blocks >= JOURNAL_MIN_BLOCKS ? blocks : 0; // 镜像太小时不建日志
+    } else if (opts->journal_blocks > room) {
+        printf("Error: Journal must fit in one block group (at most %u blocks)\n", room);
+        return -1;
+    } else {
+        geo->journal_blocks = opts->journal_blocks;
+    }
+    return 0;
+}
+
 // 文件系统格式化
-int ext2_format(const char *disk_image) {
+int ext2_format(const char *disk_image, const format_options_t *opts) {
     printf("Formatting EXT2 file system: %s\n", disk_image);
-    
-    // 创建磁盘镜像文件
-    FILE *fp = fopen(disk_image, "wb");
-    if (fp == NULL) {
-        printf("Error: Cannot create disk image file\n");
+    dcache_invalidate();
+    invalidate_permission_cache(0);
+
+    format_options_t defaults;
+    if (opts == NULL) {
+        default_format_options(&defaults);
+        opts = &defaults;
+    }
+    fs_geometry_t geo;
+    if (compute_geometry(opts, &geo) != 0) {
         return -1;
     }
+    uint32_t inodes_count = geo.group_count * geo.inodes_per_group;
+    printf("Block size: %d, blocks: %u, inodes: %u, block groups: %u, journal: %u blocks\n",
+           BLOCK_SIZE, geo.blocks_count, inodes_count, geo.group_count, geo.journal_blocks);
     
-    // 写入空块
-    uint8_t zero_block[BLOCK_SIZE] = {0};
-    for (int i = 0; i < MAX_BLOCKS; i++) {
-        if (fwrite(zero_block, 1, BLOCK_SIZE, fp) != BLOCK_SIZE) {
-            printf("Error: Failed to write block %d\n", i);
-            fclose(fp);
-            /*uint8_t zero_block[BLOCK_SIZE] = {0};
-            fwrite(zero_block, 1, BLOCK_SIZE, fp);
-            解释一下，fwrite使用fp作为文件指针，向文件中写入：起始地址为zero_block，写入长度为BLOCK_SIZE字节的内容。（1表示每个数据项为一字节）
-            */
-            return -1;
+    // 组描述符：第 g 组从块 1 + g * blocks_per_group 开始，依次是块位图、inode位图、inode表
+    ext2_group_desc_t *gdt = calloc(geo.gdt_blocks, BLOCK_SIZE);
+    if (gdt == NULL) {
+        printf("Error: Out of memory\n");
+        return -1;
+    }
+    uint32_t total_free = 0;
+    for (uint32_t g = 0; g < geo.group_count; g++) {
+        uint32_t meta = 1 + g * geo.blocks_per_group;
+        if (g == 0) {
+            meta += geo.gdt_blocks + USERS_BLOCKS;
         }
+        gdt[g].bg_block_bitmap = meta;
+        gdt[g].bg_inode_bitmap = meta + 1;
+        gdt[g].bg_inode_table = meta + 2;
+        gdt[g].bg_free_blocks_count = group_blocks(&geo, g) - group_overhead(&geo, g);
+        gdt[g].bg_free_inodes_count = geo.inodes_per_group;
+        // 位图和inode表都不写，挂载时推算位图，inode表在第一次使用时清零
+        gdt[g].bg_flags = EXT2_BG_BLOCK_UNINIT | EXT2_BG_INODE_UNINIT;
+        gdt[g].bg_itable_unused = geo.inodes_per_group;
+        total_free += gdt[g].bg_free_blocks_count;
     }
-    
-    fclose(fp);
+    gdt[0].bg_free_inodes_count--; // inode 1 保留
     
     // 初始化超级块
     ext2_superblock_t superblock;
     memset(&superblock, 0, sizeof(superblock));
     
     // 设置超级块字段
-    superblock.s_inodes_count = MAX_INODES;
-    superblock.s_blocks_count = MAX_BLOCKS;
-    superblock.s_r_blocks_count = 10; // 保留块数
-    superblock.s_free_blocks_count = MAX_BLOCKS - 10;
-    superblock.s_free_inodes_count = MAX_INODES - 1;
+    superblock.s_inodes_count = inodes_count;
+    superblock.s_blocks_count = geo.blocks_count;
+    superblock.s_r_blocks_count = 0; // 不为root保留块
+    // 块 0 和各组的元数据块不可分配，inode 1 保留
+    superblock.s_free_blocks_count = total_free;
+    superblock.s_free_inodes_count = inodes_count - 1;
     superblock.s_first_data_block = 1;
-    superblock.s_log_block_size = 0; // 1KB块
-    superblock.s_log_frag_size = 0;
-    superblock.s_blocks_per_group = MAX_BLOCKS;
-    superblock.s_frags_per_group = MAX_BLOCKS;
-    superblock.s_inodes_per_group = MAX_INODES;
+    superblock.s_log_block_size = __builtin_ctz(BLOCK_SIZE) - 10; // 块大小 = 1024 << s_log_block_size
+    superblock.s_log_frag_size = superblock.s_log_block_size;
+    superblock.s_blocks_per_group = geo.blocks_per_group;
+    superblock.s_frags_per_group = geo.blocks_per_group;
+    superblock.s_inodes_per_group = geo.inodes_per_group;
     superblock.s_mtime = time(NULL);
     superblock.s_wtime = time(NULL);
     superblock.s_mnt_count = 0;
@@ -100,7 +401,7 @@ int ext2_format(const char *disk_image) {
     superblock.s_lastcheck = time(NULL);
     superblock.s_checkinterval = 1800; // 30分钟
     superblock.s_creator_os = 0; // Linux
-    superblock.s_rev_level = 0;
+    superblock.s_rev_level = EXT2_DYNAMIC_REV;
     superblock.s_def_resuid = 0;
     superblock.s_def_resgid = 0;
     superblock.s_first_ino = 11;
@@ -108,7 +409,8 @@ int ext2_format(const char *disk_image) {
     superblock.s_block_group_nr = 0;
     superblock.s_feature_compat = 0;
     superblock.s_feature_incompat = 0;
-    superblock.s_feature_ro_compat = 0;
+    superblock.s_feature_ro_compat = EXT2_FEATURE_RO_COMPAT_UNINIT_BG;
+    superblock.s_users_block = 1 + geo.gdt_blocks; // 紧接在描述符表之后
     
     // 生成UUID
     for (int i = 0; i < 16; i++) {
@@ -118,58 +420,42 @@ int ext2_format(const char *disk_image) {
     strcpy(superblock.s_volume_name, "EXT2FS");
     strcpy(superblock.s_last_mounted, "/");
     
-    // 写入超级块
-    FILE *fp2 = fopen(disk_image, "r+b");
-    if (fp2 == NULL) {
-        printf("Error: Cannot write superblock\n");
-        return -1;
-    }
-    
-    if (fwrite(&superblock, 1, sizeof(superblock), fp2) != sizeof(superblock)) {
-        printf("Error: Failed to write superblock\n");
-        fclose(fp2);
+    /*
+    只写超级块和描述符表，一次批量提交。各组标记为未初始化，位图和inode表都留在稀疏文件的空洞里，
+    格式化的写入量与镜像大小无关。
+    */
+    uint8_t *sb_block = calloc(1, BLOCK_SIZE);
+    if (sb_block == NULL) {
+        printf("Error: Out of memory\n");
+        free(gdt);
         return -1;
     }
-    
-    fclose(fp2);
-    
-    // 初始化位图
-    memset(block_bitmap, 0, BLOCK_SIZE);
-    memset(inode_bitmap, 0, BLOCK_SIZE);
-    
-    // 标记已使用的块
-    for (int i = 0; i < 10; i++) {
-        set_bitmap_bit(block_bitmap, i);
-    }
-    
-    // 标记已使用的inode
-    set_bitmap_bit(inode_bitmap, 0); // inode 0 不使用
-    
-    // 写入位图
-    FILE *fp3 = fopen(disk_image, "r+b");
-    if (fp3 == NULL) {
-        printf("Error: Cannot write bitmaps\n");
+    memcpy(sb_block, &superblock, sizeof(superblock));
+    struct iovec iov[2] = {
+        { sb_block, BLOCK_SIZE },
+        { gdt, (size_t)geo.gdt_blocks * BLOCK_SIZE },
+    };
+    block_request_t reqs[2] = {
+        { 1, 0, &iov[0], 1 },
+        { 1, 1, &iov[1], 1 },
+    };
+
+    int result = create_disk_image(disk_image, geo.blocks_count, opts->prealloc, reqs, 2);
+    free(sb_block);
+    free(gdt);
+    if (result != 0) {
+        printf("Error: Cannot create disk image file\n");
         return -1;
     }
     
-    // 写入块位图
-    fseek(fp3, BLOCK_SIZE, SEEK_SET);
-    fwrite(block_bitmap, 1, BLOCK_SIZE, fp3);
-    
-    // 写入inode位图
-    fseek(fp3, 2 * BLOCK_SIZE, SEEK_SET);
-    fwrite(inode_bitmap, 1, BLOCK_SIZE, fp3);
-    
-    fclose(fp3);
-    
     // 创建根目录
-    if (init_disk_image(disk_image) != 0) {
+    if (init_disk_image(disk_image, DISK_BACKEND_BUFFERED) != 0) {
         printf("Error: Failed to initialize disk image\n");
         return -1;
     }
     
     // 创建根目录inode
-    uint32_t root_inode = create_inode(EXT2_S_IFDIR | 0755, 0, 0);
+    uint32_t root_inode = create_inode(0, EXT2_S_IFDIR | 0755, 0, 0);
     printf("DEBUG: root_inode = %u\n", root_inode);
     if (root_inode == 0) {
         printf("Error: Failed to create root directory inode\n");
@@ -190,22 +476,10 @@ int ext2_format(const char *disk_image) {
     set_inode_block(root_inode, 0, root_block);
     
     // 创建根目录的 . 和 .. 目录项
-    uint8_t root_data[BLOCK_SIZE] = {0};
-    ext2_dir_entry_t *entries = (ext2_dir_entry_t*)root_data;
-    
-    // . 目录项
-    entries[0].inode = root_inode;
-    entries[0].rec_len = sizeof(ext2_dir_entry_t);
-    entries[0].name_len = 1;
-    entries[0].file_type = 2; // 目录
-    strcpy(entries[0].name, ".");
-    
-    // .. 目录项
-    entries[1].inode = root_inode;
-    entries[1].rec_len = sizeof(ext2_dir_entry_t);
-    entries[1].name_len = 2;
-    entries[1].file_type = 2; // 目录
-    strcpy(entries[1].name, "..");
+    uint8_t root_data[BLOCK_SIZE];
+    dir_block_init(root_data);
+    dir_block_insert(root_data, ".", root_inode, 2);  // 目录
+    dir_block_insert(root_data, "..", root_inode, 2);
     
     // 写入根目录数据
     write_block(root_block, root_data);
@@ -213,6 +487,29 @@ int ext2_format(const char *disk_image) {
     // 创建根目录后，初始化默认用户并保存到磁盘
     init_users();
     save_users_to_disk();
+
+    // 日志区：中间一组的数据区开头的一段连续块，写入空的日志超级块后再在超级块中启用
+    if (geo.journal_blocks > 0) {
+        uint32_t mid = geo.group_count / 2;
+        uint32_t goal = 1 + mid * geo.blocks_per_group + group_overhead(&geo, mid);
+        uint32_t count;
+        uint32_t start = allocate_blocks(goal, geo.journal_blocks, &count);
+        if (start == 0 || count != geo.journal_blocks) {
+            if (start != 0) {
+                free_blocks(start, count);
+            }
+            printf("Error: Failed to allocate journal\n");
+            close_disk_image();
+            return -1;
+        }
+        uint8_t jsb[BLOCK_SIZE];
+        journal_format_superblock(jsb, geo.journal_blocks);
+        write_block(start, jsb);
+        fs.superblock.s_journal_block = start;
+        fs.superblock.s_journal_blocks = geo.journal_blocks;
+        fs.superblock.s_feature_compat |= EXT2_FEATURE_COMPAT_HAS_JOURNAL;
+        mark_superblock_dirty();
+    }
     
     close_disk_image();
     
@@ -223,5 +520,6 @@ int ext2_format(const char *disk_image) {
 // 文件系统清理
 void ext2_cleanup(void) {
     close_disk_image();
+    io_engine_shutdown();
     printf("EXT2 file system cleaned up\n");
 } 
\ No newline at end of file
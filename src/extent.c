@@ -0,0 +1,650 @@
+#include "../include/extent.h"
+#include "../include/disk.h"
+#include "../include/ext2.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static ext2_extent_header_t *root_header(ext2_inode_t *inode)
+{
+    return (ext2_extent_header_t *)inode->i_block;
+}
+
+static const ext2_extent_header_t *root_header_const(const ext2_inode_t *inode)
+{
+    return (const ext2_extent_header_t *)inode->i_block;
+}
+
+void extent_init(ext2_inode_t *inode)
+{
+    memset(inode->i_block, 0, sizeof(inode->i_block));
+    ext2_extent_header_t *eh = root_header(inode);
+    eh->eh_magic = EXT2_EXT_MAGIC;
+    eh->eh_max = EXT2_EXT_ROOT_ENTRIES;
+    eh->eh_depth = 0;
+}
+
+// 在按 ee_block 排序的数组中找最后一个起始块号 <= block_index 的extent，没有返回-1
+static int search_extent(const ext2_extent_t *ext, int n, uint32_t block_index)
+{
+    int lo = 0, hi = n - 1, found = -1;
+    while (lo <= hi)
+    {
+        int mid = (lo + hi) / 2;
+        if (ext[mid].ee_block <= block_index)
+        {
+            found = mid;
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid - 1;
+        }
+    }
+    return found;
+}
+
+static int search_index(const ext2_extent_idx_t *idx, int n, uint32_t block_index)
+{
+    int lo = 0, hi = n - 1, found = -1;
+    while (lo <= hi)
+    {
+        int mid = (lo + hi) / 2;
+        if (idx[mid].ei_block <= block_index)
+        {
+            found = mid;
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid - 1;
+        }
+    }
+    return found;
+}
+
+// 读取深度为 depth 的节点块（缓存中的只读指针），校验魔数和深度
+static const ext2_extent_header_t *node_header(uint32_t block_no, uint16_t depth)
+{
+    const ext2_extent_header_t *eh = get_block_ptr(block_no);
+    if (eh == NULL || eh->eh_magic != EXT2_EXT_MAGIC || eh->eh_depth != depth ||
+        eh->eh_entries > EXT2_EXT_LEAF_ENTRIES)
+    {
+        return NULL;
+    }
+    return eh;
+}
+
+int extent_lookup(const ext2_inode_t *inode, uint32_t block_index, uint32_t *pblk, uint32_t *len)
+{
+    const ext2_extent_header_t *eh = root_header_const(inode);
+    if (eh->eh_magic != EXT2_EXT_MAGIC || eh->eh_depth > EXT2_EXT_MAX_DEPTH || block_index >= EXT2_EXT_MAX_BLOCKS)
+    {
+        return -1;
+    }
+
+    // 空洞最多延伸到下一个extent（或右边下一个子树）的起点，越往下界限越紧
+    uint32_t hole_end = EXT2_EXT_MAX_BLOCKS;
+    while (eh->eh_depth > 0)
+    {
+        const ext2_extent_idx_t *idx = (const ext2_extent_idx_t *)(eh + 1);
+        int k = search_index(idx, eh->eh_entries, block_index);
+        if (k == -1)
+        {
+            *pblk = 0;
+            *len = (eh->eh_entries > 0 ? idx[0].ei_block : hole_end) - block_index;
+            return 0;
+        }
+        if (k + 1 < eh->eh_entries)
+        {
+            hole_end = idx[k + 1].ei_block;
+        }
+        eh = node_header(idx[k].ei_leaf, eh->eh_depth - 1);
+        if (eh == NULL)
+        {
+            return -1;
+        }
+    }
+
+    const ext2_extent_t *ext = (const ext2_extent_t *)(eh + 1);
+    int n = eh->eh_entries;
+    int k = search_extent(ext, n, block_index);
+    if (k != -1 && block_index - ext[k].ee_block < ext[k].ee_len)
+    {
+        uint32_t skip = block_index - ext[k].ee_block;
+        *pblk = ext[k].ee_start + skip;
+        *len = ext[k].ee_len - skip;
+        return 0;
+    }
+
+    if (k + 1 < n)
+    {
+        hole_end = ext[k + 1].ee_block;
+    }
+    *pblk = 0;
+    *len = hole_end - block_index;
+    return 0;
+}
+
+/*
+修改extent树时从根到叶子的一条路径。
+第 0 层是根节点，放在 i_block 的本地副本里，操作全部成功后才复制回inode；
+其他各层读进各自的缓冲区，修改后立即写回（先写新分配的块，再写引用它的节点）。
+索引项和extent都是 12 字节，内部节点和叶子块的容量相同。
+*/
+typedef struct {
+    uint8_t root[sizeof(((ext2_inode_t *)0)->i_block)];
+    uint8_t *node[EXT2_EXT_MAX_DEPTH + 1];     // 第 l 层节点的内容，node[0] 指向 root
+    uint32_t block[EXT2_EXT_MAX_DEPTH + 1];    // 第 l 层节点所在的块（根为0）
+    int index[EXT2_EXT_MAX_DEPTH + 1];         // 内部节点：走向下一层的索引项
+    uint8_t *buffer[EXT2_EXT_MAX_DEPTH + 1];   // 第 1 层以下的缓冲区，用到时才分配
+    int depth;                                 // 根节点的深度，叶子在第 depth 层
+} ext_path_t;
+
+static ext2_extent_header_t *node_hdr(uint8_t *node)
+{
+    return (ext2_extent_header_t *)node;
+}
+
+// 节点中第一个表项的逻辑块号（extent和索引项的第一个字段都是逻辑块号）
+static uint32_t node_first_key(uint8_t *node)
+{
+    return *(const uint32_t *)(node_hdr(node) + 1);
+}
+
+static int path_open(ext_path_t *path, const ext2_inode_t *inode)
+{
+    memset(path, 0, sizeof(*path));
+    memcpy(path->root, inode->i_block, sizeof(path->root));
+    ext2_extent_header_t *eh = node_hdr(path->root);
+    if (eh->eh_magic != EXT2_EXT_MAGIC || eh->eh_depth > EXT2_EXT_MAX_DEPTH ||
+        eh->eh_entries > EXT2_EXT_ROOT_ENTRIES)
+    {
+        return -1;
+    }
+    path->node[0] = path->root;
+    path->depth = eh->eh_depth;
+    return 0;
+}
+
+static void path_close(ext_path_t *path)
+{
+    for (int l = 0; l <= EXT2_EXT_MAX_DEPTH; l++)
+    {
+        free(path->buffer[l]);
+    }
+}
+
+// 从根往下找 block_index 所在（或应该插入）的叶子，block_index 在第一个子树之前时走最左边
+static int path_find(ext_path_t *path, uint32_t block_index)
+{
+    for (int l = 0; l < path->depth; l++)
+    {
+        ext2_extent_header_t *eh = node_hdr(path->node[l]);
+        ext2_extent_idx_t *idx = (ext2_extent_idx_t *)(eh + 1);
+        if (eh->eh_entries == 0)
+        {
+            return -1;
+        }
+        int k = search_index(idx, eh->eh_entries, block_index);
+        path->index[l] = k == -1 ? 0 : k;
+
+        if (path->buffer[l + 1] == NULL && (path->buffer[l + 1] = malloc(BLOCK_SIZE)) == NULL)
+        {
+            return -1;
+        }
+        uint32_t child = idx[path->index[l]].ei_leaf;
+        ext2_extent_header_t *ch = (ext2_extent_header_t *)path->buffer[l + 1];
+        if (read_block(child, ch) != 0 || ch->eh_magic != EXT2_EXT_MAGIC ||
+            ch->eh_depth != path->depth - l - 1 || ch->eh_max != EXT2_EXT_LEAF_ENTRIES ||
+            ch->eh_entries > EXT2_EXT_LEAF_ENTRIES)
+        {
+            printf("Error: Corrupted extent tree node %u\n", child);
+            return -1;
+        }
+        path->block[l + 1] = child;
+        path->node[l + 1] = path->buffer[l + 1];
+    }
+    return 0;
+}
+
+static int path_write(ext_path_t *path, int level)
+{
+    return level == 0 ? 0 : write_block(path->block[level], path->node[level]);
+}
+
+// level 层节点的第一个表项变了：沿路径向上更新父节点中的索引键，直到它不再是父节点的第一项
+static int path_fix_keys(ext_path_t *path, int level)
+{
+    uint32_t key = node_first_key(path->node[level]);
+    for (int l = level; l > 0; l--)
+    {
+        ext2_extent_idx_t *idx = (ext2_extent_idx_t *)(node_hdr(path->node[l - 1]) + 1);
+        if (idx[path->index[l - 1]].ei_block == key)
+        {
+            break;
+        }
+        idx[path->index[l - 1]].ei_block = key;
+        if (path_write(path, l - 1) != 0)
+        {
+            return -1;
+        }
+        if (path->index[l - 1] != 0)
+        {
+            break;
+        }
+    }
+    return 0;
+}
+
+// 路径右边下一个子树的起始逻辑块号，没有时返回 EXT2_EXT_MAX_BLOCKS
+static uint32_t path_next_key(const ext_path_t *path)
+{
+    for (int l = path->depth - 1; l >= 0; l--)
+    {
+        ext2_extent_header_t *eh = node_hdr(path->node[l]);
+        if (path->index[l] + 1 < eh->eh_entries)
+        {
+            return ((ext2_extent_idx_t *)(eh + 1))[path->index[l] + 1].ei_block;
+        }
+    }
+    return EXT2_EXT_MAX_BLOCKS;
+}
+
+// 根节点满了：把根的全部表项移到一个新块里，根只留一个指向它的索引，树长高一层
+static int path_grow(ext_path_t *path)
+{
+    if (path->depth >= EXT2_EXT_MAX_DEPTH)
+    {
+        printf("Error: Extent tree too deep\n");
+        return -1;
+    }
+    uint32_t child = allocate_block();
+    if (child == 0)
+    {
+        return -1;
+    }
+    uint8_t *buffer = calloc(1, BLOCK_SIZE);
+    if (buffer == NULL)
+    {
+        free_block(child);
+        return -1;
+    }
+    ext2_extent_header_t *root = node_hdr(path->root);
+    memcpy(buffer, path->root, sizeof(path->root));
+    node_hdr(buffer)->eh_max = EXT2_EXT_LEAF_ENTRIES;
+    int ret = write_block(child, buffer);
+    free(buffer);
+    if (ret != 0)
+    {
+        free_block(child);
+        return -1;
+    }
+
+    // 根的表项马上要清空，先取出新子节点的第一个键
+    uint32_t first_key = node_first_key(path->root);
+    ext2_extent_idx_t *idx = (ext2_extent_idx_t *)(root + 1);
+    memset(idx, 0, EXT2_EXT_ROOT_ENTRIES * sizeof(ext2_extent_idx_t));
+    idx[0].ei_block = first_key;
+    idx[0].ei_leaf = child;
+    root->eh_entries = 1;
+    root->eh_depth++;
+    path->depth++;
+    return 0;
+}
+
+/*
+level 层（不是根）的节点满了而父节点还有空位：分出一个新节点，插到父节点中它的后面。
+block_index 在节点最后一项之后（顺序追加）时只移出最后一项，让旧节点保持满的；否则对半分。
+*/
+static int path_split(ext_path_t *path, int level, uint32_t block_index)
+{
+    ext2_extent_header_t *eh = node_hdr(path->node[level]);
+    uint8_t *entries = (uint8_t *)(eh + 1);
+    const size_t entry_size = sizeof(ext2_extent_t);
+    uint32_t last_key = *(const uint32_t *)(entries + (eh->eh_entries - 1) * entry_size);
+    int keep = block_index > last_key ? eh->eh_entries - 1 : eh->eh_entries / 2;
+    int move = eh->eh_entries - keep;
+
+    uint32_t sibling = allocate_block();
+    if (sibling == 0)
+    {
+        return -1;
+    }
+    uint8_t *buffer = calloc(1, BLOCK_SIZE);
+    if (buffer == NULL)
+    {
+        free_block(sibling);
+        return -1;
+    }
+    ext2_extent_header_t *sh = node_hdr(buffer);
+    sh->eh_magic = EXT2_EXT_MAGIC;
+    sh->eh_max = EXT2_EXT_LEAF_ENTRIES;
+    sh->eh_depth = eh->eh_depth;
+    sh->eh_entries = move;
+    memcpy(sh + 1, entries + keep * entry_size, move * entry_size);
+    uint32_t key = node_first_key(buffer);
+    int ret = write_block(sibling, buffer);
+    free(buffer);
+    if (ret != 0)
+    {
+        free_block(sibling);
+        return -1;
+    }
+
+    memset(entries + keep * entry_size, 0, move * entry_size);
+    eh->eh_entries = keep;
+    if (path_write(path, level) != 0)
+    {
+        return -1;
+    }
+
+    ext2_extent_header_t *ph = node_hdr(path->node[level - 1]);
+    ext2_extent_idx_t *idx = (ext2_extent_idx_t *)(ph + 1);
+    int pos = path->index[level - 1] + 1;
+    memmove(idx + pos + 1, idx + pos, (ph->eh_entries - pos) * sizeof(ext2_extent_idx_t));
+    memset(&idx[pos], 0, sizeof(idx[pos]));
+    idx[pos].ei_block = key;
+    idx[pos].ei_leaf = sibling;
+    ph->eh_entries++;
+    return path_write(path, level - 1);
+}
+
+/*
+保证 block_index 所在的叶子还能再放一个表项：从叶子往上找第一个不满的节点，分裂它下面那一层，
+根节点也满时先让树长高。每次结构变化后重新查找，返回时 path 是一条叶子有空位的路径。
+*/
+static int path_make_room(ext_path_t *path, uint32_t block_index)
+{
+    for (;;)
+    {
+        if (path_find(path, block_index) != 0)
+        {
+            return -1;
+        }
+        int l = path->depth;
+        while (l >= 0 && node_hdr(path->node[l])->eh_entries >= node_hdr(path->node[l])->eh_max)
+        {
+            l--;
+        }
+        if (l == path->depth)
+        {
+            return 0;
+        }
+        if ((l < 0 ? path_grow(path) : path_split(path, l + 1, block_index)) != 0)
+        {
+            return -1;
+        }
+    }
+}
+
+// level 层（不是根）的节点变空了：释放它，并从父节点中删掉它的索引，父节点也变空时继续向上
+static int path_remove_node(ext_path_t *path, int level)
+{
+    free_block(path->block[level]);
+    ext2_extent_header_t *ph = node_hdr(path->node[level - 1]);
+    ext2_extent_idx_t *idx = (ext2_extent_idx_t *)(ph + 1);
+    int pos = path->index[level - 1];
+    memmove(idx + pos, idx + pos + 1, (ph->eh_entries - pos - 1) * sizeof(ext2_extent_idx_t));
+    ph->eh_entries--;
+    memset(&idx[ph->eh_entries], 0, sizeof(idx[0]));
+
+    if (ph->eh_entries == 0)
+    {
+        if (level - 1 > 0)
+        {
+            return path_remove_node(path, level - 1);
+        }
+        // 整棵树空了，根回到深度 0
+        ph->eh_depth = 0;
+        path->depth = 0;
+        return 0;
+    }
+    if (path_write(path, level - 1) != 0)
+    {
+        return -1;
+    }
+    return pos == 0 ? path_fix_keys(path, level - 1) : 0;
+}
+
+// 两个extent在逻辑上和物理上都首尾相接，并且合并后不超过最大长度
+static int extent_contiguous(const ext2_extent_t *a, const ext2_extent_t *b)
+{
+    return a->ee_block + a->ee_len == b->ee_block && a->ee_start + a->ee_len == b->ee_start &&
+           a->ee_len + b->ee_len <= EXT2_EXT_MAX_LEN;
+}
+
+// 插入一个不和已有extent重叠的extent，能和同一叶子中的左右邻居合并时不增加表项
+static int path_insert(ext_path_t *path, const ext2_extent_t *e)
+{
+    if (path_find(path, e->ee_block) != 0)
+    {
+        return -1;
+    }
+    int d = path->depth;
+    ext2_extent_header_t *eh = node_hdr(path->node[d]);
+    ext2_extent_t *ext = (ext2_extent_t *)(eh + 1);
+    int k = search_extent(ext, eh->eh_entries, e->ee_block);
+
+    if (k != -1 && extent_contiguous(&ext[k], e))
+    {
+        ext[k].ee_len += e->ee_len;
+        if (k + 1 < eh->eh_entries && extent_contiguous(&ext[k], &ext[k + 1]))
+        {
+            ext[k].ee_len += ext[k + 1].ee_len;
+            memmove(ext + k + 1, ext + k + 2, (eh->eh_entries - k - 2) * sizeof(ext2_extent_t));
+            eh->eh_entries--;
+            memset(&ext[eh->eh_entries], 0, sizeof(ext[0]));
+        }
+        return path_write(path, d);
+    }
+    if (k + 1 < eh->eh_entries && extent_contiguous(e, &ext[k + 1]))
+    {
+        ext[k + 1].ee_block = e->ee_block;
+        ext[k + 1].ee_start = e->ee_start;
+        ext[k + 1].ee_len += e->ee_len;
+        if (path_write(path, d) != 0)
+        {
+            return -1;
+        }
+        return k + 1 == 0 ? path_fix_keys(path, d) : 0;
+    }
+
+    if (path_make_room(path, e->ee_block) != 0)
+    {
+        return -1;
+    }
+    d = path->depth;
+    eh = node_hdr(path->node[d]);
+    ext = (ext2_extent_t *)(eh + 1);
+    int pos = search_extent(ext, eh->eh_entries, e->ee_block) + 1;
+    memmove(ext + pos + 1, ext + pos, (eh->eh_entries - pos) * sizeof(ext2_extent_t));
+    ext[pos] = *e;
+    eh->eh_entries++;
+    if (path_write(path, d) != 0)
+    {
+        return -1;
+    }
+    return pos == 0 ? path_fix_keys(path, d) : 0;
+}
+
+/*
+取消 [start, end) 的映射，free_data 为真时释放这些数据块。
+每次只处理一个extent：在中间挖掉一段时多出一个表项，叶子满了先分裂；叶子变空时连同它释放。
+*/
+static int path_punch(ext_path_t *path, uint32_t start, uint32_t end, int free_data)
+{
+    while (start < end)
+    {
+        if (path_find(path, start) != 0)
+        {
+            return -1;
+        }
+        int d = path->depth;
+        ext2_extent_header_t *eh = node_hdr(path->node[d]);
+        ext2_extent_t *ext = (ext2_extent_t *)(eh + 1);
+        int k = search_extent(ext, eh->eh_entries, start);
+        if (k == -1 || ext[k].ee_block + ext[k].ee_len <= start)
+        {
+            k++;
+        }
+        if (k >= eh->eh_entries)
+        {
+            // 这个叶子里没有了，跳到右边的子树
+            uint32_t next = path_next_key(path);
+            if (next != EXT2_EXT_MAX_BLOCKS && next <= start)
+            {
+                printf("Error: Corrupted extent tree index\n");
+                return -1;
+            }
+            start = next;
+            continue;
+        }
+
+        ext2_extent_t e = ext[k];
+        if (e.ee_block >= end)
+        {
+            break;
+        }
+        uint32_t e_end = e.ee_block + e.ee_len;
+        uint32_t cut_start = e.ee_block > start ? e.ee_block : start;
+        uint32_t cut_end = e_end < end ? e_end : end;
+        if (e.ee_block < cut_start && e_end > cut_end)
+        {
+            if (eh->eh_entries >= eh->eh_max)
+            {
+                if (path_make_room(path, start) != 0)
+                {
+                    return -1;
+                }
+                continue;
+            }
+            memmove(ext + k + 2, ext + k + 1, (eh->eh_entries - k - 1) * sizeof(ext2_extent_t));
+            ext[k].ee_len = cut_start - e.ee_block;
+            ext[k + 1] = e;
+            ext[k + 1].ee_block = cut_end;
+            ext[k + 1].ee_start = e.ee_start + (cut_end - e.ee_block);
+            ext[k + 1].ee_len = e_end - cut_end;
+            eh->eh_entries++;
+        }
+        else if (e.ee_block < cut_start)
+        {
+            ext[k].ee_len = cut_start - e.ee_block;
+        }
+        else if (e_end > cut_end)
+        {
+            ext[k].ee_block = cut_end;
+            ext[k].ee_start = e.ee_start + (cut_end - e.ee_block);
+            ext[k].ee_len = e_end - cut_end;
+        }
+        else
+        {
+            memmove(ext + k, ext + k + 1, (eh->eh_entries - k - 1) * sizeof(ext2_extent_t));
+            eh->eh_entries--;
+            memset(&ext[eh->eh_entries], 0, sizeof(ext[0]));
+        }
+
+        if (free_data)
+        {
+            free_blocks(e.ee_start + (cut_start - e.ee_block), cut_end - cut_start);
+        }
+        if (d > 0 && eh->eh_entries == 0)
+        {
+            if (path_remove_node(path, d) != 0)
+            {
+                return -1;
+            }
+        }
+        else
+        {
+            if (path_write(path, d) != 0 || (d > 0 && k == 0 && path_fix_keys(path, d) != 0))
+            {
+                return -1;
+            }
+        }
+        start = cut_end;
+    }
+    return 0;
+}
+
+// 根节点只剩一个子节点且子节点放得进根时，把它提上来（截断后小文件回到 i_block 中）
+static int path_shrink(ext_path_t *path)
+{
+    while (path->depth > 0 && node_hdr(path->root)->eh_entries == 1)
+    {
+        if (path_find(path, 0) != 0)
+        {
+            return -1;
+        }
+        ext2_extent_header_t *ch = node_hdr(path->node[1]);
+        if (ch->eh_entries > EXT2_EXT_ROOT_ENTRIES)
+        {
+            break;
+        }
+        uint32_t child = path->block[1];
+        ext2_extent_header_t *root = node_hdr(path->root);
+        memset(root + 1, 0, EXT2_EXT_ROOT_ENTRIES * sizeof(ext2_extent_t));
+        memcpy(root + 1, ch + 1, ch->eh_entries * sizeof(ext2_extent_t));
+        root->eh_entries = ch->eh_entries;
+        root->eh_depth = ch->eh_depth;
+        path->depth--;
+        free_block(child);
+    }
+    return 0;
+}
+
+int extent_map(ext2_inode_t *inode, uint32_t block_index, uint32_t pblk, uint32_t count)
+{
+    if (count == 0)
+    {
+        return 0;
+    }
+    if (block_index >= EXT2_EXT_MAX_BLOCKS || count > EXT2_EXT_MAX_BLOCKS - block_index)
+    {
+        return -1;
+    }
+
+    ext_path_t path;
+    if (path_open(&path, inode) != 0)
+    {
+        return -1;
+    }
+
+    // 先去掉和 [block_index, end) 重叠的映射（填空洞时只是一次查找），再插入新映射，超过 EXT2_EXT_MAX_LEN 的切成多段
+    int result = path_punch(&path, block_index, block_index + count, 0);
+    for (uint32_t done = 0; result == 0 && pblk != 0 && done < count; done += EXT2_EXT_MAX_LEN)
+    {
+        ext2_extent_t e;
+        memset(&e, 0, sizeof(e));
+        e.ee_block = block_index + done;
+        e.ee_len = count - done < EXT2_EXT_MAX_LEN ? count - done : EXT2_EXT_MAX_LEN;
+        e.ee_start = pblk + done;
+        result = path_insert(&path, &e);
+    }
+    if (result == 0)
+    {
+        memcpy(inode->i_block, path.root, sizeof(path.root));
+    }
+    path_close(&path);
+    return result;
+}
+
+int extent_truncate(ext2_inode_t *inode, uint32_t first_index)
+{
+    ext_path_t path;
+    if (path_open(&path, inode) != 0)
+    {
+        return -1;
+    }
+    int result = first_index < EXT2_EXT_MAX_BLOCKS ? path_punch(&path, first_index, EXT2_EXT_MAX_BLOCKS, 1) : 0;
+    if (result == 0)
+    {
+        result = path_shrink(&path);
+    }
+    if (result == 0)
+    {
+        memcpy(inode->i_block, path.root, sizeof(path.root));
+    }
+    path_close(&path);
+    return result;
+}
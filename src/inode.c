@@ -1,5 +1,6 @@
 #include "../include/inode.h"
 #include "../include/disk.h"
+#include "../include/extent.h"
 #include "../include/ext2.h"
 #include "../include/user.h"
 #include <stdio.h>
@@ -8,13 +9,14 @@
 #include <time.h>
 #include <errno.h>
 
-// Inode操作
-int create_inode(uint16_t mode, uint16_t uid, uint16_t gid)
+// Inode操作，新inode尽量和父目录 parent_inode 放在同一个块组，失败返回0（调用者都按0判断）
+int create_inode(uint32_t parent_inode, uint16_t mode, uint16_t uid, uint16_t gid)
 {
-    uint32_t inode_no = allocate_inode();//返回空闲inode号（刚分配的）
+    int is_dir = (mode & 0xF000) == EXT2_S_IFDIR;
+    uint32_t inode_no = allocate_inode(parent_inode, is_dir);//返回空闲inode号（刚分配的）
     if (inode_no == 0)
     {
-        return -1;
+        return 0;
     }
 
     ext2_inode_t inode;
@@ -42,74 +44,222 @@ int create_inode(uint16_t mode, uint16_t uid, uint16_t gid)
         inode.i_block[i] = 0;
     }
 
+    // 挂载时指定了 extents，新建的普通文件使用extent映射
+    if ((mode & 0xF000) == EXT2_S_IFREG && fs.mount_opts.use_extents)
+    {
+        inode.i_flags |= EXT2_EXTENTS_FL;
+        extent_init(&inode);
+        if (!(fs.superblock.s_feature_incompat & EXT2_FEATURE_INCOMPAT_EXTENTS))
+        {
+            fs.superblock.s_feature_incompat |= EXT2_FEATURE_INCOMPAT_EXTENTS;
+            mark_superblock_dirty();
+        }
+    }
+
     if (write_inode(inode_no, &inode) != 0)
     {
-        free_inode(inode_no);
-        return -1;
+        free_inode(inode_no, is_dir);
+        return 0;
     }
+    invalidate_permission_cache(inode_no);
 
     return inode_no;
 }
 
-int delete_inode(uint32_t inode_no)
+/*
+块指针映射
+
+i_block[0..11] 是直接块，i_block[12]/[13]/[14] 分别是一级/二级/三级间接块，
+每个间接块存放 ADDR_PER_BLOCK 个 4 字节的块号。
+*/
+#define ADDR_PER_BLOCK (BLOCK_SIZE / 4)
+#define DIRECT_BLOCKS 12
+
+/*
+把逻辑块号分解成访问路径：offsets[0] 是 i_block 中的下标，
+offsets[1..depth] 依次是各级间接块中的下标。返回深度（0 为直接块），超出范围返回-1。
+*/
+static int block_path(uint32_t block_index, uint32_t offsets[4])
 {
-    ext2_inode_t inode;
-    if (read_inode(inode_no, &inode) != 0)
+    const uint64_t a = ADDR_PER_BLOCK;
+    uint64_t index = block_index;
+
+    if (index < DIRECT_BLOCKS)
     {
-        return -1;
+        offsets[0] = index;
+        return 0;
+    }
+    index -= DIRECT_BLOCKS;
+    if (index < a)
+    {
+        offsets[0] = 12;
+        offsets[1] = index;
+        return 1;
+    }
+    index -= a;
+    if (index < a * a)
+    {
+        offsets[0] = 13;
+        offsets[1] = index / a;
+        offsets[2] = index % a;
+        return 2;
+    }
+    index -= a * a;
+    if (index < a * a * a)
+    {
+        offsets[0] = 14;
+        offsets[1] = index / (a * a);
+        offsets[2] = (index / a) % a;
+        offsets[3] = index % a;
+        return 3;
+    }
+    return -1;
+}
+
+/*
+释放以 block 为根、深度为 level 的间接块子树中（相对子树起点的）下标 >= keep 的数据块。
+整棵子树都不需要保留时连同间接块一起释放并返回1，调用者把指向它的指针清0。
+*/
+static int truncate_indirect(uint32_t block, int level, uint64_t keep)
+{
+    uint64_t span = 1; // 每个表项覆盖的数据块数
+    for (int i = 1; i < level; i++)
+    {
+        span *= ADDR_PER_BLOCK;
+    }
+
+    uint32_t table[ADDR_PER_BLOCK];
+    if (read_block(block, table) != 0)
+    {
+        return 0;
+    }
+
+    int changed = 0;
+    for (uint32_t i = 0; i < ADDR_PER_BLOCK; i++)
+    {
+        uint64_t start = i * span;
+        if (table[i] == 0 || start + span <= keep)
+        {
+            continue;
+        }
+        if (level == 1)
+        {
+            free_block(table[i]);
+            table[i] = 0;
+            changed = 1;
+        }
+        else if (truncate_indirect(table[i], level - 1, keep > start ? keep - start : 0))
+        {
+            table[i] = 0;
+            changed = 1;
+        }
     }
 
-    // 释放所有数据块
-    for (int i = 0; i < 12; i++)
+    if (keep == 0)
     {
-        if (inode.i_block[i] != 0)
+        free_block(block);
+        return 1;
+    }
+    if (changed)
+    {
+        write_block(block, table);
+    }
+    return 0;
+}
+
+// 释放块指针文件中逻辑块号 >= keep 的所有数据块，以及不再需要的间接块
+static void truncate_block_map(ext2_inode_t *inode, uint32_t keep)
+{
+    for (uint32_t i = keep; i < DIRECT_BLOCKS; i++)
+    {
+        if (inode->i_block[i] != 0)
         {
-            free_block(inode.i_block[i]);
+            free_block(inode->i_block[i]);
+            inode->i_block[i] = 0;
         }
     }
 
-    // 释放间接块（简化实现，只处理一级间接）
-    if (inode.i_block[12] != 0)
+    uint64_t base = DIRECT_BLOCKS;
+    uint64_t span = ADDR_PER_BLOCK;
+    for (int level = 1; level <= 3; level++)
     {
-        uint32_t indirect_blocks[BLOCK_SIZE / 4];
-        if (read_block(inode.i_block[12], indirect_blocks) == 0)
+        uint32_t *root = &inode->i_block[DIRECT_BLOCKS + level - 1];
+        if (*root != 0 && base + span > keep &&
+            truncate_indirect(*root, level, keep > base ? keep - base : 0))
         {
-            for (int i = 0; i < BLOCK_SIZE / 4; i++)
-            {
-                if (indirect_blocks[i] != 0)
-                {
-                    free_block(indirect_blocks[i]);
-                }
-            }
+            *root = 0;
         }
-        free_block(inode.i_block[12]);
+        base += span;
+        span *= ADDR_PER_BLOCK;
+    }
+}
+
+int delete_inode(uint32_t inode_no)
+{
+    ext2_inode_t inode;
+    if (read_inode(inode_no, &inode) != 0)
+    {
+        return -1;
+    }
+
+    // extent文件按整段释放数据块和叶子块，块指针文件释放所有数据块和各级间接块
+    if (inode.i_flags & EXT2_EXTENTS_FL)
+    {
+        extent_truncate(&inode, 0);
+    }
+    else
+    {
+        truncate_block_map(&inode, 0);
+    }
+
+    // 目录的哈希索引块
+    if ((inode.i_flags & EXT2_INDEX_FL) && inode.i_dir_acl != 0)
+    {
+        free_block(inode.i_dir_acl);
     }
 
     // 清除inode
+    int is_dir = (inode.i_mode & 0xF000) == EXT2_S_IFDIR;
+    invalidate_permission_cache(inode_no);
     memset(&inode, 0, sizeof(ext2_inode_t));
     write_inode(inode_no, &inode);
 
     // 释放inode
-    free_inode(inode_no);
+    free_inode(inode_no, is_dir);
 
     return 0;
 }
 
-int get_inode_block(uint32_t inode_no, uint32_t block_index, uint32_t *block_no)
+/*
+解析从 block_index 开始的一段映射：*pblk 为对应的物理块号（0 表示空洞），
+*len 为之后在同一个块指针数组（直接块或最底层的间接块）中连续的块数
+（物理块号依次加1，或者都是空洞）。
+每级间接块只在路径上访问一次，通过 get_block_ptr 直接在缓存里扫描，不拷贝整块；
+一段最长可达一个间接块覆盖的范围，之后的下标由映射缓存直接命中。
+*/
+static int lookup_block_run(const ext2_inode_t *ip, uint32_t block_index, uint32_t *pblk, uint32_t *len)
 {
-    ext2_inode_t inode;
-    if (read_inode(inode_no, &inode) != 0)
+    if (ip->i_flags & EXT2_EXTENTS_FL)
     {
-        return -1;
+        return extent_lookup(ip, block_index, pblk, len);
     }
 
-    if (block_index < 12)
+    uint32_t offsets[4];
+    int depth = block_path(block_index, offsets);
+    if (depth < 0)
     {
-        *block_no = inode.i_block[block_index];
-        //printf("[DEBUG] get_inode_block: inode=%u, block_index=%u, block_no=%u\n", inode_no, block_index, *block_no);
-        return 0;
+        return -1; // 超出范围
     }
-    else if (block_index < 12 + BLOCK_SIZE / 4) 
+
+    const uint32_t *table;
+    uint32_t first, limit;
+    if (depth == 0)
+    {
+        table = ip->i_block;
+        first = block_index;
+        limit = DIRECT_BLOCKS;
+    }
+    else
     /*为什么是除以 4？
      因为每个物理块号是 uint32_t 类型，固定占 4 字节
 
@@ -119,127 +269,516 @@ int get_inode_block(uint32_t inode_no, uint32_t block_index, uint32_t *block_no)
 
      一个 1024 字节的块可存储 256 个这样的 4 字节块号*/
     {
-        // 一级间接块
-        if (inode.i_block[12] == 0)
+        // 沿路径逐级向下找到最底层的间接块，中间某一级不存在时到该间接块末尾为止都是空洞
+        uint32_t block = ip->i_block[offsets[0]];
+        for (int level = 1; level < depth && block != 0; level++)
+        {
+            const uint32_t *upper = get_block_ptr(block);
+            if (upper == NULL)
+            {
+                return -1;
+            }
+            block = upper[offsets[level]];
+        }
+        if (block == 0)
         {
-            *block_no = 0;
+            *pblk = 0;
+            *len = ADDR_PER_BLOCK - offsets[depth];
             return 0;
         }
+        table = get_block_ptr(block);
+        if (table == NULL)
+        {
+            return -1;
+        }
+        first = offsets[depth];
+        limit = ADDR_PER_BLOCK;
+    }
+
+    uint32_t start = table[first];
+    uint32_t n = 1;
+    while (first + n < limit &&
+           (start == 0 ? table[first + n] == 0 : table[first + n] == start + n))
+    {
+        n++;
+    }
+    *pblk = start;
+    *len = n;
+    return 0;
+}
+
+/*
+带缓存的映射查找：先看缓存inode上记录的上一段映射，命中时不用再读间接块。
+返回值和输出同 lookup_block_run，只是 *pblk 和 *len 从 block_index 开始算。
+*/
+static int map_block_run(uint32_t inode_no, uint32_t block_index, uint32_t *pblk, uint32_t *len)
+{
+    ext2_inode_t *ip = iget(inode_no);
+    if (ip == NULL)
+    {
+        return -1;
+    }
 
-        uint32_t indirect_blocks[BLOCK_SIZE / 4];
-        if (read_block(inode.i_block[12], indirect_blocks) != 0)
+    block_map_cache_t *map = inode_block_map(ip);
+    if (map->len == 0 || block_index < map->lblk || block_index - map->lblk >= map->len)
+    {
+        uint32_t start, n;
+        if (lookup_block_run(ip, block_index, &start, &n) != 0)
         {
+            iput(ip);
             return -1;
         }
+        map->lblk = block_index;
+        map->pblk = start;
+        map->len = n;
+    }
 
-        *block_no = indirect_blocks[block_index - 12];
-        return 0;
+    uint32_t skip = block_index - map->lblk;
+    *pblk = map->pblk == 0 ? 0 : map->pblk + skip;
+    *len = map->len - skip;
+    iput(ip);
+    return 0;
+}
+
+int get_inode_block(uint32_t inode_no, uint32_t block_index, uint32_t *block_no)
+{
+    uint32_t len;
+    return map_block_run(inode_no, block_index, block_no, &len);
+}
+
+// 分配一个新的间接块并清零
+static uint32_t allocate_indirect_block(void)
+{
+    uint32_t block_no = allocate_block();
+    if (block_no != 0)
+    {
+        uint8_t zero[BLOCK_SIZE] = {0};
+        if (write_block(block_no, zero) != 0)
+        {
+            free_block(block_no);
+            return 0;
+        }
+    }
+    return block_no;
+}
+
+/*
+沿 block_path 给出的路径找到最底层的间接块，create 非0时逐级分配缺失的间接块。
+返回最底层间接块的块号；不存在（不创建时）或分配失败返回0。
+*/
+static uint32_t find_leaf_indirect(ext2_inode_t *inode, const uint32_t offsets[4], int depth, int create)
+{
+    uint32_t *root = &inode->i_block[offsets[0]];
+    if (*root == 0)
+    {
+        if (!create || (*root = allocate_indirect_block()) == 0)
+        {
+            return 0;
+        }
+        mark_inode_dirty(inode);
+    }
+
+    uint32_t block = *root;
+    for (int level = 1; level < depth; level++)
+    {
+        uint32_t table[ADDR_PER_BLOCK];
+        if (read_block(block, table) != 0)
+        {
+            return 0;
+        }
+        if (table[offsets[level]] == 0)
+        {
+            if (!create || (table[offsets[level]] = allocate_indirect_block()) == 0)
+            {
+                return 0;
+            }
+            if (write_block(block, table) != 0)
+            {
+                return 0;
+            }
+        }
+        block = table[offsets[level]];
+    }
+    return block;
+}
+
+/*
+在块指针文件中设置从 block_index 开始的最多 count 个映射（物理块号 first_block 起依次加1，
+first_block 为0时清除映射）。同一个间接块里的表项一次读改写完成，返回设置的块数，出错返回-1。
+*/
+static int set_block_map_run(ext2_inode_t *inode, uint32_t block_index, uint32_t first_block, uint32_t count)
+{
+    uint32_t offsets[4];
+    int depth = block_path(block_index, offsets);
+    if (depth < 0)
+    {
+        return -1; // 超出范围
+    }
+
+    if (depth == 0)
+    {
+        uint32_t n = 0;
+        for (; n < count && block_index + n < DIRECT_BLOCKS; n++)
+        {
+            inode->i_block[block_index + n] = first_block == 0 ? 0 : first_block + n;
+        }
+        mark_inode_dirty(inode);
+        return n;
     }
 
-    return -1; // 超出范围
+    uint32_t leaf = find_leaf_indirect(inode, offsets, depth, first_block != 0);
+    uint32_t n = ADDR_PER_BLOCK - offsets[depth];
+    if (n > count)
+    {
+        n = count;
+    }
+    if (leaf == 0)
+    {
+        return first_block == 0 ? (int)n : -1; // 清除映射时间接块不存在就已经是空洞
+    }
+
+    uint32_t table[ADDR_PER_BLOCK];
+    if (read_block(leaf, table) != 0)
+    {
+        return -1;
+    }
+    for (uint32_t i = 0; i < n; i++)
+    {
+        table[offsets[depth] + i] = first_block == 0 ? 0 : first_block + i;
+    }
+    return write_block(leaf, table) == 0 ? (int)n : -1;
 }
 
 int set_inode_block(uint32_t inode_no, uint32_t block_index, uint32_t block_no)
 {
-    ext2_inode_t inode;
-    if (read_inode(inode_no, &inode) != 0)
+    return set_inode_blocks(inode_no, block_index, block_no, 1) == 1 ? 0 : -1;
+}
+
+/*
+把逻辑块 [block_index, block_index + count) 映射到从 first_block 开始的连续物理块（first_block 为0时清除映射）。
+extent文件只插入一个extent；块指针文件按间接块分批设置。
+返回成功映射的块数，出错且一块都没映射时返回-1。
+*/
+int set_inode_blocks(uint32_t inode_no, uint32_t block_index, uint32_t first_block, uint32_t count)
+{
+    ext2_inode_t *inode = iget(inode_no);
+    if (inode == NULL)
     {
         return -1;
     }
 
-    if (block_index < 12)
+    uint32_t mapped = 0;
+    if (inode->i_flags & EXT2_EXTENTS_FL)
     {
-        inode.i_block[block_index] = block_no;
+        if (extent_map(inode, block_index, first_block, count) == 0)
+        {
+            mapped = count;
+        }
+        mark_inode_dirty(inode);
     }
-    else if (block_index < 12 + BLOCK_SIZE / 4)
+    else
     {
-        // 一级间接块
-        if (inode.i_block[12] == 0)
+        while (mapped < count)
         {
-            inode.i_block[12] = allocate_block();
-            if (inode.i_block[12] == 0)
+            int n = set_block_map_run(inode, block_index + mapped,
+                                      first_block == 0 ? 0 : first_block + mapped, count - mapped);
+            if (n <= 0)
             {
-                return -1;
+                break;
             }
+            mapped += n;
         }
+    }
 
-        uint32_t indirect_blocks[BLOCK_SIZE / 4];
-        if (read_block(inode.i_block[12], indirect_blocks) != 0)
+    inode_block_map(inode)->len = 0; // 映射变了，缓存的映射段作废
+    iput(inode);
+    return mapped > 0 ? (int)mapped : -1;
+}
+
+/*
+从 block_index 开始，向后合并物理上连续的块。
+first_block 是 block_index 对应的物理块号，block_offset 是数据在第一块内的偏移，
+返回合并后覆盖的字节数（不超过 max_bytes），*nblocks 为合并的块数。
+*/
+static size_t coalesce_run(uint32_t inode_no, uint32_t block_index, uint32_t first_block,
+                           uint32_t block_offset, size_t max_bytes, uint32_t *nblocks)
+{
+    // 按映射段整段合并，段在直接块/间接块的边界上断开时再接着查下一段
+    uint32_t blocks = 0;
+    size_t want_blocks = (block_offset + max_bytes + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    while (blocks < want_blocks)
+    {
+        uint32_t pblk, len;
+        if (map_block_run(inode_no, block_index + blocks, &pblk, &len) != 0 ||
+            pblk != first_block + blocks)
         {
-            memset(indirect_blocks, 0, BLOCK_SIZE);
+            break;
         }
-
-        indirect_blocks[block_index - 12] = block_no;
-        write_block(inode.i_block[12], indirect_blocks);
+        blocks += len;
     }
-    else
+    if (blocks == 0)
     {
-        return -1; // 超出范围
+        blocks = 1;
+    }
+    if (blocks > want_blocks)
+    {
+        blocks = want_blocks;
     }
 
-    int result = write_inode(inode_no, &inode);
-    return result;
+    *nblocks = blocks;
+    size_t run_bytes = (size_t)blocks * BLOCK_SIZE - block_offset;
+    return run_bytes < max_bytes ? run_bytes : max_bytes;
 }
 
-// 文件读写操作
-ssize_t read_inode_data(uint32_t inode_no, void *buffer, size_t size, off_t offset)
+/*
+文件中一段物理连续的块，以及它在用户缓冲区中对应的位置。
+
+phys_start：第一块的物理块号，nblocks：块数
+head：数据在第一块内的起始偏移，len：搬运的字节数
+*/
+typedef struct {
+    uint32_t phys_start;
+    uint32_t nblocks;
+    uint32_t head;
+    char *user;
+    size_t len;
+} data_run_t;
+
+/*
+为一段连续块生成 iovec：首尾不完整的块借助临时缓冲区，中间的整块直接对用户缓冲区读写。
+只有第一段的首块和最后一段的尾块可能不完整，first_buf/last_buf 分别给它们用。
+first_bounce/last_bounce 返回用到的临时缓冲区（没有则为 NULL）。
+*/
+static int build_run_iov(const data_run_t *run, uint8_t *first_buf, uint8_t *last_buf,
+                         struct iovec *iov, uint8_t **first_bounce, uint8_t **last_bounce)
 {
-    ext2_inode_t inode;
-    if (read_inode(inode_no, &inode) != 0)
+    int iovcnt = 0;
+    int head_partial = run->head != 0 || (run->nblocks == 1 && run->len < BLOCK_SIZE);
+    int tail_partial = run->nblocks > 1 && (run->head + run->len) % BLOCK_SIZE != 0;
+    uint32_t mid_start = head_partial ? 1 : 0;
+    uint32_t mid_end = tail_partial ? run->nblocks - 1 : run->nblocks;
+
+    *first_bounce = head_partial ? first_buf : NULL;
+    *last_bounce = tail_partial ? last_buf : NULL;
+
+    if (head_partial)
     {
-        return -1;
+        iov[iovcnt].iov_base = first_buf;
+        iov[iovcnt].iov_len = BLOCK_SIZE;
+        iovcnt++;
+    }
+    if (mid_end > mid_start)
+    {
+        // 第 k 块（k >= 1）在用户缓冲区中的起始位置是 user + (BLOCK_SIZE - head) + (k - 1) * BLOCK_SIZE
+        size_t user_off = mid_start == 0 ? 0 : (BLOCK_SIZE - run->head) + (size_t)(mid_start - 1) * BLOCK_SIZE;
+        iov[iovcnt].iov_base = run->user + user_off;
+        iov[iovcnt].iov_len = (size_t)(mid_end - mid_start) * BLOCK_SIZE;
+        iovcnt++;
+    }
+    if (tail_partial)
+    {
+        iov[iovcnt].iov_base = last_buf;
+        iov[iovcnt].iov_len = BLOCK_SIZE;
+        iovcnt++;
     }
+    return iovcnt;
+}
 
-    if (offset >= inode.i_size)
+// 首块不完整时，该块内需要搬运的字节数
+static size_t run_head_len(const data_run_t *run)
+{
+    size_t n = BLOCK_SIZE - run->head;
+    return n > run->len ? run->len : n;
+}
+
+// 尾块不完整时，尾块内需要搬运的字节数，以及它在用户缓冲区中的偏移
+static size_t run_tail_len(const data_run_t *run)
+{
+    return (run->head + run->len) % BLOCK_SIZE;
+}
+
+static size_t run_tail_user_off(const data_run_t *run)
+{
+    return run->len - run_tail_len(run);
+}
+
+/*
+把一批连续块段和用户缓冲区之间的搬运作为一批请求交给 I/O 引擎，
+所有段同时在途，而不是一段一段同步读写。
+*/
+static int transfer_runs(int is_write, data_run_t *runs, int nruns)
+{
+    if (nruns == 0)
     {
         return 0;
     }
 
-    size_t bytes_read = 0;
-    size_t remaining = size;
-    off_t current_offset = offset;
+    uint8_t first_buf[BLOCK_SIZE];
+    uint8_t last_buf[BLOCK_SIZE];
+    uint8_t *first_bounce[2] = {NULL, NULL};  // 第一段 / 最后一段的首块临时缓冲区
+    uint8_t *last_bounce = NULL;              // 最后一段的尾块临时缓冲区
 
-    while (remaining > 0 && current_offset < inode.i_size)
+    struct iovec *iov = malloc((size_t)nruns * 3 * sizeof(struct iovec));
+    block_request_t *reqs = malloc((size_t)nruns * sizeof(block_request_t));
+    if (iov == NULL || reqs == NULL)
     {
-        uint32_t block_index = current_offset / BLOCK_SIZE;
-        uint32_t block_offset = current_offset % BLOCK_SIZE;
-        uint32_t block_no;
+        free(iov);
+        free(reqs);
+        return -1;
+    }
 
-        if (get_inode_block(inode_no, block_index, &block_no) != 0 || block_no == 0)
+    for (int i = 0; i < nruns; i++)
+    {
+        // 最后一段（且不是第一段）的首块只可能是单块的不完整块，借用 last_buf
+        uint8_t *fb = (i == 0) ? first_buf : last_buf;
+        uint8_t *hb, *tb;
+        reqs[i].write = is_write;
+        reqs[i].block_no = runs[i].phys_start;
+        reqs[i].iov = &iov[i * 3];
+        reqs[i].iovcnt = build_run_iov(&runs[i], fb, last_buf, &iov[i * 3], &hb, &tb);
+        if (i == 0)
         {
-            break;
+            first_bounce[0] = hb;
+        }
+        else if (i == nruns - 1)
+        {
+            first_bounce[1] = hb;
         }
+        if (i == nruns - 1)
+        {
+            last_bounce = tb;
+        }
+    }
 
-        uint8_t block_buffer[BLOCK_SIZE];
-        if (read_block(block_no, block_buffer) != 0)
+    data_run_t *first = &runs[0];
+    data_run_t *last = &runs[nruns - 1];
+    int result = 0;
+
+    if (is_write)
+    {
+        // 不完整的首尾块需要先读出原内容再合并
+        if (first_bounce[0] != NULL)
         {
-            break;
+            result |= read_blocks(first->phys_start, 1, first_bounce[0]);
+            memcpy(first_bounce[0] + first->head, first->user, run_head_len(first));
+        }
+        if (first_bounce[1] != NULL)
+        {
+            result |= read_blocks(last->phys_start, 1, first_bounce[1]);
+            memcpy(first_bounce[1], last->user, last->len);
+        }
+        if (last_bounce != NULL)
+        {
+            result |= read_blocks(last->phys_start + last->nblocks - 1, 1, last_bounce);
+            memcpy(last_bounce, last->user + run_tail_user_off(last), run_tail_len(last));
         }
+        if (result == 0)
+        {
+            result = submit_block_batch(reqs, nruns);
+        }
+    }
+    else
+    {
+        result = submit_block_batch(reqs, nruns);
+        if (result == 0)
+        {
+            if (first_bounce[0] != NULL)
+            {
+                memcpy(first->user, first_bounce[0] + first->head, run_head_len(first));
+            }
+            if (first_bounce[1] != NULL)
+            {
+                memcpy(last->user, first_bounce[1], last->len);
+            }
+            if (last_bounce != NULL)
+            {
+                memcpy(last->user + run_tail_user_off(last), last_bounce, run_tail_len(last));
+            }
+        }
+    }
 
-        size_t bytes_in_block = BLOCK_SIZE - block_offset;
-        if (bytes_in_block > remaining)
+    free(iov);
+    free(reqs);
+    return result == 0 ? 0 : -1;
+}
+
+/*
+把 [offset, offset + size) 映射成若干物理连续块段。
+遇到空洞或映射失败时停止，返回段数（出错返回-1），*mapped 为段覆盖的字节数。
+*/
+static int collect_runs(uint32_t inode_no, char *user, size_t size, off_t offset,
+                        data_run_t **runs_out, size_t *mapped)
+{
+    int nruns = 0;
+    int cap = 8;
+    data_run_t *runs = malloc(cap * sizeof(data_run_t));
+    if (runs == NULL)
+    {
+        return -1;
+    }
+
+    size_t done = 0;
+    off_t current_offset = offset;
+    while (done < size)
+    {
+        uint32_t block_index = current_offset / BLOCK_SIZE;
+        uint32_t block_offset = current_offset % BLOCK_SIZE;
+        uint32_t block_no;
+        if (get_inode_block(inode_no, block_index, &block_no) != 0 || block_no == 0)
         {
-            bytes_in_block = remaining;
+            break;
         }
-        if (current_offset + bytes_in_block > inode.i_size)
+
+        if (nruns == cap)
         {
-            bytes_in_block = inode.i_size - current_offset;
+            cap *= 2;
+            data_run_t *bigger = realloc(runs, cap * sizeof(data_run_t));
+            if (bigger == NULL)
+            {
+                free(runs);
+                return -1;
+            }
+            runs = bigger;
         }
 
-        memcpy((char *)buffer + bytes_read, block_buffer + block_offset, bytes_in_block);
+        // 物理上连续的块合并成一个请求
+        data_run_t *run = &runs[nruns++];
+        run->phys_start = block_no;
+        run->head = block_offset;
+        run->user = user + done;
+        run->len = coalesce_run(inode_no, block_index, block_no, block_offset, size - done, &run->nblocks);
 
-        bytes_read += bytes_in_block;
-        remaining -= bytes_in_block;
-        current_offset += bytes_in_block;
+        done += run->len;
+        current_offset += run->len;
     }
 
-    // 更新访问时间
-    update_atime(inode_no);
+    *runs_out = runs;
+    *mapped = done;
+    return nruns;
+}
 
-    return bytes_read;
+// 文件读写操作
+/*
+读文件时是否需要更新 i_atime：
+- noatime：从不更新
+- relatime：atime 不晚于 mtime/ctime，或者距上次更新超过一天时才更新
+- 默认（atime）：每次读都更新
+*/
+static int atime_needs_update(const ext2_inode_t *inode, uint32_t now)
+{
+    switch (fs.mount_opts.atime_mode)
+    {
+    case ATIME_NOATIME:
+        return 0;
+    case ATIME_RELATIME:
+        return inode->i_atime <= inode->i_mtime || inode->i_atime <= inode->i_ctime ||
+               now - inode->i_atime >= RELATIME_INTERVAL;
+    default:
+        return inode->i_atime != now;
+    }
 }
 
-ssize_t write_inode_data(uint32_t inode_no, const void *buffer, size_t size, off_t offset)
+ssize_t read_inode_data(uint32_t inode_no, void *buffer, size_t size, off_t offset)
 {
     ext2_inode_t inode;
     if (read_inode(inode_no, &inode) != 0)
@@ -247,163 +786,310 @@ ssize_t write_inode_data(uint32_t inode_no, const void *buffer, size_t size, off
         return -1;
     }
 
+    if (offset >= inode.i_size)
+    {
+        return 0;
+    }
+    if (size > (size_t)(inode.i_size - offset))
+    {
+        size = inode.i_size - offset;
+    }
 
+    data_run_t *runs;
+    size_t bytes_read = 0;
+    int nruns = collect_runs(inode_no, buffer, size, offset, &runs, &bytes_read);
+    if (nruns < 0)
+    {
+        return -1;
+    }
+    int ret = transfer_runs(0, runs, nruns);
+    free(runs);
+    if (ret != 0)
+    {
+        return -1;
+    }
 
-    size_t bytes_written = 0;
-    size_t remaining = size;//remaining表示剩余要写入的字节数，一开始比如是2000字节的话
-    off_t current_offset = offset;
-
-    while (remaining > 0)
+    // 按挂载选项决定是否更新访问时间（noatime/relatime 下纯读通常不产生写）
+    ext2_inode_t *ip = iget(inode_no);
+    if (ip != NULL)
     {
-        uint32_t block_index = current_offset / BLOCK_SIZE;//比如24字节，block_index=0
-        uint32_t block_offset = current_offset % BLOCK_SIZE;//如果2000字节，那么这里就是1024字节的溢出的部分
-        uint32_t block_no;
-        if (get_inode_block(inode_no, block_index, &block_no) != 0)
+        uint32_t now = time(NULL);
+        if (atime_needs_update(ip, now))
         {
-            break;
+            ip->i_atime = now;
+            mark_inode_dirty(ip);
         }
+        iput(ip);
+    }
+
+    return bytes_read;
+}
+
+ssize_t write_inode_data(uint32_t inode_no, const void *buffer, size_t size, off_t offset)
+{
+    ext2_inode_t inode;
+    if (read_inode(inode_no, &inode) != 0)
+    {
+        return -1;
+    }
 
-        if (block_no == 0)
+    /*
+    先为整个写入范围分配缺失的块，分配失败时只写到已分配的部分。
+    连续缺失的块一次性申请一段连续的物理块，并以前一个逻辑块的物理块号 +1 为目标，
+    让文件在磁盘上尽量连续。
+    */
+    size_t writable = size;
+    if (size > 0)
+    {
+        uint32_t first_index = offset / BLOCK_SIZE;
+        uint32_t last_index = (offset + size - 1) / BLOCK_SIZE;
+        uint32_t block_index = first_index;
+        while (block_index <= last_index)
         {
-            block_no = allocate_block();//找到空闲的块号
-            if (block_no == 0)
+            // 已映射的段整段跳过，空洞段的长度就是连续缺失的块数
+            uint32_t block_no, run_len;
+            if (map_block_run(inode_no, block_index, &block_no, &run_len) != 0)
             {
                 break;
             }
-            if (set_inode_block(inode_no, block_index, block_no) != 0)//如果是24字节，设置inode的i_block数组，这里设置了i_block[0]=block_no
-            //这里是更新了比如说inode为4号的i_block数组，但是前面的inode为4的i_block数组没有更新，所以需要重新读取inode
+            if (block_no != 0)
             {
-                free_block(block_no);
-                break;
+                block_index += run_len;
+                continue;
             }
-            // 重新读取inode以获取最新的i_block数组
-            if (read_inode(inode_no, &inode) != 0) {
-                break;
+            uint32_t missing = run_len;
+            if (missing > last_index - block_index + 1)
+            {
+                missing = last_index - block_index + 1;
             }
-        }
 
-        uint8_t block_buffer[BLOCK_SIZE];
-        if (read_block(block_no, block_buffer) != 0)
-        {
-            break;
-        }
+            // 紧接前一块分配；文件还没有前一块时从inode所在组的数据区开始找
+            uint32_t goal = inode_goal_block(inode_no);
+            uint32_t prev_block;
+            if (block_index > 0 && get_inode_block(inode_no, block_index - 1, &prev_block) == 0 && prev_block != 0)
+            {
+                goal = prev_block + 1;
+            }
 
-        size_t bytes_in_block = BLOCK_SIZE - block_offset;//根据上面如果是2000字节的话,BLOCK_SIZE-block_offset的话就是改块的剩余空间
-        if (bytes_in_block > remaining)//如果改块剩余空间大于剩余要写入的字节数，那么就写入剩余要写入的字节数
-        {
-            bytes_in_block = remaining;
+            uint32_t count;
+            uint32_t run_start = allocate_blocks(goal, missing, &count);//找到一段空闲的块
+            if (run_start == 0)
+            {
+                break;
+            }
+            int result = set_inode_blocks(inode_no, block_index, run_start, count);
+            uint32_t mapped = result > 0 ? (uint32_t)result : 0;
+            for (uint32_t i = mapped; i < count; i++)
+            {
+                free_block(run_start + i);
+            }
+            block_index += mapped;
+            if (mapped < count)
+            {
+                break;
+            }
         }
-
-        //否则的话就写入改块的剩余空间
-        memcpy(block_buffer + block_offset, (char *)buffer + bytes_written, bytes_in_block);
-
-        if (write_block(block_no, block_buffer) != 0)
+        if (block_index <= last_index)
         {
-            break;
+            writable = block_index == first_index ? 0 : (size_t)((off_t)block_index * BLOCK_SIZE - offset);
         }
-
-        bytes_written += bytes_in_block;
-        remaining -= bytes_in_block;
-        current_offset += bytes_in_block;
     }
 
-    // 更新文件大小和时间戳
-    if (current_offset > inode.i_size)
+    data_run_t *runs;
+    size_t bytes_written = 0;
+    int nruns = collect_runs(inode_no, (char *)buffer, writable, offset, &runs, &bytes_written);
+    if (nruns < 0)
     {
-        inode.i_size = current_offset;
-        inode.i_blocks = (inode.i_size + BLOCK_SIZE - 1) / BLOCK_SIZE;
-        
-        // 将更新后的inode写回磁盘
-        if (write_inode(inode_no, &inode) != 0) {
-            // 写入失败
-        }
+        return -1;
+    }
+    // 数据没写成功时不改文件大小和时间戳，已分配的块留在映射里，截断或删除时一并释放
+    int ret = transfer_runs(1, runs, nruns);
+    free(runs);
+    if (ret != 0)
+    {
+        return -1;
+    }
+    if (bytes_written == 0)
+    {
+        return 0;
     }
+    off_t current_offset = offset + bytes_written;
 
-    update_mtime(inode_no);
-    update_ctime(inode_no);
+    // 文件大小和时间戳在缓存中的同一个inode上一起修改，只产生一次inode写回
+    ext2_inode_t *ip = iget(inode_no);
+    if (ip == NULL)
+    {
+        return -1;
+    }
+    uint32_t old_size = ip->i_size;
+    if (current_offset > ip->i_size)
+    {
+        ip->i_size = current_offset;
+        ip->i_blocks = (ip->i_size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    }
+    int64_t delta = (int64_t)ip->i_size - old_size;
+    uint32_t parent = ip->i_parent;
+    ip->i_mtime = ip->i_ctime = time(NULL);
+    mark_inode_dirty(ip);
+    iput(ip);
+    if (delta != 0 && !is_directory(inode_no))
+    {
+        adjust_subtree_size(parent, delta);
+    }
 
     return bytes_written;
 }
 
 int truncate_inode(uint32_t inode_no, off_t length)
 {
-    ext2_inode_t inode;
-    if (read_inode(inode_no, &inode) != 0)
+    ext2_inode_t *ip = iget(inode_no);
+    if (ip == NULL)
     {
         return -1;
     }
 
-    if (length >= inode.i_size)
+    if (length >= ip->i_size)
     {
+        iput(ip);
         return 0; // 不需要截断
     }
 
     uint32_t new_blocks = (length + BLOCK_SIZE - 1) / BLOCK_SIZE;
-    uint32_t old_blocks = (inode.i_size + BLOCK_SIZE - 1) / BLOCK_SIZE;
 
-    // 释放多余的块
-    for (uint32_t i = new_blocks; i < old_blocks; i++)
+    // extent文件整段释放；块指针文件释放多余的数据块和不再需要的间接块
+    if (ip->i_flags & EXT2_EXTENTS_FL)
     {
-        uint32_t block_no;
-        if (get_inode_block(inode_no, i, &block_no) == 0 && block_no != 0)
-        {
-            free_block(block_no);
-            set_inode_block(inode_no, i, 0);
-        }
+        extent_truncate(ip, new_blocks);
+    }
+    else
+    {
+        truncate_block_map(ip, new_blocks);
+    }
+    inode_block_map(ip)->len = 0;
+
+    int64_t delta = (int64_t)length - ip->i_size;
+    uint32_t parent = ip->i_parent;
+    int is_dir = (ip->i_mode & 0xF000) == EXT2_S_IFDIR;
+    ip->i_size = length;
+    ip->i_blocks = new_blocks;
+    ip->i_mtime = ip->i_ctime = time(NULL);
+    mark_inode_dirty(ip);
+    iput(ip);
+    if (!is_dir)
+    {
+        adjust_subtree_size(parent, delta);
     }
+    return 0;
+}
+/*
+权限判定缓存
+
+按inode号直接映射（inode_no % PERM_CACHE_SIZE）缓存当前用户对该inode适用的权限类别
+（属主/属组/其他）和这一类的 rwx 三位，路径上每一级目录的权限检查只是一次数组访问，不用再读inode。
+uid/gid 记录在项中，换用户后自然不命中；chmod/chown、inode 创建和删除时使对应项失效，
+换镜像时整体失效。
+*/
+typedef struct
+{
+    uint32_t inode_no;
+    uint32_t gen;                 // 等于 perm_cache_gen 时有效
+    uint16_t uid;
+    uint16_t gid;
+    uint8_t cls;                  // PERM_CLASS_*
+    uint8_t bits;                 // 这一类的 rwx（r=4 w=2 x=1）
+} perm_cache_entry_t;
 
-    inode.i_size = length;
-    inode.i_blocks = new_blocks;
+#define PERM_CACHE_SIZE 1024
 
-    update_mtime(inode_no);
-    update_ctime(inode_no);
+static perm_cache_entry_t perm_cache[PERM_CACHE_SIZE];
+static uint32_t perm_cache_gen = 1;
+
+// inode_no 为0时清空整个缓存
+void invalidate_permission_cache(uint32_t inode_no)
+{
+    if (inode_no == 0)
+    {
+        perm_cache_gen++;
+    }
+    else if (perm_cache[inode_no % PERM_CACHE_SIZE].inode_no == inode_no)
+    {
+        perm_cache[inode_no % PERM_CACHE_SIZE].gen = 0;
+    }
+}
+
+/*
+当前用户对inode适用的权限类别（*cls）和这一类的 rwx 三位，inode 不存在时返回-1。
+root 也按普通规则给出类别，是否放行由调用者判断。
+*/
+int inode_permission_bits(uint32_t inode_no, int *cls)
+{
+    uint16_t uid = get_current_uid();
+    uint16_t gid = get_current_gid();
+    perm_cache_entry_t *pc = &perm_cache[inode_no % PERM_CACHE_SIZE];
+    if (pc->inode_no == inode_no && pc->gen == perm_cache_gen && pc->uid == uid && pc->gid == gid)
+    {
+        *cls = pc->cls;
+        return pc->bits;
+    }
 
-    return write_inode(inode_no, &inode);
+    const ext2_inode_t *ip = get_inode_ptr(inode_no);
+    if (ip == NULL)
+    {
+        return -1;
+    }
+    int c, bits;
+    if (uid == ip->i_uid)
+    {
+        c = PERM_CLASS_OWNER;
+        bits = (ip->i_mode >> 6) & 0x7;
+    }
+    else if (gid == ip->i_gid)
+    {
+        c = PERM_CLASS_GROUP;
+        bits = (ip->i_mode >> 3) & 0x7;
+    }
+    else
+    {
+        c = PERM_CLASS_OTHER;
+        bits = ip->i_mode & 0x7;
+    }
+    pc->inode_no = inode_no;
+    pc->gen = perm_cache_gen;
+    pc->uid = uid;
+    pc->gid = gid;
+    pc->cls = c;
+    pc->bits = bits;
+    *cls = c;
+    return bits;
 }
+
 /*检查当前用户是否有权限 (access) 访问指定的 inode (inode_no)。
 返回 1（有权限）或 0（无权限）。*/
 int check_permission(uint32_t inode_no, int access)
 {
-    ext2_inode_t inode;
-    if (read_inode(inode_no, &inode) != 0)
+    int cls;
+    int mode = inode_permission_bits(inode_no, &cls);
+    if (mode < 0)
     {
         return 0;
     }
-    uint16_t uid = get_current_uid();
-    uint16_t gid = get_current_gid();
 
     // root用户拥有所有权限
-    if (uid == 0)
+    if (get_current_uid() == 0)
     {
         return 1;
     }
 
-    uint16_t mode = 0;
+    // 将权限常量转换为对应的权限位
     uint16_t access_mask = 0;
-    
-    if (uid == inode.i_uid)
+    if (cls == PERM_CLASS_GROUP)
     {
-        mode = (inode.i_mode >> 6) & 0x7;
-        // 将权限常量转换为对应的权限位
-        access_mask = 0;
-        if (access & EXT2_S_IRUSR) access_mask |= 0x4;  // 读权限
-        if (access & EXT2_S_IWUSR) access_mask |= 0x2;  // 写权限
-        if (access & EXT2_S_IXUSR) access_mask |= 0x1;  // 执行权限
-    }
-    else if (gid == inode.i_gid)
-    {
-        mode = (inode.i_mode >> 3) & 0x7;
-        // 将权限常量转换为对应的权限位
-        access_mask = 0;
         if (access & EXT2_S_IRGRP) access_mask |= 0x4;  // 读权限
         if (access & EXT2_S_IWGRP) access_mask |= 0x2;  // 写权限
         if (access & EXT2_S_IXGRP) access_mask |= 0x1;  // 执行权限
     }
     else
     {
-        mode = inode.i_mode & 0x7;
-        // 将权限常量转换为对应的权限位
-        access_mask = 0;
         if (access & EXT2_S_IRUSR) access_mask |= 0x4;  // 读权限
         if (access & EXT2_S_IWUSR) access_mask |= 0x2;  // 写权限
         if (access & EXT2_S_IXUSR) access_mask |= 0x1;  // 执行权限
@@ -415,124 +1101,217 @@ int check_permission(uint32_t inode_no, int access)
 
 int change_permission(uint32_t inode_no, uint16_t mode)
 {
-    ext2_inode_t inode;
-    if (read_inode(inode_no, &inode) != 0)
+    ext2_inode_t *inode = iget(inode_no);
+    if (inode == NULL)
     {
         return -1;
     }
 
-    inode.i_mode = (inode.i_mode & 0xF000) | (mode & 0x0FFF);
-    update_ctime(inode_no);
-
-    return write_inode(inode_no, &inode);
+    inode->i_mode = (inode->i_mode & 0xF000) | (mode & 0x0FFF);
+    inode->i_ctime = time(NULL);
+    mark_inode_dirty(inode);
+    iput(inode);
+    invalidate_permission_cache(inode_no);
+    return 0;
 }
 
 int change_owner(uint32_t inode_no, uint16_t uid, uint16_t gid)
 {
-    ext2_inode_t inode;
-    if (read_inode(inode_no, &inode) != 0)
+    ext2_inode_t *inode = iget(inode_no);
+    if (inode == NULL)
     {
         return -1;
     }
 
-    inode.i_uid = uid;
-    inode.i_gid = gid;
-    update_ctime(inode_no);
-
-    return write_inode(inode_no, &inode);
+    inode->i_uid = uid;
+    inode->i_gid = gid;
+    inode->i_ctime = time(NULL);
+    mark_inode_dirty(inode);
+    iput(inode);
+    invalidate_permission_cache(inode_no);
+    return 0;
 }
 
-// 时间戳更新
+// 时间戳更新（直接修改inode缓存中的副本）
 void update_atime(uint32_t inode_no)
 {
-    ext2_inode_t inode;
-    if (read_inode(inode_no, &inode) == 0)
+    ext2_inode_t *inode = iget(inode_no);
+    if (inode != NULL)
     {
-        inode.i_atime = time(NULL);
-        write_inode(inode_no, &inode);
+        inode->i_atime = time(NULL);
+        mark_inode_dirty(inode);
+        iput(inode);
     }
 }
 
 void update_mtime(uint32_t inode_no)
 {
-    ext2_inode_t inode;
-    if (read_inode(inode_no, &inode) == 0)
+    ext2_inode_t *inode = iget(inode_no);
+    if (inode != NULL)
     {
-        inode.i_mtime = time(NULL);
-        write_inode(inode_no, &inode);
+        inode->i_mtime = time(NULL);
+        mark_inode_dirty(inode);
+        iput(inode);
     }
 }
 
 void update_ctime(uint32_t inode_no)
 {
-    ext2_inode_t inode;
-    if (read_inode(inode_no, &inode) == 0)
+    ext2_inode_t *inode = iget(inode_no);
+    if (inode != NULL)
     {
-        inode.i_ctime = time(NULL);
-        write_inode(inode_no, &inode);
+        inode->i_ctime = time(NULL);
+        mark_inode_dirty(inode);
+        iput(inode);
     }
 }
 
 // 链接计数
 int increment_link_count(uint32_t inode_no)
 {
-    ext2_inode_t inode;
-    if (read_inode(inode_no, &inode) != 0)
+    ext2_inode_t *inode = iget(inode_no);
+    if (inode == NULL)
     {
         return -1;
     }
 
-    inode.i_links_count++;
-    update_ctime(inode_no);
-
-    return write_inode(inode_no, &inode);
+    inode->i_links_count++;
+    inode->i_ctime = time(NULL);
+    mark_inode_dirty(inode);
+    iput(inode);
+    return 0;
 }
 
 int decrement_link_count(uint32_t inode_no)
 {
-    ext2_inode_t inode;
-    if (read_inode(inode_no, &inode) != 0)
+    ext2_inode_t *inode = iget(inode_no);
+    if (inode == NULL)
     {
         return -1;
     }
 
-    if (inode.i_links_count > 0)
+    if (inode->i_links_count > 0)
     {
-        inode.i_links_count--;
+        inode->i_links_count--;
     }
-    update_ctime(inode_no);
-
-    return write_inode(inode_no, &inode);
+    inode->i_ctime = time(NULL);
+    mark_inode_dirty(inode);
+    iput(inode);
+    return 0;
 }
 
-// 工具函数
+// 工具函数（只读，直接使用inode缓存中的副本避免拷贝）
 int is_directory(uint32_t inode_no)
 {
-    ext2_inode_t inode;
-    if (read_inode(inode_no, &inode) != 0)
+    const ext2_inode_t *ip = get_inode_ptr(inode_no);
+    if (ip == NULL)
     {
         return 0;
     }
-    int result = (inode.i_mode & 0xF000) == EXT2_S_IFDIR;
-    return result;
+    return (ip->i_mode & 0xF000) == EXT2_S_IFDIR;
 }
 
 int is_regular_file(uint32_t inode_no)
 {
-    ext2_inode_t inode;
-    if (read_inode(inode_no, &inode) != 0)
+    const ext2_inode_t *ip = get_inode_ptr(inode_no);
+    if (ip == NULL)
     {
         return 0;
     }
-    return (inode.i_mode & 0xF000) == EXT2_S_IFREG;
+    return (ip->i_mode & 0xF000) == EXT2_S_IFREG;
+}
+
+/*
+目录子树大小
+
+目录的子树大小是它下面（递归）所有非目录文件的字节数之和，按 64 位存放在
+i_subtree_size（低 32 位）和 i_subtree_size_hi（高 32 位）中，每个inode的 i_parent
+记录它所在的目录。文件大小变化、目录项增删时把差值沿 i_parent 一路加到根目录，
+列目录时直接读出每个子目录的大小，不用递归遍历子树。
+*/
+
+uint64_t get_subtree_size(const ext2_inode_t *ip)
+{
+    return ((uint64_t)ip->i_subtree_size_hi << 32) | ip->i_subtree_size;
+}
+
+static void set_subtree_size(ext2_inode_t *ip, uint64_t size)
+{
+    ip->i_subtree_size = (uint32_t)size;
+    ip->i_subtree_size_hi = (uint32_t)(size >> 32);
+}
+
+// inode 计入所在目录大小的字节数：目录是它的子树大小，其他文件是文件大小
+static uint64_t subtree_contribution(const ext2_inode_t *ip)
+{
+    return (ip->i_mode & 0xF000) == EXT2_S_IFDIR ? get_subtree_size(ip) : ip->i_size;
+}
+
+void adjust_subtree_size(uint32_t dir_inode, int64_t delta)
+{
+    // 限制层数，防止 i_parent 损坏成环时死循环
+    for (int depth = 0; dir_inode != 0 && delta != 0 && depth < MAX_PATH; depth++)
+    {
+        ext2_inode_t *ip = iget(dir_inode);
+        if (ip == NULL)
+        {
+            return;
+        }
+        int64_t size = (int64_t)get_subtree_size(ip) + delta;
+        set_subtree_size(ip, size < 0 ? 0 : (uint64_t)size);
+        mark_inode_dirty(ip);
+        uint32_t parent = ip->i_parent;
+        iput(ip);
+        if (dir_inode == EXT2_ROOT_INO)
+        {
+            break;
+        }
+        dir_inode = parent;
+    }
+}
+
+// 把inode挂到目录下：记录 i_parent，并把它的大小计入目录及其祖先
+void link_to_parent(uint32_t inode_no, uint32_t parent_inode)
+{
+    ext2_inode_t *ip = iget(inode_no);
+    if (ip == NULL)
+    {
+        return;
+    }
+    if (ip->i_parent == 0)
+    {
+        ip->i_parent = parent_inode;
+        mark_inode_dirty(ip);
+    }
+    uint64_t size = subtree_contribution(ip);
+    iput(ip);
+    adjust_subtree_size(parent_inode, (int64_t)size);
+}
+
+// 从目录中摘下inode：从目录及其祖先中减去它的大小
+void unlink_from_parent(uint32_t inode_no, uint32_t parent_inode)
+{
+    ext2_inode_t *ip = iget(inode_no);
+    if (ip == NULL)
+    {
+        return;
+    }
+    if (ip->i_parent == parent_inode)
+    {
+        ip->i_parent = 0;
+        mark_inode_dirty(ip);
+    }
+    uint64_t size = subtree_contribution(ip);
+    iput(ip);
+    adjust_subtree_size(parent_inode, -(int64_t)size);
 }
 
 uint32_t get_file_size(uint32_t inode_no)
 {
-    ext2_inode_t inode;
-    if (read_inode(inode_no, &inode) != 0)
+    const ext2_inode_t *ip = get_inode_ptr(inode_no);
+    if (ip == NULL)
     {
         return 0;
     }
-    return inode.i_size;
-}
\ No newline at end of file
+    return ip->i_size;
+}
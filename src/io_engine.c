@@ -0,0 +1,321 @@
+#include "../include/io_engine.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+
+// 当前使用的引擎，首次提交时按默认配置初始化
+static const io_engine_t *current_engine = NULL;
+static unsigned current_depth = IO_ENGINE_DEFAULT_DEPTH;
+
+size_t io_request_bytes(const io_request_t *req)
+{
+    size_t total = 0;
+    for (int i = 0; i < req->iovcnt; i++)
+    {
+        total += req->iov[i].iov_len;
+    }
+    return total;
+}
+
+// 同步执行一个请求，线程池和同步引擎共用
+static int execute_request(io_request_t *req)
+{
+    size_t expected = io_request_bytes(req);
+    ssize_t n;
+    do
+    {
+        if (req->op == IO_OP_READ)
+        {
+            n = preadv(req->fd, req->iov, req->iovcnt, req->offset);
+        }
+        else
+        {
+            n = pwritev(req->fd, req->iov, req->iovcnt, req->offset);
+        }
+    } while (n < 0 && errno == EINTR);
+
+    req->result = (n == (ssize_t)expected) ? 0 : -1;
+    req->done = 1;
+    return req->result;
+}
+
+/*
+同步引擎：逐个执行，不需要任何初始化
+*/
+static int sync_setup(unsigned depth)
+{
+    (void)depth;
+    return 0;
+}
+
+static int sync_submit_and_wait(io_request_t *reqs, int nr, unsigned depth)
+{
+    (void)depth;
+    int result = 0;
+    for (int i = 0; i < nr; i++)
+    {
+        if (execute_request(&reqs[i]) != 0)
+        {
+            result = -1;
+        }
+    }
+    return result;
+}
+
+static void sync_teardown(void)
+{
+}
+
+const io_engine_t sync_engine = {
+    "sync", sync_setup, sync_submit_and_wait, sync_teardown
+};
+
+/*
+线程池引擎：工作线程从共享的请求批次中领取请求，
+同时在途的请求数等于工作线程数（不超过 depth）。
+*/
+static pthread_t pool_threads[IO_ENGINE_MAX_THREADS];
+static int pool_nthreads = 0;
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_work_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t pool_done_cond = PTHREAD_COND_INITIALIZER;
+static io_request_t *pool_reqs = NULL;  // 当前批次
+static int pool_nr = 0;
+static int pool_next = 0;               // 下一个待领取的请求
+static int pool_done = 0;               // 已完成的请求数
+static int pool_shutdown = 0;
+
+static void *pool_worker(void *arg)
+{
+    (void)arg;
+    pthread_mutex_lock(&pool_lock);
+    while (1)
+    {
+        while (!pool_shutdown && (pool_reqs == NULL || pool_next >= pool_nr))
+        {
+            pthread_cond_wait(&pool_work_cond, &pool_lock);
+        }
+        if (pool_shutdown)
+        {
+            break;
+        }
+
+        io_request_t *req = &pool_reqs[pool_next++];
+        pthread_mutex_unlock(&pool_lock);
+        execute_request(req);
+        pthread_mutex_lock(&pool_lock);
+
+        if (++pool_done == pool_nr)
+        {
+            pthread_cond_signal(&pool_done_cond);
+        }
+    }
+    pthread_mutex_unlock(&pool_lock);
+    return NULL;
+}
+
+static void threadpool_teardown(void)
+{
+    pthread_mutex_lock(&pool_lock);
+    pool_shutdown = 1;
+    pthread_cond_broadcast(&pool_work_cond);
+    pthread_mutex_unlock(&pool_lock);
+
+    for (int i = 0; i < pool_nthreads; i++)
+    {
+        pthread_join(pool_threads[i], NULL);
+    }
+    pool_nthreads = 0;
+    pool_shutdown = 0;
+}
+
+static int threadpool_setup(unsigned depth)
+{
+    int nthreads = depth < IO_ENGINE_MAX_THREADS ? (int)depth : IO_ENGINE_MAX_THREADS;
+    if (nthreads < 1)
+    {
+        nthreads = 1;
+    }
+
+    for (int i = 0; i < nthreads; i++)
+    {
+        if (pthread_create(&pool_threads[i], NULL, pool_worker, NULL) != 0)
+        {
+            threadpool_teardown();
+            return -1;
+        }
+        pool_nthreads++;
+    }
+    return 0;
+}
+
+static int threadpool_submit_and_wait(io_request_t *reqs, int nr, unsigned depth)
+{
+    (void)depth;
+    if (nr <= 0)
+    {
+        return 0;
+    }
+
+    pthread_mutex_lock(&pool_lock);
+    pool_reqs = reqs;
+    pool_nr = nr;
+    pool_next = 0;
+    pool_done = 0;
+    pthread_cond_broadcast(&pool_work_cond);
+    while (pool_done < pool_nr)
+    {
+        pthread_cond_wait(&pool_done_cond, &pool_lock);
+    }
+    pool_reqs = NULL;
+    pool_nr = 0;
+    pthread_mutex_unlock(&pool_lock);
+
+    for (int i = 0; i < nr; i++)
+    {
+        if (reqs[i].result != 0)
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+const io_engine_t threadpool_engine = {
+    "threads", threadpool_setup, threadpool_submit_and_wait, threadpool_teardown
+};
+
+// 引擎选择
+int io_engine_init(const char *name, unsigned depth)
+{
+    io_engine_shutdown();
+
+    if (depth == 0)
+    {
+        depth = IO_ENGINE_DEFAULT_DEPTH;
+    }
+    if (depth > IO_ENGINE_MAX_DEPTH)
+    {
+        depth = IO_ENGINE_MAX_DEPTH;
+    }
+
+    const io_engine_t *candidates[3];
+    int count = 0;
+    if (name == NULL || strcmp(name, "auto") == 0)
+    {
+        candidates[count++] = &io_uring_engine;
+        candidates[count++] = &threadpool_engine;
+    }
+    else if (strcmp(name, "uring") == 0 || strcmp(name, "io_uring") == 0)
+    {
+        candidates[count++] = &io_uring_engine;
+        candidates[count++] = &threadpool_engine;
+    }
+    else if (strcmp(name, "threads") == 0)
+    {
+        candidates[count++] = &threadpool_engine;
+    }
+    else if (strcmp(name, "sync") != 0)
+    {
+        return -1;
+    }
+    candidates[count++] = &sync_engine;
+
+    for (int i = 0; i < count; i++)
+    {
+        if (candidates[i]->setup(depth) == 0)
+        {
+            current_engine = candidates[i];
+            current_depth = depth;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+void io_engine_shutdown(void)
+{
+    if (current_engine != NULL)
+    {
+        current_engine->teardown();
+        current_engine = NULL;
+    }
+}
+
+const char *io_engine_name(void)
+{
+    return current_engine ? current_engine->name : "none";
+}
+
+unsigned io_engine_depth(void)
+{
+    return current_depth;
+}
+
+int io_engine_submit(io_request_t *reqs, int nr)
+{
+    if (current_engine == NULL && io_engine_init(NULL, current_depth) != 0)
+    {
+        return -1;
+    }
+    for (int i = 0; i < nr; i++)
+    {
+        reqs[i].done = 0;
+    }
+    int ret = current_engine->submit_and_wait(reqs, nr, current_depth);
+    if (ret != IO_ENGINE_BROKEN)
+    {
+        return ret;
+    }
+
+    // 引擎坏了：换成线程池，把没完成的请求挑出来重做（按偏移读写，重做是安全的）
+    printf("Warning: I/O engine %s failed, falling back to threads\n", current_engine->name);
+    if (io_engine_init("threads", current_depth) != 0)
+    {
+        return -1;
+    }
+    int pending = 0;
+    for (int i = 0; i < nr; i++)
+    {
+        if (!reqs[i].done)
+        {
+            pending++;
+        }
+    }
+    io_request_t *redo = pending > 0 ? malloc(pending * sizeof(io_request_t)) : NULL;
+    if (pending > 0 && redo == NULL)
+    {
+        return -1;
+    }
+    int n = 0;
+    for (int i = 0; i < nr; i++)
+    {
+        if (!reqs[i].done)
+        {
+            redo[n++] = reqs[i];
+        }
+    }
+    if (pending > 0)
+    {
+        current_engine->submit_and_wait(redo, pending, current_depth);
+    }
+
+    int result = 0;
+    n = 0;
+    for (int i = 0; i < nr; i++)
+    {
+        if (!reqs[i].done)
+        {
+            reqs[i] = redo[n++];
+        }
+        if (reqs[i].result != 0)
+        {
+            result = -1;
+        }
+    }
+    free(redo);
+    return result;
+}
@@ -0,0 +1,253 @@
+#include "../include/io_engine.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+/*
+io_uring 引擎
+
+直接使用 io_uring_setup/io_uring_enter 系统调用和共享内存环：
+- 提交队列（SQ）：填好 SQE 后推进 sq_tail，由 io_uring_enter 通知内核
+- 完成队列（CQ）：内核推进 cq_tail，用户态消费后推进 cq_head
+一次 io_uring_enter 可以同时提交多个请求并等待至少一个完成，
+批次中始终保持最多 depth 个请求在途。
+*/
+
+static int ring_fd = -1;
+static unsigned ring_entries = 0;
+
+static void *sq_ring_ptr = NULL;
+static size_t sq_ring_size = 0;
+static void *cq_ring_ptr = NULL;
+static size_t cq_ring_size = 0;
+static struct io_uring_sqe *sqes = NULL;
+static size_t sqes_size = 0;
+
+static unsigned *sq_head;
+static unsigned *sq_tail;
+static unsigned *sq_mask;
+static unsigned *sq_array;
+static unsigned *cq_head;
+static unsigned *cq_tail;
+static unsigned *cq_mask;
+static struct io_uring_cqe *cqes;
+
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params *p)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static void uring_teardown(void)
+{
+    if (sqes != NULL)
+    {
+        munmap(sqes, sqes_size);
+        sqes = NULL;
+    }
+    if (cq_ring_ptr != NULL && cq_ring_ptr != sq_ring_ptr)
+    {
+        munmap(cq_ring_ptr, cq_ring_size);
+    }
+    cq_ring_ptr = NULL;
+    if (sq_ring_ptr != NULL)
+    {
+        munmap(sq_ring_ptr, sq_ring_size);
+        sq_ring_ptr = NULL;
+    }
+    if (ring_fd != -1)
+    {
+        close(ring_fd);
+        ring_fd = -1;
+    }
+    ring_entries = 0;
+}
+
+static int uring_setup(unsigned depth)
+{
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+
+    ring_fd = sys_io_uring_setup(depth, &p);
+    if (ring_fd < 0)
+    {
+        ring_fd = -1;
+        return -1;
+    }
+    ring_entries = p.sq_entries;
+
+    sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    // 新内核中 SQ 和 CQ 可以共用一次映射
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        if (cq_ring_size > sq_ring_size)
+        {
+            sq_ring_size = cq_ring_size;
+        }
+        cq_ring_size = sq_ring_size;
+    }
+
+    sq_ring_ptr = mmap(NULL, sq_ring_size, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+    if (sq_ring_ptr == MAP_FAILED)
+    {
+        sq_ring_ptr = NULL;
+        uring_teardown();
+        return -1;
+    }
+
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        cq_ring_ptr = sq_ring_ptr;
+    }
+    else
+    {
+        cq_ring_ptr = mmap(NULL, cq_ring_size, PROT_READ | PROT_WRITE,
+                           MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+        if (cq_ring_ptr == MAP_FAILED)
+        {
+            cq_ring_ptr = NULL;
+            uring_teardown();
+            return -1;
+        }
+    }
+
+    sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    sqes = mmap(NULL, sqes_size, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED)
+    {
+        sqes = NULL;
+        uring_teardown();
+        return -1;
+    }
+
+    uint8_t *sq = sq_ring_ptr;
+    uint8_t *cq = cq_ring_ptr;
+    sq_head = (unsigned *)(sq + p.sq_off.head);
+    sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+    sq_array = (unsigned *)(sq + p.sq_off.array);
+    cq_head = (unsigned *)(cq + p.cq_off.head);
+    cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+    cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    return 0;
+}
+
+// 把一个请求放入提交队列（调用者保证队列未满）
+static void uring_queue(io_request_t *req, unsigned index)
+{
+    unsigned tail = *sq_tail;
+    unsigned slot = tail & *sq_mask;
+    struct io_uring_sqe *sqe = &sqes[slot];
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = req->op == IO_OP_READ ? IORING_OP_READV : IORING_OP_WRITEV;
+    sqe->fd = req->fd;
+    sqe->off = (uint64_t)req->offset;
+    sqe->addr = (uint64_t)(uintptr_t)req->iov;
+    sqe->len = (unsigned)req->iovcnt;
+    sqe->user_data = index;
+
+    sq_array[slot] = slot;
+    __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+// 消费完成队列，返回本次收割的请求数；有请求失败时置 *failed
+static unsigned uring_reap(io_request_t *reqs, int *failed)
+{
+    unsigned reaped = 0;
+    unsigned head = *cq_head;
+    unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+    while (head != tail)
+    {
+        struct io_uring_cqe *cqe = &cqes[head & *cq_mask];
+        io_request_t *req = &reqs[cqe->user_data];
+        req->result = (cqe->res >= 0 && (size_t)cqe->res == io_request_bytes(req)) ? 0 : -1;
+        req->done = 1;
+        if (req->result != 0)
+        {
+            *failed = 1;
+        }
+        head++;
+        reaped++;
+    }
+    __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+    return reaped;
+}
+
+static int uring_submit_and_wait(io_request_t *reqs, int nr, unsigned depth)
+{
+    if (depth > ring_entries)
+    {
+        depth = ring_entries;
+    }
+
+    int next = 0;        // 下一个要入队的请求
+    int completed = 0;
+    unsigned inflight = 0;
+    unsigned unsubmitted = 0;  // 已入队但内核尚未接收的 SQE
+    int failed = 0;
+
+    while (completed < nr)
+    {
+        while (next < nr && inflight < depth)
+        {
+            uring_queue(&reqs[next], (unsigned)next);
+            next++;
+            inflight++;
+            unsubmitted++;
+        }
+
+        int ret = sys_io_uring_enter(ring_fd, unsubmitted, 1, IORING_ENTER_GETEVENTS);
+        if (ret < 0)
+        {
+            if (errno == EINTR || errno == EAGAIN || errno == EBUSY)
+            {
+                continue;
+            }
+            break;
+        }
+        unsubmitted -= (unsigned)ret;
+
+        unsigned reaped = uring_reap(reqs, &failed);
+        inflight -= reaped;
+        completed += (int)reaped;
+    }
+    if (completed == nr)
+    {
+        return failed ? -1 : 0;
+    }
+
+    /*
+    环已不可用。内核已接收的请求还可能在读写调用者的缓冲区，
+    先只收割不提交，等它们结束后再拆掉环；
+    收割也失败时直接关闭环，由内核取消剩余请求。
+    */
+    while (inflight > unsubmitted)
+    {
+        int ret = sys_io_uring_enter(ring_fd, 0, 1, IORING_ENTER_GETEVENTS);
+        if (ret < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY)
+        {
+            break;
+        }
+        inflight -= uring_reap(reqs, &failed);
+    }
+    uring_teardown();
+    return IO_ENGINE_BROKEN;
+}
+
+const io_engine_t io_uring_engine = {
+    "io_uring", uring_setup, uring_submit_and_wait, uring_teardown
+};
@@ -0,0 +1,547 @@
+#include "../include/journal.h"
+#include "../include/ext2.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+// 运行时状态
+static int journal_fd = -1;
+static uint32_t journal_first = 0;    // 日志区第一个块（日志超级块）
+static uint32_t journal_blocks = 0;   // 日志区块数
+static uint32_t journal_head = 1;     // 下一个事务写在日志区的第几块
+static uint32_t journal_sequence = 1; // 下一个事务的序号
+static int journal_open = 0;          // 日志超级块已标记为非空（s_start != 0）
+static journal_stats_t journal_stats;
+
+/*
+已记录块的集合：日志中（自上次检查点以来）有内容的块号，释放这些块时需要记撤销。
+开放寻址哈希表，容量是日志区块数的两倍以上，不会填满。
+*/
+#define LOGGED_EMPTY 0xFFFFFFFFu
+static uint32_t *logged = NULL;
+static uint32_t logged_size = 0;
+
+// 正在运行的事务中的撤销记录
+static uint32_t *revokes = NULL;
+static uint32_t nr_revoke = 0;
+static uint32_t revoke_capacity = 0;
+
+static uint32_t crc_table[256];
+static int crc_ready = 0;
+
+static uint32_t journal_crc32(uint32_t crc, const uint8_t *data, size_t len)
+{
+    if (!crc_ready)
+    {
+        for (uint32_t i = 0; i < 256; i++)
+        {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++)
+            {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            crc_table[i] = c;
+        }
+        crc_ready = 1;
+    }
+    crc = ~crc;
+    for (size_t i = 0; i < len; i++)
+    {
+        crc = crc_table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+static int pread_full(int fd, void *buffer, size_t len, off_t offset)
+{
+    uint8_t *p = buffer;
+    while (len > 0)
+    {
+        ssize_t n = pread(fd, p, len, offset);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return -1;
+        }
+        p += n;
+        len -= n;
+        offset += n;
+    }
+    return 0;
+}
+
+static int pwrite_full(int fd, const void *buffer, size_t len, off_t offset)
+{
+    const uint8_t *p = buffer;
+    while (len > 0)
+    {
+        ssize_t n = pwrite(fd, p, len, offset);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return -1;
+        }
+        p += n;
+        len -= n;
+        offset += n;
+    }
+    return 0;
+}
+
+// 日志区第 index 块在镜像中的偏移
+static off_t journal_offset(uint32_t first_block, uint32_t index)
+{
+    return (off_t)(first_block + index) * BLOCK_SIZE;
+}
+
+// 描述符需要的块数
+static uint32_t descriptor_blocks(uint32_t entries)
+{
+    size_t bytes = sizeof(journal_descriptor_t) + (size_t)entries * sizeof(uint32_t);
+    return (bytes + BLOCK_SIZE - 1) / BLOCK_SIZE;
+}
+
+void journal_format_superblock(void *block, uint32_t nblocks)
+{
+    journal_superblock_t *jsb = block;
+    memset(block, 0, BLOCK_SIZE);
+    jsb->s_header.h_magic = JOURNAL_MAGIC;
+    jsb->s_header.h_blocktype = JOURNAL_SUPERBLOCK;
+    jsb->s_blocks = nblocks;
+    jsb->s_sequence = 1;
+    jsb->s_start = 0;
+}
+
+static int read_journal_superblock(int fd, uint32_t first_block, uint32_t nblocks, journal_superblock_t *jsb)
+{
+    uint8_t buffer[BLOCK_SIZE];
+    if (pread_full(fd, buffer, BLOCK_SIZE, journal_offset(first_block, 0)) != 0)
+    {
+        return -1;
+    }
+    memcpy(jsb, buffer, sizeof(*jsb));
+    if (jsb->s_header.h_magic != JOURNAL_MAGIC || jsb->s_header.h_blocktype != JOURNAL_SUPERBLOCK ||
+        jsb->s_blocks != nblocks || jsb->s_start >= nblocks)
+    {
+        printf("Error: Invalid journal superblock\n");
+        return -1;
+    }
+    return 0;
+}
+
+static int write_journal_superblock(int fd, uint32_t first_block, uint32_t nblocks, uint32_t sequence, uint32_t start)
+{
+    uint8_t buffer[BLOCK_SIZE];
+    journal_format_superblock(buffer, nblocks);
+    journal_superblock_t *jsb = (journal_superblock_t *)buffer;
+    jsb->s_sequence = sequence;
+    jsb->s_start = start;
+    return pwrite_full(fd, buffer, BLOCK_SIZE, journal_offset(first_block, 0));
+}
+
+/*
+读出日志区 pos 处序号为 sequence 的事务（描述符块和元数据块读进 *buffer），
+校验描述符、提交块和校验和，完整时返回 0 并填好 *desc，否则返回 -1（日志到此结束）
+*/
+static int read_transaction(int fd, uint32_t first_block, uint32_t nblocks, uint32_t fs_blocks,
+                            uint32_t pos, uint32_t sequence, uint8_t **buffer, journal_descriptor_t *desc)
+{
+    uint8_t block[BLOCK_SIZE];
+    if (pos + 2 > nblocks || pread_full(fd, block, BLOCK_SIZE, journal_offset(first_block, pos)) != 0)
+    {
+        return -1;
+    }
+    memcpy(desc, block, sizeof(*desc));
+    if (desc->d_header.h_magic != JOURNAL_MAGIC || desc->d_header.h_blocktype != JOURNAL_DESCRIPTOR_BLOCK ||
+        desc->d_header.h_sequence != sequence || desc->d_desc_blocks == 0 ||
+        desc->d_nr_blocks > nblocks || desc->d_nr_revoke > fs_blocks ||
+        descriptor_blocks(desc->d_nr_blocks + desc->d_nr_revoke) != desc->d_desc_blocks ||
+        (uint64_t)pos + desc->d_desc_blocks + desc->d_nr_blocks + 1 > nblocks)
+    {
+        return -1;
+    }
+
+    uint32_t body = desc->d_desc_blocks + desc->d_nr_blocks;
+    uint8_t *data = malloc((size_t)body * BLOCK_SIZE);
+    if (data == NULL || pread_full(fd, data, (size_t)body * BLOCK_SIZE, journal_offset(first_block, pos)) != 0 ||
+        pread_full(fd, block, BLOCK_SIZE, journal_offset(first_block, pos + body)) != 0)
+    {
+        free(data);
+        return -1;
+    }
+
+    const journal_commit_t *commit = (const journal_commit_t *)block;
+    if (commit->c_header.h_magic != JOURNAL_MAGIC || commit->c_header.h_blocktype != JOURNAL_COMMIT_BLOCK ||
+        commit->c_header.h_sequence != sequence ||
+        commit->c_checksum != journal_crc32(0, data, (size_t)body * BLOCK_SIZE))
+    {
+        free(data);
+        return -1;
+    }
+
+    // 目标块必须在镜像内且不在日志区里
+    const uint32_t *entries = (const uint32_t *)(data + sizeof(journal_descriptor_t));
+    for (uint32_t i = 0; i < desc->d_nr_blocks + desc->d_nr_revoke; i++)
+    {
+        if (entries[i] >= fs_blocks || (entries[i] >= first_block && entries[i] < first_block + nblocks))
+        {
+            free(data);
+            return -1;
+        }
+    }
+    *buffer = data;
+    return 0;
+}
+
+typedef struct {
+    uint32_t block_no;
+    uint32_t sequence;            // 撤销所在的最大事务序号
+} revoke_entry_t;
+
+static int compare_revoke(const void *a, const void *b)
+{
+    uint32_t x = ((const revoke_entry_t *)a)->block_no;
+    uint32_t y = ((const revoke_entry_t *)b)->block_no;
+    return (x > y) - (x < y);
+}
+
+// 块是否被序号不小于 sequence 的事务撤销
+static int is_revoked(const revoke_entry_t *table, uint32_t n, uint32_t block_no, uint32_t sequence)
+{
+    revoke_entry_t key = { block_no, 0 };
+    const revoke_entry_t *e = bsearch(&key, table, n, sizeof(revoke_entry_t), compare_revoke);
+    return e != NULL && e->sequence >= sequence;
+}
+
+/*
+重放日志：第一遍扫描出所有完整的事务并收集撤销记录，第二遍按顺序把各块写回原位置，
+然后 fdatasync，并把日志标记为空。
+*/
+int journal_recover(int fd, uint32_t first_block, uint32_t nblocks, uint32_t fs_blocks)
+{
+    journal_superblock_t jsb;
+    if (read_journal_superblock(fd, first_block, nblocks, &jsb) != 0)
+    {
+        return -1;
+    }
+    if (jsb.s_start == 0)
+    {
+        return 0;
+    }
+
+    revoke_entry_t *table = NULL;
+    uint32_t nr_table = 0, table_capacity = 0;
+    uint32_t pos = jsb.s_start, sequence = jsb.s_sequence, count = 0;
+    uint8_t *data;
+    journal_descriptor_t desc;
+    while (read_transaction(fd, first_block, nblocks, fs_blocks, pos, sequence, &data, &desc) == 0)
+    {
+        const uint32_t *entries = (const uint32_t *)(data + sizeof(journal_descriptor_t));
+        for (uint32_t i = 0; i < desc.d_nr_revoke; i++)
+        {
+            if (nr_table == table_capacity)
+            {
+                uint32_t capacity = table_capacity ? table_capacity * 2 : 64;
+                revoke_entry_t *grown = realloc(table, capacity * sizeof(revoke_entry_t));
+                if (grown == NULL)
+                {
+                    free(data);
+                    free(table);
+                    return -1;
+                }
+                table = grown;
+                table_capacity = capacity;
+            }
+            table[nr_table].block_no = entries[desc.d_nr_blocks + i];
+            table[nr_table].sequence = sequence;
+            nr_table++;
+        }
+        free(data);
+        pos += desc.d_desc_blocks + desc.d_nr_blocks + 1;
+        sequence++;
+        count++;
+    }
+
+    // 同一块的多条撤销只保留最大的序号
+    qsort(table, nr_table, sizeof(revoke_entry_t), compare_revoke);
+    uint32_t unique = 0;
+    for (uint32_t i = 0; i < nr_table; i++)
+    {
+        if (unique > 0 && table[unique - 1].block_no == table[i].block_no)
+        {
+            if (table[i].sequence > table[unique - 1].sequence)
+            {
+                table[unique - 1].sequence = table[i].sequence;
+            }
+            continue;
+        }
+        table[unique++] = table[i];
+    }
+
+    int result = 0;
+    uint32_t replayed = 0;
+    pos = jsb.s_start;
+    for (uint32_t t = 0; t < count && result == 0; t++)
+    {
+        uint32_t seq = jsb.s_sequence + t;
+        if (read_transaction(fd, first_block, nblocks, fs_blocks, pos, seq, &data, &desc) != 0)
+        {
+            result = -1;
+            break;
+        }
+        const uint32_t *entries = (const uint32_t *)(data + sizeof(journal_descriptor_t));
+        const uint8_t *blocks = data + (size_t)desc.d_desc_blocks * BLOCK_SIZE;
+        for (uint32_t i = 0; i < desc.d_nr_blocks; i++)
+        {
+            if (is_revoked(table, unique, entries[i], seq))
+            {
+                continue;
+            }
+            if (pwrite_full(fd, blocks + (size_t)i * BLOCK_SIZE, BLOCK_SIZE, (off_t)entries[i] * BLOCK_SIZE) != 0)
+            {
+                result = -1;
+                break;
+            }
+            replayed++;
+        }
+        free(data);
+        pos += desc.d_desc_blocks + desc.d_nr_blocks + 1;
+    }
+    free(table);
+
+    if (result != 0 || fdatasync(fd) != 0 ||
+        write_journal_superblock(fd, first_block, nblocks, sequence, 0) != 0 || fdatasync(fd) != 0)
+    {
+        printf("Error: Journal recovery failed\n");
+        return -1;
+    }
+    printf("Journal recovered: %u transactions, %u blocks replayed\n", count, replayed);
+    return (int)count;
+}
+
+int journal_load(int fd, uint32_t first_block, uint32_t nblocks)
+{
+    journal_superblock_t jsb;
+    if (read_journal_superblock(fd, first_block, nblocks, &jsb) != 0)
+    {
+        return -1;
+    }
+
+    journal_unload();
+    logged_size = 1;
+    while (logged_size < nblocks * 2)
+    {
+        logged_size <<= 1;
+    }
+    logged = malloc(logged_size * sizeof(uint32_t));
+    if (logged == NULL)
+    {
+        logged_size = 0;
+        return -1;
+    }
+    memset(logged, 0xFF, logged_size * sizeof(uint32_t));
+
+    journal_fd = fd;
+    journal_first = first_block;
+    journal_blocks = nblocks;
+    journal_head = 1;
+    journal_sequence = jsb.s_sequence;
+    journal_open = jsb.s_start != 0;
+    memset(&journal_stats, 0, sizeof(journal_stats));
+    return 0;
+}
+
+void journal_unload(void)
+{
+    free(logged);
+    free(revokes);
+    logged = NULL;
+    logged_size = 0;
+    revokes = NULL;
+    nr_revoke = 0;
+    revoke_capacity = 0;
+    journal_fd = -1;
+    journal_first = 0;
+    journal_blocks = 0;
+}
+
+int journal_is_loaded(void)
+{
+    return journal_fd != -1;
+}
+
+uint32_t journal_get_blocks(void)
+{
+    return journal_blocks;
+}
+
+static uint32_t logged_slot(uint32_t block_no)
+{
+    uint32_t h = (block_no * 2654435761u) & (logged_size - 1);
+    while (logged[h] != LOGGED_EMPTY && logged[h] != block_no)
+    {
+        h = (h + 1) & (logged_size - 1);
+    }
+    return h;
+}
+
+int journal_is_logged(uint32_t block_no)
+{
+    return logged != NULL && logged[logged_slot(block_no)] == block_no;
+}
+
+int journal_revoke(uint32_t block_no)
+{
+    if (!journal_is_loaded())
+    {
+        return 0;
+    }
+    if (nr_revoke == revoke_capacity)
+    {
+        uint32_t capacity = revoke_capacity ? revoke_capacity * 2 : 64;
+        uint32_t *grown = realloc(revokes, capacity * sizeof(uint32_t));
+        if (grown == NULL)
+        {
+            return -1;
+        }
+        revokes = grown;
+        revoke_capacity = capacity;
+    }
+    revokes[nr_revoke++] = block_no;
+    return 0;
+}
+
+// 块在撤销之后又作为元数据写进同一个事务，撤销作废
+void journal_cancel_revoke(uint32_t block_no)
+{
+    for (uint32_t i = 0; i < nr_revoke; i++)
+    {
+        if (revokes[i] == block_no)
+        {
+            revokes[i] = revokes[--nr_revoke];
+            return;
+        }
+    }
+}
+
+int journal_has_revokes(void)
+{
+    return nr_revoke > 0;
+}
+
+/*
+把一个事务追加到日志：描述符块、count 个元数据块和提交块拼成一段连续的缓冲区，一次写入再 fdatasync。
+日志剩余空间不够时返回 JOURNAL_FULL，由调用者做检查点后调用 journal_reset 再重试。
+*/
+int journal_write_transaction(const uint32_t *blocks, uint8_t *const *data, uint32_t count)
+{
+    if (!journal_is_loaded())
+    {
+        return -1;
+    }
+
+    uint32_t ndesc = descriptor_blocks(count + nr_revoke);
+    uint32_t total = ndesc + count + 1;
+    if (journal_head + total > journal_blocks)
+    {
+        return journal_head == 1 ? -1 : JOURNAL_FULL;
+    }
+
+    uint8_t *buffer = calloc(total, BLOCK_SIZE);
+    if (buffer == NULL)
+    {
+        return -1;
+    }
+    journal_descriptor_t *desc = (journal_descriptor_t *)buffer;
+    desc->d_header.h_magic = JOURNAL_MAGIC;
+    desc->d_header.h_blocktype = JOURNAL_DESCRIPTOR_BLOCK;
+    desc->d_header.h_sequence = journal_sequence;
+    desc->d_desc_blocks = ndesc;
+    desc->d_nr_blocks = count;
+    desc->d_nr_revoke = nr_revoke;
+    uint32_t *entries = (uint32_t *)(buffer + sizeof(journal_descriptor_t));
+    memcpy(entries, blocks, count * sizeof(uint32_t));
+    if (nr_revoke > 0)
+    {
+        memcpy(entries + count, revokes, nr_revoke * sizeof(uint32_t));
+    }
+    for (uint32_t i = 0; i < count; i++)
+    {
+        memcpy(buffer + (size_t)(ndesc + i) * BLOCK_SIZE, data[i], BLOCK_SIZE);
+    }
+
+    journal_commit_t *commit = (journal_commit_t *)(buffer + (size_t)(ndesc + count) * BLOCK_SIZE);
+    commit->c_header.h_magic = JOURNAL_MAGIC;
+    commit->c_header.h_blocktype = JOURNAL_COMMIT_BLOCK;
+    commit->c_header.h_sequence = journal_sequence;
+    commit->c_checksum = journal_crc32(0, buffer, (size_t)(ndesc + count) * BLOCK_SIZE);
+
+    // 日志为空时先把日志超级块标记为从第 1 块开始，和事务在同一次 fdatasync 中落盘
+    int result = 0;
+    if (!journal_open)
+    {
+        result = write_journal_superblock(journal_fd, journal_first, journal_blocks, journal_sequence, 1);
+    }
+    if (result == 0)
+    {
+        result = pwrite_full(journal_fd, buffer, (size_t)total * BLOCK_SIZE, journal_offset(journal_first, journal_head));
+    }
+    if (result == 0)
+    {
+        result = fdatasync(journal_fd);
+    }
+    free(buffer);
+    if (result != 0)
+    {
+        return -1;
+    }
+
+    journal_open = 1;
+    journal_head += total;
+    journal_sequence++;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        logged[logged_slot(blocks[i])] = blocks[i];
+    }
+    journal_stats.commits++;
+    journal_stats.blocks_logged += count;
+    journal_stats.revokes += nr_revoke;
+    nr_revoke = 0;
+    return 0;
+}
+
+/*
+清空日志：调用者已经把所有已提交的块写回原位置并 fdatasync（检查点或卸载）。
+日志超级块标记为空后 fdatasync，之后的事务从日志区第 1 块重新开始，撤销记录也不再需要。
+*/
+int journal_reset(void)
+{
+    if (!journal_is_loaded())
+    {
+        return 0;
+    }
+    if (write_journal_superblock(journal_fd, journal_first, journal_blocks, journal_sequence, 0) != 0 ||
+        fdatasync(journal_fd) != 0)
+    {
+        return -1;
+    }
+    journal_open = 0;
+    journal_head = 1;
+    memset(logged, 0xFF, logged_size * sizeof(uint32_t));
+    nr_revoke = 0;
+    journal_stats.checkpoints++;
+    return 0;
+}
+
+void journal_get_stats(journal_stats_t *stats)
+{
+    *stats = journal_stats;
+}
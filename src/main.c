@@ -25,7 +25,7 @@ int main(int argc, char *argv[]) {
     srand(time(NULL));
     
     // 初始化文件系统
-    if (ext2_init(NULL) != 0) {
+    if (ext2_init(NULL, NULL) != 0) {
         printf("Error: Failed to initialize file system\n");
         return 1;
     }
@@ -14,16 +14,29 @@ extern ext2_fs_t fs;
 // 当前工作目录 inode 号
 static uint32_t current_working_directory_inode = EXT2_ROOT_INO;
 
-#define USER_BLOCK_NO 4 // 用户信息存储在第4号块
-
-// 保存用户信息到磁盘
+// 保存用户信息到磁盘（格式化时预留的用户表块）
 void save_users_to_disk() {
-    write_block(USER_BLOCK_NO, fs.users);
+    if (fs.superblock.s_users_block == 0) {
+        return;
+    }
+    uint8_t buffer[USERS_BLOCKS * BLOCK_SIZE];
+    memset(buffer, 0, sizeof(buffer));
+    memcpy(buffer, fs.users, sizeof(fs.users));
+    // 逐块经过块缓存写入，这样用户表和其他元数据一起记进日志
+    for (uint32_t i = 0; i < USERS_BLOCKS; i++) {
+        write_block(fs.superblock.s_users_block + i, buffer + i * BLOCK_SIZE);
+    }
 }
 
-// 从磁盘加载用户信息
+// 从磁盘加载用户信息，未挂载时什么也不做
 void load_users_from_disk() {
-    read_block(USER_BLOCK_NO, fs.users);
+    if (fs.superblock.s_users_block == 0) {
+        return;
+    }
+    uint8_t buffer[USERS_BLOCKS * BLOCK_SIZE];
+    if (read_blocks(fs.superblock.s_users_block, USERS_BLOCKS, buffer) == 0) {
+        memcpy(fs.users, buffer, sizeof(fs.users));
+    }
 }
 
 uint32_t get_cwd_inode() {
@@ -213,32 +226,25 @@ int is_logged_in(void) {
     return fs.current_user != -1;
 }
 
-// 权限检查
+// 权限检查（权限类别和 rwx 位来自 inode_permission_bits 的缓存）
 int check_file_permission(uint32_t inode_no, int access) {
-    ext2_inode_t inode;
-    if (read_inode(inode_no, &inode) != 0) {
+    int cls;
+    int mode = inode_permission_bits(inode_no, &cls);
+    if (mode < 0) {
         return 0;
     }
     
-    uint16_t uid = get_current_uid();
-    uint16_t gid = get_current_gid();
-    
     // root用户有所有权限
-    if (uid == 0) {
+    if (get_current_uid() == 0) {
         return 1;
     }
     
-    uint16_t mode = 0;
     uint16_t access_mask = 0;
-    
-    if (uid == inode.i_uid) {
-        mode = (inode.i_mode >> 6) & 0x7;
+    if (cls == PERM_CLASS_OWNER) {
         access_mask = (access >> 6) & 0x7;
-    } else if (gid == inode.i_gid) {
-        mode = (inode.i_mode >> 3) & 0x7;
+    } else if (cls == PERM_CLASS_GROUP) {
         access_mask = (access >> 3) & 0x7;
     } else {
-        mode = inode.i_mode & 0x7;
         access_mask = access & 0x7;
     }
     
@@ -250,12 +256,19 @@ int check_directory_permission(uint32_t inode_no, int access) {
     return check_file_permission(inode_no, access);
 }
 
-// 检查路径权限（包括路径上的所有目录）
-int check_path_permission(const char *path, int access) {
-    uint16_t uid = get_current_uid();
+/*
+沿路径逐级解析并检查权限，只走一遍：检查一级目录的执行权限后立即在其中查找下一级。
+*inode_no 返回解析到的目标inode（路径不存在或是相对路径时为0），调用者不必再 path_to_inode。
+*/
+int resolve_path_permission(const char *path, int access, uint32_t *inode_no) {
+    *inode_no = 0;
     
-    // root用户有所有权限
-    if (uid == 0) {
+    // root用户有所有权限，只解析路径
+    if (get_current_uid() == 0) {
+        uint32_t target;
+        if (path_to_inode(path, &target) == 0) {
+            *inode_no = target;
+        }
         return 1;
     }
     
@@ -271,24 +284,10 @@ int check_path_permission(const char *path, int access) {
     char *token = strtok(path_copy, "/");
     
     while (token != NULL) {
-        // 检查当前目录的访问权限
-        
-        // 根据当前用户类型选择正确的执行权限位
-        int execute_permission;
-        ext2_inode_t inode;
-        if (read_inode(current_inode, &inode) == 0) {
-            if (uid == inode.i_uid) {
-                execute_permission = EXT2_S_IXUSR;
-            } else if (get_current_gid() == inode.i_gid) {
-                execute_permission = EXT2_S_IXGRP;
-            } else {
-                execute_permission = EXT2_S_IXOTH;
-            }
-        } else {
-            execute_permission = EXT2_S_IXOTH; // 默认使用其他用户权限
-        }
-        
-        if (!check_directory_permission(current_inode, execute_permission)) {
+        // 检查当前目录对当前用户所属类别的执行权限
+        int cls;
+        int bits = inode_permission_bits(current_inode, &cls);
+        if (bits < 0 || !(bits & 0x1)) {
             return 0; // 没有执行权限
         }
         
@@ -307,17 +306,36 @@ int check_path_permission(const char *path, int access) {
     }
     
     // 检查最终目标的权限
-    return check_file_permission(current_inode, access);
+    if (!check_file_permission(current_inode, access)) {
+        return 0;
+    }
+    if (path[0] == '/') {
+        *inode_no = current_inode;
+    }
+    return 1;
+}
+
+// 检查路径权限（包括路径上的所有目录）
+int check_path_permission(const char *path, int access) {
+    uint32_t inode_no;
+    return resolve_path_permission(path, access, &inode_no);
 }
 
 // 检查用户是否有权限访问特定路径
 // 这个函数主要处理路径级别的访问控制，而不是文件级别的权限
 int check_user_path_access(const char *path, int access) {
+    uint32_t inode_no;
+    return check_user_path_access_at(path, access, &inode_no);
+}
+
+// 同上，放行时 *inode_no 返回顺带解析出的目标inode（没有解析时为0）
+int check_user_path_access_at(const char *path, int access, uint32_t *inode_no) {
     uint16_t uid = get_current_uid();
+    *inode_no = 0;
 
     // root用户有所有权限
     if (uid == 0) {
-        return 1;
+        return resolve_path_permission(path, access, inode_no);
     }
 
     // 获取当前用户名
@@ -329,7 +347,7 @@ int check_user_path_access(const char *path, int access) {
         // 允许访问根目录 /，但只允许读和执行，不允许写
         if (strcmp(path, "/") == 0) {
             if ((access & EXT2_S_IWUSR) == 0) {
-                int ret = check_path_permission(path, access);
+                int ret = resolve_path_permission(path, access, inode_no);
                 return ret;
             } else {
                 return 0;
@@ -342,7 +360,7 @@ int check_user_path_access(const char *path, int access) {
             if (strcmp(path, "/home") != 0 && strcmp(path, "/root") != 0) {
                 // 不是 /home 或 /root，允许访问但只读
                 if ((access & EXT2_S_IWUSR) == 0) {
-                    int ret = check_path_permission(path, access);
+                    int ret = resolve_path_permission(path, access, inode_no);
                     return ret;
                 } else {
                     return 0;
@@ -352,14 +370,14 @@ int check_user_path_access(const char *path, int access) {
         
         // 允许访问 /home 目录
         if (strcmp(path, "/home") == 0) {
-            int ret = check_path_permission(path, access);
+            int ret = resolve_path_permission(path, access, inode_no);
             return ret;
         }
         
         // 允许访问 /root 目录，只能读（不允许写/执行）
         if (strcmp(path, "/root") == 0) {
             if ((access & (EXT2_S_IWUSR | EXT2_S_IXUSR)) == 0) {
-                int ret = check_path_permission(path, access);
+                int ret = resolve_path_permission(path, access, inode_no);
                 return ret;
             } else {
                 return 0;
@@ -372,7 +390,7 @@ int check_user_path_access(const char *path, int access) {
         if (strncmp(path, home_path, strlen(home_path)) == 0) {
             // 允许访问 /home/username 或 /home/username/xxx
             if (path[strlen(home_path)] == '\0' || path[strlen(home_path)] == '/') {
-                int ret = check_path_permission(path, access);
+                int ret = resolve_path_permission(path, access, inode_no);
                 return ret;
             }
         }
@@ -392,7 +410,7 @@ int check_user_path_access(const char *path, int access) {
                 if (strcmp(other_username, username) != 0) {
                     if ((access & EXT2_S_IWUSR) == 0) {
                         // 只允许读和执行，不允许写
-                        int ret = check_path_permission(path, access);
+                        int ret = resolve_path_permission(path, access, inode_no);
                         return ret;
                     } else {
                         return 0;
@@ -403,7 +421,7 @@ int check_user_path_access(const char *path, int access) {
                 if (strcmp(path_part, username) != 0) {
                     if ((access & EXT2_S_IWUSR) == 0) {
                         // 只允许读和执行，不允许写
-                        int ret = check_path_permission(path, access);
+                        int ret = resolve_path_permission(path, access, inode_no);
                         return ret;
                     } else {
                         return 0;